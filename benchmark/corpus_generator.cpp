@@ -0,0 +1,322 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+// 合成 ObjC 工程：自带 Foundation 桩头文件，不依赖 Xcode，在 Linux 上即可解析
+//
+// 输出目录：
+//   sdk/Foundation/Foundation.h   以 -isystem 引入，视为系统源码
+//   src/BenchForward.h            所有类的 @class 前置声明
+//   src/BenchUtil.h               不含类名的 inline 工具函数
+//   src/BenchFile<N>.h/.m         类、分类、typedef、泛型属性、宏、字符串字面量
+//   compile_commands.json
+//   rename.txt                    BenchClass* -> Obf*
+#include <random>
+#include <set>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> OutputDir("output", cl::desc("Directory the corpus is generated into"),
+    cl::value_desc("directory"), cl::Required);
+static cl::opt<unsigned> ClassCount("classes", cl::desc("Number of classes"), cl::init(2000));
+static cl::opt<unsigned> FileCount("files", cl::desc("Number of .h/.m pairs the classes are spread over"), cl::init(200));
+static cl::opt<unsigned> CategoryCount("categories", cl::desc("Number of categories on random classes"), cl::init(400));
+static cl::opt<unsigned> GenericsDepth("generics-depth",
+    cl::desc("Nesting depth of the generic collection property of each class"), cl::init(2));
+static cl::opt<unsigned> MacroPercent("macro-percent",
+    cl::desc("Percentage of class messages spelled through a macro"), cl::init(20));
+static cl::opt<unsigned> LiteralsPerClass("literals", cl::desc("String literals naming classes per implementation"),
+    cl::init(2));
+static cl::opt<unsigned> ImportsPerFile("imports", cl::desc("Other headers imported by each .m file"), cl::init(4));
+static cl::opt<unsigned> InlineHelpers("inline-helpers",
+    cl::desc("Inline functions with bodies in the SDK stub and in BenchUtil.h each"), cl::init(8));
+static cl::opt<unsigned> Seed("seed", cl::desc("Random seed, the same seed gives the same corpus"), cl::init(1));
+
+static const char FoundationStub[] = R"(#pragma once
+#define NS_ASSUME_NONNULL_BEGIN _Pragma("clang assume_nonnull begin")
+#define NS_ASSUME_NONNULL_END _Pragma("clang assume_nonnull end")
+
+typedef signed char BOOL;
+#define YES ((BOOL)1)
+#define NO ((BOOL)0)
+typedef unsigned long NSUInteger;
+typedef long NSInteger;
+
+@protocol NSObject
+- (BOOL)isEqual:(id)object;
+@end
+
+__attribute__((objc_root_class))
+@interface NSObject <NSObject>
++ (instancetype)alloc;
++ (instancetype)new;
++ (Class)class;
+- (instancetype)init;
+@end
+
+@interface NSString : NSObject
+@property (readonly) NSUInteger length;
+- (NSString *)stringByAppendingString:(NSString *)aString;
+@end
+
+@interface NSConstantString : NSString
+@end
+
+@interface NSNumber : NSObject
++ (NSNumber *)numberWithInteger:(NSInteger)value;
+@end
+
+@interface NSArray<__covariant ObjectType> : NSObject
+@property (readonly) NSUInteger count;
+- (ObjectType)firstObject;
+@end
+
+@interface NSMutableArray<ObjectType> : NSArray<ObjectType>
+- (void)addObject:(ObjectType)anObject;
+@end
+
+@interface NSDictionary<__covariant KeyType, __covariant ObjectType> : NSObject
+- (ObjectType)objectForKey:(KeyType)aKey;
+@end
+
+NSString *NSStringFromClass(Class aClass);
+Class NSClassFromString(NSString *aClassName);
+
+static inline NSUInteger NSBenchHash(NSUInteger value)
+{
+    NSUInteger hash = value;
+    for (int i = 0; i < 4; i++)
+        hash = hash * 2654435761u + (NSUInteger)i;
+    return hash;
+}
+)";
+
+static bool writeFile(StringRef path, StringRef content)
+{
+    std::error_code ec;
+    raw_fd_ostream os(path, ec, sys::fs::OF_None);
+    if (ec)
+    {
+        errs() << "cannot open " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    os << content;
+    return true;
+}
+
+//count 个带函数体的 inline 函数，模拟头文件中与类名无关的实现代码
+static std::string inlineHelpers(StringRef prefix, unsigned count)
+{
+    std::string helpers;
+    raw_string_ostream os(helpers);
+    for (unsigned i = 0; i < count; i++)
+    {
+        os << "\nstatic inline unsigned long " << prefix << i << "(unsigned long value)\n{\n"
+           << "    unsigned long hash = value ^ " << i << "u;\n"
+           << "    for (int round = 0; round < " << (i % 4 + 2) << "; round++)\n"
+           << "        hash = (hash << 5) + hash + (unsigned long)round;\n"
+           << "    return hash;\n}\n";
+    }
+    return os.str();
+}
+
+static std::string className(unsigned index)
+{
+    return "BenchClass" + std::to_string(index);
+}
+
+//depth 层嵌套的泛型集合类型，最内层为类指针
+static std::string genericType(unsigned depth, unsigned classIndex)
+{
+    if (depth == 0)
+        return className(classIndex) + " *";
+    std::string inner = genericType(depth - 1, classIndex);
+    if (depth % 2)
+        return "NSArray<" + inner + "> *";
+    return "NSDictionary<NSString *, " + inner + "> *";
+}
+
+int main(int argc, const char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "synthetic Objective-C corpus generator\n");
+    if (ClassCount == 0 || FileCount == 0)
+    {
+        errs() << "--classes and --files must be positive\n";
+        return 1;
+    }
+    unsigned files = std::min<unsigned>(FileCount, ClassCount);
+    std::mt19937 rng(Seed);
+    auto pick = [&](unsigned bound) { return std::uniform_int_distribution<unsigned>(0, bound - 1)(rng); };
+
+    SmallString<256> root(OutputDir);
+    sys::fs::make_absolute(root);
+    SmallString<256> sdkDir(root), srcDir(root);
+    sys::path::append(sdkDir, "sdk");
+    sys::path::append(srcDir, "src");
+    SmallString<256> foundationDir(sdkDir);
+    sys::path::append(foundationDir, "Foundation");
+    for (StringRef dir : {StringRef(foundationDir), StringRef(srcDir)})
+    {
+        if (std::error_code ec = sys::fs::create_directories(dir))
+        {
+            errs() << "cannot create " << dir << ": " << ec.message() << "\n";
+            return 1;
+        }
+    }
+    if (!writeFile((foundationDir + "/Foundation.h").str(), FoundationStub + inlineHelpers("NSBenchInline", InlineHelpers)))
+        return 1;
+
+    //类按顺序连续分到各文件中
+    auto fileOfClass = [&](unsigned index) { return uint64_t(index) * files / ClassCount; };
+    std::vector<std::vector<unsigned>> classesOfFile(files);
+    for (unsigned i = 0; i < ClassCount; i++)
+        classesOfFile[fileOfClass(i)].push_back(i);
+    //接口与实现中方法签名用到的类需一致
+    std::vector<unsigned> returnClass(ClassCount), argumentClass(ClassCount);
+    for (unsigned i = 0; i < ClassCount; i++)
+    {
+        returnClass[i] = pick(ClassCount);
+        argumentClass[i] = pick(ClassCount);
+    }
+    std::vector<std::vector<unsigned>> categoriesOfFile(files);
+    std::vector<unsigned> categoryClass(CategoryCount);
+    for (unsigned c = 0; c < CategoryCount; c++)
+    {
+        categoryClass[c] = pick(ClassCount);
+        categoriesOfFile[fileOfClass(categoryClass[c])].push_back(c);
+    }
+
+    std::string forward = "#pragma once\n";
+    for (unsigned i = 0; i < ClassCount; i++)
+        forward += "@class " + className(i) + ";\n";
+    if (!writeFile((srcDir + "/BenchForward.h").str(), forward) ||
+        !writeFile((srcDir + "/BenchUtil.h").str(), "#pragma once\n" + inlineHelpers("BenchUtil", InlineHelpers)))
+        return 1;
+
+    json::Array commands;
+    for (unsigned f = 0; f < files; f++)
+    {
+        std::string base = "BenchFile" + std::to_string(f);
+        std::string header;
+        raw_string_ostream h(header);
+        h << "#pragma once\n#import <Foundation/Foundation.h>\n#import \"BenchForward.h\"\n#import \"BenchUtil.h\"\n\n"
+             "NS_ASSUME_NONNULL_BEGIN\n\n";
+        for (unsigned i : classesOfFile[f])
+        {
+            //同一文件中前面的类可以作为父类
+            std::string super = (i != classesOfFile[f].front() && pick(2)) ? className(i - 1) : "NSObject";
+            h << "@interface " << className(i) << " : " << super << "\n{\n"
+              << "    " << className(pick(ClassCount)) << " *_ivar" << i << ";\n}\n"
+              << "@property (nonatomic, strong) " << className(pick(ClassCount)) << " *link;\n"
+              << "@property (nonatomic, strong) " << genericType(GenericsDepth, pick(ClassCount)) << "items;\n"
+              << "- (" << className(returnClass[i]) << " *)makeWith:(" << className(argumentClass[i]) << " *)other;\n"
+              << "+ (instancetype)shared;\n@end\n\n"
+              << "typedef " << className(i) << " *" << className(i) << "Ref;\n\n";
+        }
+        for (unsigned c : categoriesOfFile[f])
+        {
+            h << "@interface " << className(categoryClass[c]) << " (BenchCat" << c << ")\n"
+              << "- (id)benchCat" << c << ";\n@end\n\n";
+        }
+        //头文件中向类发消息的 inline 函数，其中的类名同样要改写
+        unsigned headerClass = classesOfFile[f].front();
+        h << "static inline id BenchMake" << f << "(void)\n{\n    return [" << className(headerClass) << " new];\n}\n\n"
+          << "NS_ASSUME_NONNULL_END\n";
+        h.flush();
+        if (!writeFile((srcDir + "/" + base + ".h").str(), header))
+            return 1;
+
+        //.m 中只向可见(本文件及 import 的文件)的类发消息
+        std::set<unsigned> importedFiles = {f};
+        for (unsigned k = 0; k < ImportsPerFile; k++)
+            importedFiles.insert(pick(files));
+        std::vector<unsigned> visible;
+        for (unsigned imported : importedFiles)
+            visible.insert(visible.end(), classesOfFile[imported].begin(), classesOfFile[imported].end());
+        auto pickVisible = [&]() { return visible[pick(visible.size())]; };
+
+        std::string source;
+        raw_string_ostream m(source);
+        for (unsigned imported : importedFiles)
+            m << "#import \"BenchFile" << imported << ".h\"\n";
+        m << "\n#define BENCH_NEW(cls) [cls new]\n#define BENCH_CAST(cls, value) ((cls *)(value))\n\n";
+        auto classMessage = [&](unsigned index) {
+            if (pick(100) < MacroPercent)
+                return "BENCH_NEW(" + className(index) + ")";
+            return "[" + className(index) + " new]";
+        };
+        for (unsigned i : classesOfFile[f])
+        {
+            unsigned made = pickVisible();
+            m << "@implementation " << className(i) << "\n"
+              << "- (" << className(returnClass[i]) << " *)makeWith:(" << className(argumentClass[i]) << " *)other\n{\n"
+              << "    " << className(made) << " *result = " << classMessage(made) << ";\n"
+              << "    " << className(i) << "Ref selfRef = BENCH_CAST(" << className(i) << ", other);\n"
+              << "    (void)selfRef;\n"
+              << "    NSBenchHash(" << i << ");\n";
+            for (unsigned l = 0; l < LiteralsPerClass; l++)
+            {
+                unsigned named = pickVisible();
+                if (l % 2)
+                    m << "    NSString *key" << l << " = @\"" << className(named) << ".cell\";\n";
+                else
+                    m << "    Class cls" << l << " = NSClassFromString(@\"" << className(named) << "\");\n";
+                m << "    (void)" << (l % 2 ? "key" : "cls") << l << ";\n";
+            }
+            m << "    return (" << className(returnClass[i]) << " *)result;\n}\n"
+              << "+ (instancetype)shared\n{\n    return [[self alloc] init];\n}\n@end\n\n";
+        }
+        for (unsigned c : categoriesOfFile[f])
+        {
+            unsigned made = pickVisible();
+            m << "@implementation " << className(categoryClass[c]) << " (BenchCat" << c << ")\n"
+              << "- (id)benchCat" << c << "\n{\n    return " << classMessage(made) << ";\n}\n@end\n\n";
+        }
+        m.flush();
+        std::string sourcePath = (srcDir + "/" + base + ".m").str();
+        if (!writeFile(sourcePath, source))
+            return 1;
+
+        json::Array arguments{"clang", "-x", "objective-c", "-fobjc-runtime=macosx", "-fblocks", "-fsyntax-only",
+                              "-isystem", sdkDir.str(), "-I", srcDir.str(), sourcePath};
+        commands.push_back(json::Object{{"directory", root.str()}, {"file", sourcePath},
+                                        {"arguments", std::move(arguments)}});
+    }
+
+    std::string database;
+    raw_string_ostream db(database);
+    db << formatv("{0:2}", json::Value(std::move(commands))) << "\n";
+    db.flush();
+    if (!writeFile((root + "/compile_commands.json").str(), database) ||
+        !writeFile((root + "/rename.txt").str(), "BenchClass* Obf*\n"))
+        return 1;
+    outs() << "generated " << ClassCount << " classes, " << CategoryCount << " categories in " << files
+           << " files under " << root << "\n";
+    return 0;
+}
@@ -0,0 +1,170 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+// 反混淆吞吐基准：由 NameGenerator 生成的新名构造清单和反向索引，合成崩溃日志，
+// 在不同的 --jobs 下还原，报告 GB/s 并校验输出与原始日志完全一致
+#include "deobfuscator.hpp"
+#include "name_generator.hpp"
+
+#include <chrono>
+#include <random>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> ClassCount("classes", cl::desc("Number of renamed classes"), cl::init(100000));
+static cl::opt<unsigned> LogMegabytes("megabytes", cl::desc("Size of the synthetic log"), cl::init(512));
+static cl::list<unsigned> JobsList("jobs-list", cl::desc("Job counts to measure (default 1,2,4,8)"),
+    cl::CommaSeparated);
+
+int main(int argc, const char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "deobfuscation throughput benchmark\n");
+
+    NameGenerator generator("deobfuscate-bench", 12);
+    std::vector<std::string> oldNames, newNames;
+    std::vector<ManifestRecord> records;
+    SmallString<32> newName;
+    for (unsigned i = 0; i < ClassCount; i++)
+    {
+        oldNames.push_back("DemoClass" + std::to_string(i) + "ViewController");
+        generator.addReserved(oldNames.back());
+    }
+    for (unsigned i = 0; i < ClassCount; i++)
+    {
+        newNames.push_back(generator.generate(oldNames[i], "", newName).str());
+        ManifestRecord record;
+        record.kind = rename_manifest::EK_Interface;
+        record.oldName = oldNames[i];
+        record.newName = newNames[i];
+        record.file = "DemoClass" + std::to_string(i) + "ViewController.h";
+        record.line = 12;
+        record.column = 12;
+        records.push_back(std::move(record));
+    }
+    ManifestBuilder manifestBuilder;
+    manifestBuilder.add(records);
+    SmallString<128> manifestPath;
+    if (std::error_code ec = sys::fs::createTemporaryFile("deobfuscate-bench", "bin", manifestPath))
+    {
+        errs() << "cannot create temporary manifest: " << ec.message() << "\n";
+        return 1;
+    }
+    if (!manifestBuilder.writeBinary(manifestPath, errs()))
+        return 1;
+
+    auto buildStart = std::chrono::steady_clock::now();
+    std::unique_ptr<RenameManifest> manifest = RenameManifest::load(manifestPath, errs());
+    if (!manifest)
+        return 1;
+    std::string image;
+    ReverseIndex::BuildStats buildStats;
+    ReverseIndex::build(*manifest, image, buildStats);
+    std::unique_ptr<ReverseIndex> index = ReverseIndex::create(MemoryBuffer::getMemBuffer(image, "index", false), errs());
+    if (!index)
+        return 1;
+    double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+    sys::fs::remove(manifestPath);
+
+    //每个崩溃帧一个类名，夹杂系统帧和线程标题；同时生成期望的还原结果
+    std::string obfuscated, expected;
+    std::mt19937 rng(1);
+    size_t frames = 0;
+    while (obfuscated.size() < size_t(LogMegabytes) << 20)
+    {
+        unsigned k = rng() % ClassCount;
+        std::string frame = std::to_string(frames % 64) + "   MyApp                         0x0000000104a8c3f4 ";
+        auto addFrame = [&](StringRef className, std::string &log) {
+            log += frame;
+            log += (frames % 3 ? "-[" : "+[");
+            log += className;
+            log += " viewDidLoad] + 128\n";
+            if (frames % 5 == 0)
+                log += "5   UIKitCore                     0x00000001a2c3e4f0 -[UIViewController loadViewIfRequired] + 1012\n";
+            if (frames % 4 == 0)
+                log += "_OBJC_CLASS_$_" + className.str() + "\n";
+            if (frames % 64 == 0)
+                log += "\nThread 0 Crashed:: Dispatch queue: com.apple.main-thread\n";
+        };
+        addFrame(newNames[k], obfuscated);
+        addFrame(oldNames[k], expected);
+        frames++;
+    }
+
+    //按 deobfuscate 子命令的方式从文件流式读入，读入与改写重叠
+    SmallString<128> logPath;
+    if (std::error_code ec = sys::fs::createTemporaryFile("deobfuscate-bench", "log", logPath))
+    {
+        errs() << "cannot create temporary log: " << ec.message() << "\n";
+        return 1;
+    }
+    {
+        std::error_code ec;
+        raw_fd_ostream log(logPath, ec);
+        if (!ec)
+        {
+            log << obfuscated;
+            log.close();
+        }
+        if (ec || log.has_error())
+        {
+            errs() << "cannot write " << logPath << "\n";
+            log.clear_error();
+            sys::fs::remove(logPath);
+            return 1;
+        }
+    }
+
+    std::vector<unsigned> jobCounts(JobsList.begin(), JobsList.end());
+    if (jobCounts.empty())
+        jobCounts = {1, 2, 4, 8};
+    outs() << format("%u names, index %.1f MB built in %.3f s; log %.1f MB, %zu frames\n", index->getNameCount(),
+                     image.size() / 1048576.0, buildSeconds, obfuscated.size() / 1048576.0, frames);
+    outs() << " jobs   wall(s)      GB/s   restored\n";
+    bool mismatch = false;
+    for (unsigned jobs : jobCounts)
+    {
+        Deobfuscator deobfuscator(*index, jobs);
+        std::string result;
+        result.reserve(expected.size());
+        raw_string_ostream os(result);
+        auto start = std::chrono::steady_clock::now();
+        bool ran = deobfuscator.run(logPath, os, errs());
+        os.flush();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        outs() << format("%5u %9.3f %9.2f %10llu\n", jobs, seconds, obfuscated.size() / seconds / 1e9,
+                         (unsigned long long)deobfuscator.getReplacedCount());
+        mismatch |= !ran || result != expected;
+    }
+    sys::fs::remove(logPath);
+    if (mismatch)
+    {
+        outs() << "deobfuscated log differs from the original\n";
+        return 1;
+    }
+    return 0;
+}
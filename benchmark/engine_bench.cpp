@@ -0,0 +1,105 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+// 对比 matcher 与 visitor 两种遍历引擎：同一批TU，比较耗时并校验编辑完全一致
+#include "objc_obfuscator.hpp"
+#include "parallel_driver.hpp"
+
+#include <chrono>
+
+#include "llvm/Support/Format.h"
+
+static llvm::cl::OptionCategory BenchCategory("engine-bench options");
+static cl::opt<std::string> RenameMapFile("rename-map", cl::desc("Rename map used by both engines"),
+    cl::value_desc("filename"), cl::cat(BenchCategory));
+static cl::opt<unsigned> Repeat("repeat", cl::desc("Runs per engine, the fastest one is reported"),
+    cl::init(3), cl::cat(BenchCategory));
+
+struct EngineRun
+{
+    double wallSeconds = 0;
+    double traversalSeconds = 0;
+    size_t editCount = 0;
+    FileEdits edits;
+};
+
+static EngineRun runEngine(const CompilationDatabase &compilations, ArrayRef<std::string> files, ObfConfig config, ObfEngine engine)
+{
+    config.engine = engine;
+    EngineRun best;
+    for (unsigned i = 0; i < Repeat; i++)
+    {
+        //单线程，避免调度对计时的干扰
+        ParallelObfDriver driver(compilations, config, 1);
+        auto start = std::chrono::steady_clock::now();
+        driver.run(files);
+        EngineRun run;
+        run.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ReplacementMerger merger;
+        for (const TUResult &result : driver.getResults())
+        {
+            merger.add(result);
+            run.traversalSeconds += result.traversalSeconds;
+        }
+        run.edits = merger.getEdits();
+        for (const auto &fileEdits : run.edits)
+            run.editCount += fileEdits.second.size();
+        if (i == 0 || run.traversalSeconds < best.traversalSeconds)
+            best = std::move(run);
+    }
+    return best;
+}
+
+int main(int argc, const char **argv)
+{
+    auto OptionsParser = CommonOptionsParser::create(argc, argv, BenchCategory);
+    if (!OptionsParser)
+    {
+        errs() << toString(OptionsParser.takeError());
+        return 1;
+    }
+    RenameMap renameMap;
+    if (!RenameMapFile.empty() && !renameMap.loadFile(RenameMapFile, errs()))
+        return 1;
+    ObfConfig config;
+    config.renameMap = &renameMap;
+    config.roots.systemRoots.push_back("/Applications/Xcode.app/");
+
+    const std::vector<std::string> &files = OptionsParser->getSourcePathList();
+    EngineRun matcherRun = runEngine(OptionsParser->getCompilations(), files, config, ObfEngine::Matcher);
+    EngineRun visitorRun = runEngine(OptionsParser->getCompilations(), files, config, ObfEngine::Visitor);
+
+    outs() << format("%-8s %10s %14s %8s\n", "engine", "wall(s)", "traversal(s)", "edits");
+    outs() << format("%-8s %10.3f %14.3f %8zu\n", "matcher", matcherRun.wallSeconds, matcherRun.traversalSeconds, matcherRun.editCount);
+    outs() << format("%-8s %10.3f %14.3f %8zu\n", "visitor", visitorRun.wallSeconds, visitorRun.traversalSeconds, visitorRun.editCount);
+    if (visitorRun.traversalSeconds > 0)
+        outs() << format("traversal speedup: %.2fx\n", matcherRun.traversalSeconds / visitorRun.traversalSeconds);
+
+    if (matcherRun.edits != visitorRun.edits)
+    {
+        outs() << "edits differ between engines\n";
+        return 1;
+    }
+    outs() << "edits identical\n";
+    return 0;
+}
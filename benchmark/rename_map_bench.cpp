@@ -0,0 +1,146 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+// 重命名表查询的微基准：50k 精确名 + 前缀/通配规则
+#include "literal_scanner.hpp"
+#include "rename_map.hpp"
+
+#include <chrono>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> EntryCount("entries", cl::desc("Number of exact names in the map"), cl::init(50000));
+static cl::opt<unsigned> Iterations("iterations", cl::desc("Lookups per scenario"), cl::init(10000000));
+
+template <typename Fn>
+static void measure(StringRef label, Fn fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t hits = fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / Iterations;
+    outs() << format("%-28s %8.2f ns/lookup  (%zu hits)\n", label.str().c_str(), ns, hits);
+}
+
+int main(int argc, const char **argv)
+{
+    cl::ParseCommandLineOptions(argc, argv, "rename map lookup benchmark\n");
+
+    std::vector<std::string> names, misses, prefixed;
+    for (unsigned i = 0; i < EntryCount; i++)
+    {
+        names.push_back("DemoClass" + std::to_string(i * 7919u) + "ViewController");
+        misses.push_back("UIKitClass" + std::to_string(i * 7919u) + "ViewController");
+        prefixed.push_back("XYZ" + std::to_string(i) + "Cell");
+    }
+
+    RenameMap renameMap;
+    std::string error;
+    for (unsigned i = 0; i < EntryCount; i++)
+        renameMap.addRule(names[i], "N" + std::to_string(i), error);
+    renameMap.addRule("XYZ*", "Q*", error);
+    renameMap.addRule("*Cell", "C*", error);
+    outs() << "rules: " << renameMap.size() << "\n";
+
+    auto pick = [&](const std::vector<std::string> &v, unsigned i) -> StringRef {
+        return v[(i * 2654435761u) % v.size()];
+    };
+
+    measure("exact hit", [&]() {
+        SmallString<64> scratch;
+        size_t hits = 0;
+        for (unsigned i = 0; i < Iterations; i++)
+            hits += !renameMap.lookup(pick(names, i), scratch).empty();
+        return hits;
+    });
+    measure("miss", [&]() {
+        SmallString<64> scratch;
+        size_t hits = 0;
+        for (unsigned i = 0; i < Iterations; i++)
+            hits += !renameMap.lookup(pick(misses, i), scratch).empty();
+        return hits;
+    });
+    measure("prefix hit", [&]() {
+        SmallString<64> scratch;
+        size_t hits = 0;
+        for (unsigned i = 0; i < Iterations; i++)
+            hits += !renameMap.lookup(pick(prefixed, i), scratch).empty();
+        return hits;
+    });
+
+    //MatchCallbackHandler 按 IdentifierInfo* 缓存查询结果，这里用字符串地址模拟
+    DenseMap<const void *, StringRef> cache;
+    SmallString<64> scratch;
+    for (const std::string &name : names)
+        cache[name.data()] = renameMap.lookup(name, scratch);
+    for (const std::string &name : misses)
+        cache[name.data()] = renameMap.lookup(name, scratch);
+    measure("pointer-keyed cache", [&]() {
+        size_t hits = 0;
+        for (unsigned i = 0; i < Iterations; i++)
+        {
+            const std::string &name = (i & 1) ? names[(i * 2654435761u) % names.size()] : misses[(i * 2654435761u) % misses.size()];
+            hits += !cache.lookup(name.data()).empty();
+        }
+        return hits;
+    });
+
+    //字符串字面量：一半含有类名(键路径、格式串)，一半不含
+    LiteralScanner scanner(renameMap);
+    std::vector<std::string> literals;
+    for (unsigned i = 0; i < 1024; i++)
+    {
+        if (i & 1)
+            literals.push_back("section." + names[(i * 2654435761u) % names.size()] + ".title %@");
+        else
+            literals.push_back("Failed to load the configuration from disk: %@ (" + std::to_string(i) + ")");
+    }
+    outs() << "literal scanner states: " << scanner.getStateCount() << "\n";
+    //与改写时相同：找出候选，再逐个查表
+    for (LiteralPolicy policy : {LiteralPolicy::Delimited, LiteralPolicy::Substring})
+    {
+        measure(policy == LiteralPolicy::Delimited ? "literal words + lookup" : "literal scan + lookup", [&]() {
+            SmallString<64> scratch;
+            SmallVector<LiteralScanner::Candidate, 4> candidates;
+            size_t hits = 0;
+            for (unsigned i = 0; i < Iterations; i++)
+            {
+                StringRef literal = literals[i % literals.size()];
+                candidates.clear();
+                if (policy == LiteralPolicy::Delimited)
+                    LiteralScanner::splitWords(literal, candidates);
+                else
+                    scanner.scan(literal, policy, candidates);
+                for (const LiteralScanner::Candidate &candidate : candidates)
+                    hits += !renameMap.lookup(literal.substr(candidate.offset, candidate.length), scratch).empty();
+            }
+            return hits;
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,273 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+// 吞吐基准：在不同的 --jobs 下处理同一批TU，报告解析、匹配、改写、写出各阶段的耗时和 files/sec
+//
+//   ObjcCorpusGen --output=corpus
+//   ThroughputBench -p corpus --rename-map=corpus/rename.txt --jobs-list=1,2,4,8
+//
+// 不给源文件时处理编译数据库中的所有文件。--save-baseline 记下各 jobs 下的 files/sec，
+// 之后用 --baseline 对比，任何一项比基线慢超过 --tolerance 即返回 1，可作为回归门禁。
+// --compare-skip-bodies 以第一个 jobs 再跑一轮 --skip-function-bodies，改写与完整解析不一致即返回 1。
+#include "objc_obfuscator.hpp"
+#include "output_writer.hpp"
+#include "parallel_driver.hpp"
+
+#include <chrono>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+static llvm::cl::OptionCategory BenchCategory("throughput-bench options");
+static cl::opt<std::string> RenameMapFile("rename-map", cl::desc("Rename map applied to the corpus"),
+    cl::value_desc("filename"), cl::cat(BenchCategory));
+static cl::list<unsigned> JobsList("jobs-list", cl::desc("Job counts to measure (default 1,2,4,8)"),
+    cl::CommaSeparated, cl::cat(BenchCategory));
+static cl::opt<bool> PerTU("per-tu", cl::desc("Print the phase times of every TU of the single-job run"),
+    cl::cat(BenchCategory));
+static cl::opt<std::string> SaveBaseline("save-baseline", cl::desc("Write files/sec per job count to <filename>"),
+    cl::value_desc("filename"), cl::cat(BenchCategory));
+static cl::opt<std::string> Baseline("baseline", cl::desc("Fail when slower than the files/sec recorded in <filename>"),
+    cl::value_desc("filename"), cl::cat(BenchCategory));
+static cl::opt<bool> CompareSkipBodies("compare-skip-bodies",
+    cl::desc("Also run with --skip-function-bodies and fail unless the edits are identical"), cl::cat(BenchCategory));
+static cl::opt<double> Tolerance("tolerance", cl::desc("Allowed slowdown against --baseline in percent"),
+    cl::init(10), cl::cat(BenchCategory));
+
+struct PhaseTimes
+{
+    double parse = 0;
+    double match = 0;
+    double rewrite = 0;
+
+    void add(const TUResult &result)
+    {
+        parse += std::max(0.0, result.totalSeconds - result.traversalSeconds);
+        match += std::max(0.0, result.traversalSeconds - result.rewriteSeconds);
+        rewrite += result.rewriteSeconds;
+    }
+};
+
+struct ThroughputRun
+{
+    unsigned jobs = 0;
+    double wallSeconds = 0;
+    double writeSeconds = 0;
+    PhaseTimes phases;
+    size_t editCount = 0;
+    unsigned writtenFiles = 0;
+    double filesPerSecond = 0;
+    //各TU遍历结束时 AST 等占用的字节数之和
+    uint64_t memoryBytes = 0;
+    unsigned skippedBodies = 0;
+    std::map<std::string, tooling::Replacements> replacements;
+};
+
+static ThroughputRun runJobs(const CompilationDatabase &compilations, ArrayRef<std::string> files,
+                             const ObfConfig &config, unsigned jobs, StringRef outputDir)
+{
+    ThroughputRun run;
+    run.jobs = jobs;
+    ParallelObfDriver driver(compilations, config, jobs);
+    auto start = std::chrono::steady_clock::now();
+    driver.run(files);
+    ReplacementMerger merger;
+    for (const TUResult &result : driver.getResults())
+    {
+        merger.add(result);
+        run.phases.add(result);
+        run.memoryBytes += result.memoryBytes;
+        run.skippedBodies += result.skippedBodies;
+    }
+    std::map<std::string, tooling::Replacements> &replacements = run.replacements;
+    merger.finalize(replacements, errs());
+    auto writeStart = std::chrono::steady_clock::now();
+    //写到临时目录，不改动语料本身
+    OutputWriter writer(outputDir, jobs);
+    writer.write(replacements, errs());
+    auto end = std::chrono::steady_clock::now();
+    run.writeSeconds = std::chrono::duration<double>(end - writeStart).count();
+    run.wallSeconds = std::chrono::duration<double>(end - start).count();
+    run.writtenFiles = writer.getWrittenCount();
+    for (const auto &fileReplacements : replacements)
+        run.editCount += fileReplacements.second.size();
+    run.filesPerSecond = run.wallSeconds > 0 ? files.size() / run.wallSeconds : 0;
+
+    if (PerTU && jobs == 1 && !config.skipFunctionBodies)
+    {
+        outs() << format("%-48s %9s %9s %9s %9s\n", "TU", "parse(ms)", "match(ms)", "rewrite", "total(ms)");
+        for (const TUResult &result : driver.getResults())
+        {
+            PhaseTimes tu;
+            tu.add(result);
+            outs() << format("%-48s %9.2f %9.2f %9.2f %9.2f\n", sys::path::filename(result.mainFile).str().c_str(),
+                             tu.parse * 1e3, tu.match * 1e3, tu.rewrite * 1e3, result.totalSeconds * 1e3);
+        }
+    }
+    return run;
+}
+
+//基线文件每行 "jobs files/sec"
+static std::map<unsigned, double> loadBaseline(StringRef path)
+{
+    std::map<unsigned, double> baseline;
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+    {
+        errs() << "cannot read baseline " << path << ": " << buffer.getError().message() << "\n";
+        return baseline;
+    }
+    SmallVector<StringRef, 16> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, false);
+    for (StringRef line : lines)
+    {
+        StringRef jobsText, rateText;
+        std::tie(jobsText, rateText) = line.trim().split(' ');
+        unsigned jobs;
+        double rate;
+        if (!jobsText.getAsInteger(10, jobs) && !rateText.trim().getAsDouble(rate))
+            baseline[jobs] = rate;
+    }
+    return baseline;
+}
+
+int main(int argc, const char **argv)
+{
+    auto OptionsParser = CommonOptionsParser::create(argc, argv, BenchCategory, cl::ZeroOrMore);
+    if (!OptionsParser)
+    {
+        errs() << toString(OptionsParser.takeError());
+        return 1;
+    }
+    RenameMap renameMap;
+    if (!RenameMapFile.empty() && !renameMap.loadFile(RenameMapFile, errs()))
+        return 1;
+    ObfConfig config;
+    config.renameMap = &renameMap;
+    config.roots.systemRoots.push_back("/Applications/Xcode.app/");
+
+    std::vector<std::string> files = OptionsParser->getSourcePathList();
+    if (files.empty())
+        files = OptionsParser->getCompilations().getAllFiles();
+    if (files.empty())
+    {
+        errs() << "no translation units to process\n";
+        return 1;
+    }
+    std::vector<unsigned> jobCounts(JobsList.begin(), JobsList.end());
+    if (jobCounts.empty())
+        jobCounts = {1, 2, 4, 8};
+
+    SmallString<128> outputDir;
+    if (std::error_code ec = sys::fs::createUniqueDirectory("throughput-bench", outputDir))
+    {
+        errs() << "cannot create output directory: " << ec.message() << "\n";
+        return 1;
+    }
+
+    std::vector<ThroughputRun> runs;
+    for (unsigned jobs : jobCounts)
+        runs.push_back(runJobs(OptionsParser->getCompilations(), files, config, jobs, outputDir));
+    ThroughputRun skipRun;
+    if (CompareSkipBodies)
+    {
+        LiteralScanner scanner(renameMap);
+        ObfConfig skipConfig = config;
+        skipConfig.skipFunctionBodies = true;
+        skipConfig.literalScanner = &scanner;
+        skipRun = runJobs(OptionsParser->getCompilations(), files, skipConfig, runs.front().jobs, outputDir);
+    }
+    sys::fs::remove_directories(outputDir);
+
+    //各阶段为所有TU的耗时之和(CPU 时间意义上)，wall 为整轮的墙钟时间
+    outs() << format("%zu TUs\n", files.size());
+    outs() << format("%5s %9s %9s %9s %9s %9s %10s %8s %8s\n", "jobs", "wall(s)", "parse(s)", "match(s)", "rewrite",
+                     "write(s)", "files/sec", "edits", "written");
+    for (const ThroughputRun &run : runs)
+    {
+        outs() << format("%5u %9.3f %9.3f %9.3f %9.3f %9.3f %10.1f %8zu %8u\n", run.jobs, run.wallSeconds,
+                         run.phases.parse, run.phases.match, run.phases.rewrite, run.writeSeconds,
+                         run.filesPerSecond, run.editCount, run.writtenFiles);
+    }
+    const ThroughputRun &first = runs.front();
+    outs() << format("per TU (jobs=%u): parse %.2f ms, match %.2f ms, rewrite %.2f ms, write %.2f ms\n", first.jobs,
+                     first.phases.parse * 1e3 / files.size(), first.phases.match * 1e3 / files.size(),
+                     first.phases.rewrite * 1e3 / files.size(), first.writeSeconds * 1e3 / files.size());
+    //不同线程数下编辑必须一致
+    for (const ThroughputRun &run : runs)
+    {
+        if (run.editCount != first.editCount)
+        {
+            outs() << "edit count differs between job counts\n";
+            return 1;
+        }
+    }
+    if (CompareSkipBodies)
+    {
+        outs() << format("skip-function-bodies (jobs=%u): %u bodies skipped, parse %.3f s -> %.3f s, "
+                         "AST memory %.1f MB -> %.1f MB\n",
+                         first.jobs, skipRun.skippedBodies, first.phases.parse, skipRun.phases.parse,
+                         first.memoryBytes / 1048576.0, skipRun.memoryBytes / 1048576.0);
+        //跳过函数体不允许丢失或多出任何改写
+        if (skipRun.replacements != first.replacements)
+        {
+            outs() << "edits differ with --skip-function-bodies\n";
+            return 1;
+        }
+    }
+
+    if (!SaveBaseline.empty())
+    {
+        std::error_code ec;
+        raw_fd_ostream os(SaveBaseline, ec, sys::fs::OF_None);
+        if (ec)
+        {
+            errs() << "cannot open " << SaveBaseline << ": " << ec.message() << "\n";
+            return 1;
+        }
+        for (const ThroughputRun &run : runs)
+            os << run.jobs << " " << format("%.3f", run.filesPerSecond) << "\n";
+    }
+    if (!Baseline.empty())
+    {
+        std::map<unsigned, double> baseline = loadBaseline(Baseline);
+        bool regressed = false;
+        for (const ThroughputRun &run : runs)
+        {
+            auto expected = baseline.find(run.jobs);
+            if (expected == baseline.end())
+                continue;
+            double change = (run.filesPerSecond / expected->second - 1) * 100;
+            outs() << format("jobs=%u: %.1f files/sec, baseline %.1f (%+.1f%%)\n", run.jobs, run.filesPerSecond,
+                             expected->second, change);
+            regressed |= change < -Tolerance;
+        }
+        if (regressed)
+        {
+            outs() << "throughput regressed by more than " << Tolerance << "%\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+// 先写同目录下的临时文件，关闭并确认没有写错误后再 rename 到 path：
+// 磁盘满、I/O 错误时报告并返回 false，path 保持原样，不会留下截断的文件
+inline bool writeFileAtomically(llvm::StringRef path, llvm::function_ref<void(llvm::raw_ostream &)> write,
+                                llvm::raw_ostream &errs)
+{
+    llvm::SmallString<256> tempPath;
+    int fd;
+    if (std::error_code ec = llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, tempPath))
+    {
+        errs << "cannot open " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    {
+        llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+        write(os);
+        os.close();
+        if (os.has_error())
+        {
+            errs << "cannot write " << path << ": " << os.error().message() << "\n";
+            os.clear_error();
+            llvm::sys::fs::remove(tempPath);
+            return false;
+        }
+    }
+    if (std::error_code ec = llvm::sys::fs::rename(tempPath, path))
+    {
+        errs << "cannot write " << path << ": " << ec.message() << "\n";
+        llvm::sys::fs::remove(tempPath);
+        return false;
+    }
+    return true;
+}
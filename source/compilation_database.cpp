@@ -0,0 +1,441 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "compilation_database.hpp"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ConvertUTF.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+using namespace clang::tooling;
+
+namespace {
+
+// 顺序读取 JSON 的游标，只支持加载编译数据库所需的操作
+class JSONCursor
+{
+public:
+    explicit JSONCursor(StringRef aContent) : content(aContent) {}
+
+    bool atEnd()
+    {
+        skipSpace();
+        return position >= content.size();
+    }
+    //跳过空白后下一个字符为 c 时消耗它
+    bool consume(char c)
+    {
+        skipSpace();
+        if (position < content.size() && content[position] == c)
+        {
+            position++;
+            return true;
+        }
+        return false;
+    }
+    bool expect(char c)
+    {
+        if (consume(c))
+            return true;
+        return fail(std::string("expected '") + c + "'");
+    }
+    bool readString(std::string &value);
+    bool skipValue(unsigned depth = 0);
+
+    bool fail(const std::string &message)
+    {
+        if (error.empty())
+        {
+            size_t line = 1 + content.take_front(std::min(position, content.size())).count('\n');
+            error = "line " + std::to_string(line) + ": " + message;
+        }
+        return false;
+    }
+    const std::string &getError() const { return error; }
+
+private:
+    void skipSpace()
+    {
+        while (position < content.size() && isSpace(content[position]))
+            position++;
+    }
+    bool readHex4(unsigned &value);
+
+    StringRef content;
+    size_t position = 0;
+    std::string error;
+};
+
+bool JSONCursor::readHex4(unsigned &value)
+{
+    if (position + 4 > content.size() || content.substr(position, 4).getAsInteger(16, value))
+        return fail("invalid \\u escape");
+    position += 4;
+    return true;
+}
+
+bool JSONCursor::readString(std::string &value)
+{
+    value.clear();
+    if (!expect('"'))
+        return false;
+    while (true)
+    {
+        //没有转义的部分整段复制
+        size_t end = content.find_first_of("\"\\", position);
+        if (end == StringRef::npos)
+            return fail("unterminated string");
+        value.append(content.data() + position, end - position);
+        position = end + 1;
+        if (content[end] == '"')
+            return true;
+        if (position >= content.size())
+            return fail("unterminated string");
+        char escaped = content[position++];
+        switch (escaped)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            value += escaped;
+            break;
+        case 'b':
+            value += '\b';
+            break;
+        case 'f':
+            value += '\f';
+            break;
+        case 'n':
+            value += '\n';
+            break;
+        case 'r':
+            value += '\r';
+            break;
+        case 't':
+            value += '\t';
+            break;
+        case 'u':
+        {
+            unsigned codePoint;
+            if (!readHex4(codePoint))
+                return false;
+            //代理对
+            if (codePoint >= 0xD800 && codePoint < 0xDC00 && content.substr(position).startswith("\\u"))
+            {
+                position += 2;
+                unsigned low;
+                if (!readHex4(low))
+                    return false;
+                if (low < 0xDC00 || low >= 0xE000)
+                    return fail("invalid surrogate pair");
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+            char buffer[UNI_MAX_UTF8_BYTES_PER_CODE_POINT];
+            char *out = buffer;
+            if (!ConvertCodePointToUTF8(codePoint, out))
+                return fail("invalid \\u escape");
+            value.append(buffer, out);
+            break;
+        }
+        default:
+            return fail("invalid escape");
+        }
+    }
+}
+
+bool JSONCursor::skipValue(unsigned depth)
+{
+    if (depth > 64)
+        return fail("nesting too deep");
+    skipSpace();
+    if (position >= content.size())
+        return fail("unexpected end of file");
+    char c = content[position];
+    if (c == '"')
+    {
+        std::string ignored;
+        return readString(ignored);
+    }
+    if (c == '[' || c == '{')
+    {
+        char close = c == '[' ? ']' : '}';
+        position++;
+        if (consume(close))
+            return true;
+        do
+        {
+            if (c == '{')
+            {
+                std::string key;
+                if (!readString(key) || !expect(':'))
+                    return false;
+            }
+            if (!skipValue(depth + 1))
+                return false;
+        } while (consume(','));
+        return expect(close);
+    }
+    //数字、true、false、null
+    size_t end = content.find_first_of(",]} \t\r\n", position);
+    if (end == position)
+        return fail("unexpected character");
+    position = end == StringRef::npos ? content.size() : end;
+    return true;
+}
+
+//含有源文件名(不含扩展名)的参数随文件变化，不放进模板
+bool isFileSpecific(StringRef argument, StringRef file, StringRef stem)
+{
+    return argument == file || (stem.size() >= 3 && argument.contains(stem));
+}
+
+} // namespace
+
+std::unique_ptr<InternedCompilationDatabase> InternedCompilationDatabase::loadFromFile(StringRef path, std::string &error)
+{
+    //大文件由 MemoryBuffer 直接 mmap，解析完即释放
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path, /*IsText=*/false,
+                                                                          /*RequiresNullTerminator=*/false);
+    if (!buffer)
+    {
+        error = "cannot read " + path.str() + ": " + buffer.getError().message();
+        return nullptr;
+    }
+    std::unique_ptr<InternedCompilationDatabase> database(new InternedCompilationDatabase());
+    if (!database->parse((*buffer)->getBuffer(), error))
+    {
+        error = path.str() + ": " + error;
+        return nullptr;
+    }
+    return database;
+}
+
+bool InternedCompilationDatabase::parse(StringRef content, std::string &error)
+{
+    JSONCursor cursor(content);
+    auto failed = [&]() {
+        error = cursor.getError();
+        return false;
+    };
+    if (!cursor.expect('['))
+        return failed();
+    if (cursor.consume(']'))
+        return true;
+    //各条目复用同一组缓冲，只有 intern 后的字符串留下
+    std::string key, value, directory, file, output, command;
+    std::vector<std::string> arguments;
+    BumpPtrAllocator scratchAllocator;
+    SmallVector<StringRef, 128> commandLine;
+    do
+    {
+        if (!cursor.expect('{'))
+            return failed();
+        directory.clear();
+        file.clear();
+        output.clear();
+        command.clear();
+        arguments.clear();
+        bool hasFile = false, hasDirectory = false, hasCommand = false, hasArguments = false;
+        if (!cursor.consume('}'))
+        {
+            do
+            {
+                if (!cursor.readString(key) || !cursor.expect(':'))
+                    return failed();
+                if (key == "arguments")
+                {
+                    hasArguments = true;
+                    if (!cursor.expect('['))
+                        return failed();
+                    if (!cursor.consume(']'))
+                    {
+                        do
+                        {
+                            if (!cursor.readString(value))
+                                return failed();
+                            arguments.push_back(value);
+                        } while (cursor.consume(','));
+                        if (!cursor.expect(']'))
+                            return failed();
+                    }
+                    continue;
+                }
+                std::string *field = key == "directory" ? &directory : key == "file" ? &file
+                                   : key == "output" ? &output : key == "command" ? &command : nullptr;
+                if (!field)
+                {
+                    if (!cursor.skipValue())
+                        return failed();
+                    continue;
+                }
+                if (!cursor.readString(*field))
+                    return failed();
+                hasFile |= field == &file;
+                hasDirectory |= field == &directory;
+                hasCommand |= field == &command;
+            } while (cursor.consume(','));
+            if (!cursor.expect('}'))
+                return failed();
+        }
+        if (!hasFile || !hasDirectory || (!hasCommand && !hasArguments))
+        {
+            cursor.fail("entry " + std::to_string(entries.size()) +
+                        " needs \"directory\", \"file\" and \"command\" or \"arguments\"");
+            return failed();
+        }
+
+        commandLine.clear();
+        //与 JSONCompilationDatabase 相同，两者都有时以 arguments 为准
+        if (hasArguments)
+        {
+            commandLine.append(arguments.begin(), arguments.end());
+        }
+        else
+        {
+            scratchAllocator.Reset();
+            StringSaver scratch(scratchAllocator);
+            SmallVector<const char *, 128> tokens;
+            cl::TokenizeGNUCommandLine(command, scratch, tokens);
+            for (const char *token : tokens)
+                commandLine.push_back(token);
+        }
+        addEntry(directory, file, output, commandLine);
+    } while (cursor.consume(','));
+    if (!cursor.expect(']'))
+        return failed();
+    if (!cursor.atEnd())
+    {
+        cursor.fail("unexpected data after the top-level array");
+        return failed();
+    }
+    return true;
+}
+
+void InternedCompilationDatabase::addEntry(StringRef directory, StringRef file, StringRef output,
+                                           ArrayRef<StringRef> commandLine)
+{
+    Entry entry;
+    entry.directory = strings.save(directory).data();
+    SmallString<256> absolutePath;
+    if (sys::path::is_absolute(file))
+        absolutePath = file;
+    else
+        sys::path::append(absolutePath, directory, file);
+    sys::path::remove_dots(absolutePath, /*remove_dot_dot=*/true);
+    sys::path::native(absolutePath);
+    entry.file = strings.save(absolutePath.str()).data();
+    entry.output = strings.save(output).data();
+    entry.firstVariable = variables.size();
+
+    StringRef stem = sys::path::stem(file);
+    SmallVector<const char *, 128> pattern;
+    for (StringRef argument : commandLine)
+    {
+        const char *saved = strings.save(argument).data();
+        if (isFileSpecific(argument, file, stem))
+        {
+            variables.push_back(saved);
+            pattern.push_back(nullptr);
+        }
+        else
+        {
+            pattern.push_back(saved);
+        }
+    }
+    //intern 后同一字符串的地址唯一，指针数组相同即模板相同
+    StringRef key(reinterpret_cast<const char *>(pattern.data()), pattern.size() * sizeof(const char *));
+    auto inserted = templateIndex.try_emplace(key, templates.size());
+    if (inserted.second)
+    {
+        templates.emplace_back(templateArguments.size(), pattern.size());
+        templateArguments.insert(templateArguments.end(), pattern.begin(), pattern.end());
+    }
+    entry.commandTemplate = inserted.first->second;
+    entriesByFile[entry.file].push_back(entries.size());
+    entries.push_back(entry);
+}
+
+CompileCommand InternedCompilationDatabase::getCommand(const Entry &entry) const
+{
+    const std::pair<unsigned, unsigned> &pattern = templates[entry.commandTemplate];
+    std::vector<std::string> commandLine;
+    commandLine.reserve(pattern.second);
+    unsigned nextVariable = entry.firstVariable;
+    for (unsigned i = 0; i < pattern.second; i++)
+    {
+        const char *argument = templateArguments[pattern.first + i];
+        commandLine.push_back(argument ? argument : variables[nextVariable++]);
+    }
+    return CompileCommand(entry.directory, entry.file, std::move(commandLine), entry.output);
+}
+
+std::vector<CompileCommand> InternedCompilationDatabase::getCompileCommands(StringRef filePath) const
+{
+    SmallString<256> path(filePath);
+    sys::fs::make_absolute(path);
+    sys::path::remove_dots(path, /*remove_dot_dot=*/true);
+    sys::path::native(path);
+    std::vector<CompileCommand> commands;
+    auto found = entriesByFile.find(path);
+    if (found == entriesByFile.end())
+    {
+        //路径写法不同(符号链接等)时按文件名找同一个文件
+        StringRef fileName = sys::path::filename(path);
+        for (const Entry &entry : entries)
+        {
+            if (sys::path::filename(entry.file) == fileName && sys::fs::equivalent(entry.file, path))
+                commands.push_back(getCommand(entry));
+        }
+        return commands;
+    }
+    for (unsigned index : found->second)
+        commands.push_back(getCommand(entries[index]));
+    return commands;
+}
+
+std::vector<std::string> InternedCompilationDatabase::getAllFiles() const
+{
+    std::vector<std::string> files;
+    files.reserve(entriesByFile.size());
+    for (const Entry &entry : entries)
+    {
+        //每个文件只在它的第一条命令处输出一次
+        if (entriesByFile.find(entry.file)->second.front() == static_cast<unsigned>(&entry - entries.data()))
+            files.push_back(entry.file);
+    }
+    return files;
+}
+
+std::vector<CompileCommand> InternedCompilationDatabase::getAllCompileCommands() const
+{
+    std::vector<CompileCommand> commands;
+    commands.reserve(entries.size());
+    for (const Entry &entry : entries)
+        commands.push_back(getCommand(entry));
+    return commands;
+}
@@ -0,0 +1,83 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+
+// compile_commands.json 的流式加载
+//
+// 文件映射到内存后逐个条目解析，不建 DOM，也不保留原文。同一个字符串(参数、目录)只存一份；
+// 每条命令行中含有源文件名的参数(源文件本身、-o/-MF/--serialize-diagnostics 的值等)作为变量单独存放，
+// 其余部分作为模板去重，数万个 TU 通常只有几十种模板。查询时按需拼出 CompileCommand。
+class InternedCompilationDatabase : public clang::tooling::CompilationDatabase
+{
+public:
+    static std::unique_ptr<InternedCompilationDatabase> loadFromFile(llvm::StringRef path, std::string &error);
+
+    std::vector<clang::tooling::CompileCommand> getCompileCommands(llvm::StringRef filePath) const override;
+    std::vector<std::string> getAllFiles() const override;
+    std::vector<clang::tooling::CompileCommand> getAllCompileCommands() const override;
+
+    size_t getEntryCount() const { return entries.size(); }
+    size_t getTemplateCount() const { return templates.size(); }
+
+private:
+    struct Entry
+    {
+        const char *directory;
+        //按 directory 转成的绝对路径，已去掉 . 和 ..
+        const char *file;
+        const char *output;
+        unsigned commandTemplate;
+        unsigned firstVariable;
+    };
+
+    InternedCompilationDatabase() = default;
+    bool parse(llvm::StringRef content, std::string &error);
+    void addEntry(llvm::StringRef directory, llvm::StringRef file, llvm::StringRef output,
+                  llvm::ArrayRef<llvm::StringRef> commandLine);
+    clang::tooling::CompileCommand getCommand(const Entry &entry) const;
+
+    llvm::BumpPtrAllocator allocator;
+    llvm::UniqueStringSaver strings{allocator};
+    std::vector<Entry> entries;
+    //模板中的参数依次存放；nullptr 为变量，按顺序取该条目的变量
+    std::vector<const char *> templateArguments;
+    //(起始位置, 参数个数)
+    std::vector<std::pair<unsigned, unsigned>> templates;
+    //以模板的指针数组为键
+    llvm::StringMap<unsigned> templateIndex;
+    std::vector<const char *> variables;
+    //文件 -> 条目序号，一个文件可以有多条命令
+    llvm::StringMap<std::vector<unsigned>> entriesByFile;
+};
@@ -0,0 +1,412 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "deobfuscator.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+
+#include "string_table.hpp"
+
+using namespace llvm;
+using namespace reverse_index;
+
+//每个线程一次处理的字节数；一批读入 jobs 块
+static const size_t BlockSize = 4 << 20;
+
+namespace {
+
+enum ByteClass : uint8_t
+{
+    //字母数字
+    BC_Word = 1,
+    //字母数字、'_'、'$'：新名可能包含的字节
+    BC_Identifier = 2,
+    //某个新名的首字节
+    BC_First = 4,
+};
+
+const uint32_t HashBasis = 2166136261u;
+
+inline uint32_t hashByte(uint32_t hash, uint8_t byte)
+{
+    return (hash ^ byte) * 16777619u;
+}
+
+//FNV-1a 的低位不够均匀，取槽位前再混合一次
+inline uint32_t slotOf(uint32_t hash, uint32_t mask)
+{
+    return (hash ^ (hash >> 15)) * 0x2c1b3c6du >> 7 & mask;
+}
+
+} // namespace
+
+uint32_t reverse_index::hashName(StringRef name)
+{
+    uint32_t hash = HashBasis;
+    for (char c : name)
+        hash = hashByte(hash, static_cast<uint8_t>(c));
+    return hash;
+}
+
+void ReverseIndex::build(const RenameManifest &manifest, std::string &image, BuildStats &stats)
+{
+    //同一处改写在清单中每个位置一条，先按新名去重
+    StringMap<StringRef> oldNames;
+    StringSet<> ambiguousNames;
+    for (const rename_manifest::Entry &entry : manifest.entries())
+    {
+        StringRef oldName = manifest.getString(entry.oldName);
+        StringRef newName = manifest.getString(entry.newName);
+        if (oldName.empty() || newName.empty() || oldName == newName)
+            continue;
+        auto inserted = oldNames.try_emplace(newName, oldName);
+        if (!inserted.second && inserted.first->second != oldName)
+        {
+            ambiguousNames.insert(newName);
+            inserted.first->second = std::min(inserted.first->second, oldName);
+        }
+    }
+    std::vector<std::pair<StringRef, StringRef>> names;
+    names.reserve(oldNames.size());
+    for (const auto &name : oldNames)
+        names.emplace_back(name.getKey(), name.getValue());
+    std::sort(names.begin(), names.end());
+    stats.names = names.size();
+    stats.ambiguous = ambiguousNames.size();
+
+    //装载率不超过 1/2，未命中的探测很快遇到空槽
+    uint32_t slotCount = PowerOf2Ceil(std::max<uint64_t>(names.size() * 2, 1));
+    std::vector<std::pair<uint32_t, size_t>> slots(slotCount, {0, SIZE_MAX});
+    uint8_t firstBytes[256] = {};
+    uint32_t minLength = names.empty() ? 0 : UINT32_MAX;
+    uint32_t maxLength = 0;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        StringRef newName = names[i].first;
+        uint32_t hash = hashName(newName);
+        uint32_t slot = slotOf(hash, slotCount - 1);
+        while (slots[slot].second != SIZE_MAX)
+            slot = (slot + 1) & (slotCount - 1);
+        slots[slot] = {hash, i};
+        firstBytes[static_cast<uint8_t>(newName.front())] = 1;
+        minLength = std::min<uint32_t>(minLength, newName.size());
+        maxLength = std::max<uint32_t>(maxLength, newName.size());
+    }
+
+    StringTableBuilder strings;
+    std::string tables;
+    raw_string_ostream tableStream(tables);
+    support::endian::Writer writer(tableStream, support::little);
+    for (const auto &slot : slots)
+    {
+        writer.write<uint32_t>(slot.first);
+        if (slot.second == SIZE_MAX)
+        {
+            writer.write<uint64_t>(0);
+            writer.write<uint64_t>(0);
+            continue;
+        }
+        strings.writeRef(writer, names[slot.second].first);
+        strings.writeRef(writer, names[slot.second].second);
+    }
+    tableStream.flush();
+
+    image.clear();
+    raw_string_ostream os(image);
+    os.write(Magic, sizeof(Magic));
+    support::endian::Writer headerWriter(os, support::little);
+    headerWriter.write<uint32_t>(Version);
+    headerWriter.write<uint32_t>(slotCount);
+    headerWriter.write<uint32_t>(names.size());
+    headerWriter.write<uint32_t>(strings.data().size());
+    headerWriter.write<uint32_t>(minLength);
+    headerWriter.write<uint32_t>(maxLength);
+    os.write(reinterpret_cast<const char *>(firstBytes), sizeof(firstBytes));
+    os << tables << strings.data();
+    os.flush();
+}
+
+std::unique_ptr<ReverseIndex> ReverseIndex::load(StringRef path, raw_ostream &errs)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!buffer)
+    {
+        errs << "cannot read reverse index " << path << ": " << buffer.getError().message() << "\n";
+        return nullptr;
+    }
+    return create(std::move(*buffer), errs);
+}
+
+std::unique_ptr<ReverseIndex> ReverseIndex::create(std::unique_ptr<MemoryBuffer> buffer, raw_ostream &errs)
+{
+    StringRef data = buffer->getBuffer();
+    StringRef name = buffer->getBufferIdentifier();
+    const Header *header = reinterpret_cast<const Header *>(data.data());
+    if (data.size() < sizeof(Header) || memcmp(header->magic, Magic, sizeof(Magic)) != 0)
+    {
+        errs << name << ": not a reverse index\n";
+        return nullptr;
+    }
+    if (header->version != Version)
+    {
+        errs << name << ": unsupported reverse index version " << header->version << "\n";
+        return nullptr;
+    }
+    uint64_t slotsSize = uint64_t(header->slotCount) * sizeof(Slot);
+    if (!isPowerOf2_32(header->slotCount) || sizeof(Header) + slotsSize + header->stringsSize != data.size())
+    {
+        errs << name << ": truncated reverse index\n";
+        return nullptr;
+    }
+
+    std::unique_ptr<ReverseIndex> index(new ReverseIndex());
+    const char *cursor = data.data() + sizeof(Header);
+    index->slots = makeArrayRef(reinterpret_cast<const Slot *>(cursor), header->slotCount);
+    cursor += slotsSize;
+    index->strings = StringRef(cursor, header->stringsSize);
+    //改写时不再检查下标，损坏的索引在这里拒绝；至少留一个空槽，探测才会结束
+    size_t used = 0;
+    for (const Slot &slot : index->slots)
+    {
+        if (uint64_t(slot.newName.offset) + slot.newName.length > index->strings.size() ||
+            uint64_t(slot.oldName.offset) + slot.oldName.length > index->strings.size())
+        {
+            errs << name << ": corrupt reverse index\n";
+            return nullptr;
+        }
+        used += slot.newName.length != 0;
+    }
+    if (used == index->slots.size())
+    {
+        errs << name << ": corrupt reverse index\n";
+        return nullptr;
+    }
+    index->header = header;
+    index->buffer = std::move(buffer);
+    return index;
+}
+
+StringRef ReverseIndex::getString(const rename_manifest::Str &str) const
+{
+    return StringRef(strings.data() + str.offset, str.length);
+}
+
+size_t ReverseIndex::rewrite(StringRef text, std::string &out) const
+{
+    uint8_t classes[256];
+    for (unsigned c = 0; c < 256; c++)
+    {
+        char ch = static_cast<char>(c);
+        classes[c] = (isAlnum(ch) ? BC_Word : 0) | (isAlnum(ch) || ch == '_' || ch == '$' ? BC_Identifier : 0) |
+                     (header->firstBytes[c] ? BC_First : 0);
+    }
+    const size_t minLength = header->minLength;
+    const size_t maxLength = header->maxLength;
+    const uint32_t mask = slots.size() - 1;
+    //[begin, end) 是新名时返回其所在的槽
+    auto lookup = [&](const char *begin, const char *end, uint32_t hash) -> const Slot * {
+        for (uint32_t slot = slotOf(hash, mask);; slot = (slot + 1) & mask)
+        {
+            const Slot &entry = slots[slot];
+            if (!entry.newName.length)
+                return nullptr;
+            if (entry.hash == hash && getString(entry.newName) == StringRef(begin, end - begin))
+                return &entry;
+        }
+    };
+
+    const char *p = text.begin();
+    const char *end = text.end();
+    const char *copied = p;
+    size_t count = 0;
+    while (p != end)
+    {
+        uint8_t byteClass = classes[static_cast<uint8_t>(*p)];
+        if (byteClass & BC_First)
+        {
+            //沿标识符字节向后，在后面不接字母数字的位置查表，取最长的命中
+            const char *limit = end - p > ptrdiff_t(maxLength) ? p + maxLength : end;
+            uint32_t hash = HashBasis;
+            const Slot *matched = nullptr;
+            const char *matchedEnd = nullptr;
+            for (const char *q = p; q != limit && (classes[static_cast<uint8_t>(*q)] & BC_Identifier);)
+            {
+                hash = hashByte(hash, static_cast<uint8_t>(*q));
+                ++q;
+                if (size_t(q - p) >= minLength && (q == end || !(classes[static_cast<uint8_t>(*q)] & BC_Word)))
+                {
+                    if (const Slot *slot = lookup(p, q, hash))
+                    {
+                        matched = slot;
+                        matchedEnd = q;
+                    }
+                }
+            }
+            if (matched)
+            {
+                out.append(copied, p);
+                StringRef oldName = getString(matched->oldName);
+                out.append(oldName.begin(), oldName.end());
+                p = copied = matchedEnd;
+                count++;
+                continue;
+            }
+        }
+        ++p;
+        //单词中间的字节不可能是新名的开头，整个跳过
+        if (byteClass & BC_Word)
+        {
+            while (p != end && (classes[static_cast<uint8_t>(*p)] & BC_Word))
+                ++p;
+        }
+    }
+    out.append(copied, end);
+    return count;
+}
+
+Deobfuscator::Deobfuscator(const ReverseIndex &aIndex, unsigned aJobs)
+: index(aIndex)
+, jobs(llvm::hardware_concurrency(aJobs).compute_thread_count())
+{
+    if (jobs > 1)
+        pool = std::make_unique<llvm::ThreadPool>(llvm::hardware_concurrency(jobs));
+}
+
+bool Deobfuscator::run(StringRef path, raw_ostream &out, raw_ostream &errs)
+{
+    sys::fs::file_t file = sys::fs::getStdinHandle();
+    bool opened = path != "-";
+    if (opened)
+    {
+        Expected<sys::fs::file_t> handle = sys::fs::openNativeFileForRead(path);
+        if (!handle)
+        {
+            errs << "cannot read " << path << ": " << toString(handle.takeError()) << "\n";
+            return false;
+        }
+        file = *handle;
+    }
+    //读满一批(或到文件尾)后，把到最后一个换行为止的部分交给线程池，剩下的半行移到另一个缓冲区开头，
+    //接着读下一批；上一批的缓冲区在它改写完之前不会再写入
+    std::string buffers[2] = {std::string(BlockSize * jobs, '\0'), std::string()};
+    unsigned current = 0;
+    size_t filled = 0;
+    bool success = true;
+    while (true)
+    {
+        std::string &buffer = buffers[current];
+        Expected<size_t> count =
+            sys::fs::readNativeFile(file, makeMutableArrayRef(&buffer[filled], buffer.size() - filled));
+        if (!count)
+        {
+            errs << "cannot read " << path << ": " << toString(count.takeError()) << "\n";
+            success = false;
+            break;
+        }
+        filled += *count;
+        bytesRead += *count;
+        if (*count == 0)
+        {
+            finishBlock(out);
+            rewriteBlock(StringRef(buffer.data(), filled), out);
+            break;
+        }
+        if (filled < buffer.size())
+            continue;
+        size_t lineEnd = StringRef(buffer.data(), filled).rfind('\n');
+        if (lineEnd == StringRef::npos)
+        {
+            //一行比整批还长，扩大缓冲区，不在名字中间切断
+            buffer.resize(buffer.size() * 2);
+            continue;
+        }
+        finishBlock(out);
+        startBlock(StringRef(buffer.data(), lineEnd + 1));
+        filled -= lineEnd + 1;
+        std::string &next = buffers[current ^ 1];
+        if (next.size() < buffer.size())
+            next.resize(buffer.size());
+        memcpy(&next[0], &buffer[lineEnd + 1], filled);
+        current ^= 1;
+    }
+    //读取出错时也要等正在改写的一批结束，它引用着缓冲区
+    finishBlock(out);
+    if (opened)
+        sys::fs::closeFile(file);
+    return success;
+}
+
+void Deobfuscator::rewriteBlock(StringRef text, raw_ostream &out)
+{
+    startBlock(text);
+    finishBlock(out);
+}
+
+void Deobfuscator::startBlock(StringRef text)
+{
+    //每片至少一块，在换行处切开；切点只落在行首，不会切断名字
+    pieces.clear();
+    while (!text.empty())
+    {
+        size_t cut = text.size() <= BlockSize ? StringRef::npos : text.find('\n', BlockSize);
+        cut = cut == StringRef::npos ? text.size() : cut + 1;
+        pieces.push_back(text.take_front(cut));
+        text = text.drop_front(cut);
+    }
+    //输出缓冲区在各批之间复用，避免每批重新分配、缺页
+    if (outputs.size() < pieces.size())
+        outputs.resize(pieces.size());
+    auto rewritePiece = [this](size_t i) {
+        outputs[i].clear();
+        outputs[i].reserve(pieces[i].size() + pieces[i].size() / 8);
+        replaced += index.rewrite(pieces[i], outputs[i]);
+    };
+    if (pieces.size() <= 1 || !pool)
+    {
+        for (size_t i = 0; i < pieces.size(); i++)
+            rewritePiece(i);
+    }
+    else
+    {
+        for (size_t i = 0; i < pieces.size(); i++)
+            pool->async(rewritePiece, i);
+    }
+}
+
+void Deobfuscator::finishBlock(raw_ostream &out)
+{
+    if (pool)
+        pool->wait();
+    for (size_t i = 0; i < pieces.size(); i++)
+        out << outputs[i];
+    pieces.clear();
+}
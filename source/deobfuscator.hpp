@@ -0,0 +1,140 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "rename_manifest.hpp"
+
+// 反混淆(deobfuscate 子命令)：把崩溃日志、符号表中的新名换回原类名
+//
+// 反向索引由二进制重命名清单生成，可以存成文件，之后直接映射到内存使用，不做反序列化。
+// 格式(小端)：
+//   Header
+//   Slot[slotCount]      开放寻址的哈希表，以新名的 FNV-1a 哈希线性探测；槽中直接存 (新名, 原名)
+//   char[stringsSize]    字符串表，同一槽的新名和原名相邻，命中时只多读一处内存
+// 文本中只有单词开头(前一个字节不是字母数字)、首字节和长度都可能是新名的位置才查表；
+// 沿标识符字节向后，在每个后面不接字母数字的位置查一次，取最长的命中。
+// '_' 和 '$' 算作分隔符，因此 _OBJC_CLASS_$_<新名>、__OBJC_$_INSTANCE_METHODS_<新名> 这类符号也能还原。
+namespace reverse_index {
+
+const char Magic[8] = {'O', 'B', 'F', 'R', 'I', 'N', 'D', 'X'};
+const uint32_t Version = 1;
+
+struct Header
+{
+    char magic[8];
+    llvm::support::ulittle32_t version;
+    //2 的幂
+    llvm::support::ulittle32_t slotCount;
+    llvm::support::ulittle32_t nameCount;
+    llvm::support::ulittle32_t stringsSize;
+    llvm::support::ulittle32_t minLength;
+    llvm::support::ulittle32_t maxLength;
+    //可以作为某个新名首字节的字节
+    uint8_t firstBytes[256];
+};
+
+struct Slot
+{
+    llvm::support::ulittle32_t hash;
+    //长度为 0 表示空槽
+    rename_manifest::Str newName;
+    rename_manifest::Str oldName;
+};
+
+uint32_t hashName(llvm::StringRef name);
+
+} // namespace reverse_index
+
+// 只读的反向索引，构建后可被多个线程同时使用
+class ReverseIndex
+{
+public:
+    struct BuildStats
+    {
+        size_t names = 0;
+        //同一新名对应多个原名，保留按原名排序的第一个
+        size_t ambiguous = 0;
+    };
+
+    //由清单生成索引的文件内容
+    static void build(const RenameManifest &manifest, std::string &image, BuildStats &stats);
+    static std::unique_ptr<ReverseIndex> load(llvm::StringRef path, llvm::raw_ostream &errs);
+    static std::unique_ptr<ReverseIndex> create(std::unique_ptr<llvm::MemoryBuffer> buffer, llvm::raw_ostream &errs);
+
+    size_t getNameCount() const { return header->nameCount; }
+    //把 text 中的新名换成原名后追加到 out，返回替换的个数
+    size_t rewrite(llvm::StringRef text, std::string &out) const;
+
+private:
+    llvm::StringRef getString(const rename_manifest::Str &str) const;
+
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    const reverse_index::Header *header = nullptr;
+    llvm::ArrayRef<reverse_index::Slot> slots;
+    llvm::StringRef strings;
+};
+
+// 流式反混淆：按块读入(标准输入或文件)，在换行处切成片并行改写，按原顺序写出，内存占用与输入大小无关
+// 线程池在整个运行期间复用；两个输入缓冲区交替使用，改写一批的同时读入下一批
+class Deobfuscator
+{
+public:
+    Deobfuscator(const ReverseIndex &aIndex, unsigned aJobs);
+
+    //path 为 "-" 时读标准输入
+    bool run(llvm::StringRef path, llvm::raw_ostream &out, llvm::raw_ostream &errs);
+    //改写一段已在内存中的文本，按换行切片并行处理
+    void rewriteBlock(llvm::StringRef text, llvm::raw_ostream &out);
+
+    uint64_t getBytesRead() const { return bytesRead; }
+    uint64_t getReplacedCount() const { return replaced; }
+
+private:
+    //切片并交给线程池，立即返回；text 在 finishBlock 之前须保持有效
+    void startBlock(llvm::StringRef text);
+    //等待 startBlock 交出的一批改写完，按原顺序写出
+    void finishBlock(llvm::raw_ostream &out);
+
+    const ReverseIndex &index;
+    unsigned jobs;
+    //jobs 为 1 时为空，在调用线程上改写
+    std::unique_ptr<llvm::ThreadPool> pool;
+    uint64_t bytesRead = 0;
+    std::atomic<uint64_t> replaced{0};
+    //正在改写的一批
+    std::vector<llvm::StringRef> pieces;
+    std::vector<std::string> outputs;
+};
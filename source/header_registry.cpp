@@ -0,0 +1,192 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "header_registry.hpp"
+#include "objc_obfuscator.hpp"
+
+#include "clang/Lex/HeaderSearch.h"
+#include "clang/Lex/Preprocessor.h"
+#include "llvm/Support/MD5.h"
+
+std::shared_ptr<const HeaderRecord> HeaderRegistry::lookup(StringRef key) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = records.find(key);
+    return found == records.end() ? nullptr : found->second;
+}
+
+void HeaderRegistry::publish(StringRef key, std::shared_ptr<const HeaderRecord> record)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    records.try_emplace(key, std::move(record));
+}
+
+void HeaderRegistry::addReuse(size_t headers, size_t decls)
+{
+    reuseCount += headers;
+    skippedDeclCount += decls;
+}
+
+size_t HeaderRegistry::getHeaderCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return records.size();
+}
+
+HeaderDirectiveRecorder::HeaderDirectiveRecorder(const SourceManager &aSourceManager)
+: sourceManager(aSourceManager)
+{
+}
+
+void HeaderDirectiveRecorder::FileChanged(SourceLocation Loc, FileChangeReason Reason, SrcMgr::CharacteristicKind FileType,
+                                          FileID PrevFID)
+{
+    if (Reason == EnterFile)
+        files.try_emplace(sourceManager.getFileID(Loc));
+}
+
+void HeaderDirectiveRecorder::If(SourceLocation Loc, SourceRange ConditionRange, ConditionValueKind ConditionValue)
+{
+    addConditional(Loc, nullptr);
+}
+
+void HeaderDirectiveRecorder::Ifdef(SourceLocation Loc, const Token &MacroNameTok, const MacroDefinition &MD)
+{
+    addConditional(Loc, nullptr);
+}
+
+void HeaderDirectiveRecorder::Ifndef(SourceLocation Loc, const Token &MacroNameTok, const MacroDefinition &MD)
+{
+    addConditional(Loc, MacroNameTok.getIdentifierInfo());
+}
+
+void HeaderDirectiveRecorder::addConditional(SourceLocation loc, const IdentifierInfo *ifndefMacro)
+{
+    FileDirectives &directives = files[sourceManager.getFileID(loc)];
+    if (directives.conditionals++ == 0)
+        directives.firstIfndef = ifndefMacro;
+}
+
+bool HeaderDirectiveRecorder::isUnconditional(FileID fileID, const IdentifierInfo *guardMacro) const
+{
+    auto found = files.find(fileID);
+    if (found == files.end())
+        return false;
+    const FileDirectives &directives = found->second;
+    return directives.conditionals == 0 ||
+           (directives.conditionals == 1 && guardMacro && directives.firstIfndef == guardMacro);
+}
+
+HeaderOnceTracker::HeaderOnceTracker(HeaderRegistry &aRegistry, CompilerInstance &aCompilerInstance)
+: registry(aRegistry)
+, compilerInstance(aCompilerInstance)
+{
+    //同一头文件中的名字解析到哪个声明还取决于搜索路径
+    configHash = compilerInstance.getInvocation().getModuleHash();
+    for (const HeaderSearchOptions::Entry &entry : compilerInstance.getHeaderSearchOpts().UserEntries)
+    {
+        configHash += '\0';
+        configHash += entry.Path;
+    }
+}
+
+HeaderOnceTracker::FileState &HeaderOnceTracker::getState(FileID fileID)
+{
+    auto inserted = states.try_emplace(fileID);
+    FileState &state = inserted.first->second;
+    if (!inserted.second)
+        return state;
+    SourceManager &sm = compilerInstance.getSourceManager();
+    const FileEntry *entry = sm.getFileEntryForID(fileID);
+    if (!entry || fileID == sm.getMainFileID())
+        return state;
+    //没有 guard 的头文件每次包含都可能得到不同的声明
+    HeaderSearch &headerSearch = compilerInstance.getPreprocessor().getHeaderSearchInfo();
+    HeaderFileInfo &info = headerSearch.getFileInfo(entry);
+    if (!info.isImport && !info.isPragmaOnce && !headerSearch.isFileMultipleIncludeGuarded(entry))
+        return state;
+    std::string path = getAbsoluteFilePath(sm, fileID);
+    if (path.empty())
+        return state;
+
+    MD5 hasher;
+    hasher.update(sm.getBufferData(fileID));
+    hasher.update(configHash);
+    MD5::MD5Result hash;
+    hasher.final(hash);
+    state.key = path + '\0' + hash.digest().str().str();
+    state.covered = registry.lookup(state.key);
+    if (!state.covered)
+    {
+        state.captured = std::make_shared<HeaderRecord>();
+        //#if 等的结果取决于TU中此前的宏和前缀头文件，键里没有这些，换一个TU可能得到另一组声明
+        const IdentifierInfo *guardMacro = info.getControllingMacro(compilerInstance.getPreprocessor().getExternalSource());
+        state.publishable = directives && directives->isUnconditional(fileID, guardMacro);
+    }
+    return state;
+}
+
+bool HeaderOnceTracker::isCovered(const Decl *decl)
+{
+    SourceManager &sm = compilerInstance.getSourceManager();
+    FileID fileID = sm.getFileID(sm.getExpansionLoc(decl->getBeginLoc()));
+    if (!getState(fileID).covered)
+        return false;
+    skippedDecls++;
+    return true;
+}
+
+void HeaderOnceTracker::record(SourceLocation nodeLoc, const tooling::Replacement &replacement,
+                               const ManifestRecord &manifestRecord)
+{
+    SourceManager &sm = compilerInstance.getSourceManager();
+    auto found = states.find(sm.getFileID(sm.getExpansionLoc(nodeLoc)));
+    if (found == states.end() || !found->second.captured)
+        return;
+    HeaderRecord &captured = *found->second.captured;
+    captured.edits[replacement.getFilePath().str()].insert(replacement);
+    captured.renames.push_back(manifestRecord);
+}
+
+void HeaderOnceTracker::finish(TUResult &result)
+{
+    bool hasErrors = compilerInstance.getDiagnostics().hasErrorOccurred();
+    size_t reused = 0;
+    for (auto &entry : states)
+    {
+        FileState &state = entry.second;
+        if (state.covered)
+        {
+            //本TU的结果保持完整，增量缓存回放和提前合并都不依赖其它TU
+            for (const auto &fileEdits : state.covered->edits)
+                result.edits[fileEdits.first].insert(fileEdits.second.begin(), fileEdits.second.end());
+            result.renames.insert(result.renames.end(), state.covered->renames.begin(), state.covered->renames.end());
+            reused++;
+        }
+        else if (state.captured && state.publishable && !hasErrors)
+        {
+            registry.publish(state.key, std::move(state.captured));
+        }
+    }
+    registry.addReuse(reused, skippedDecls);
+}
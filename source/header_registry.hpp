@@ -0,0 +1,141 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "clang/AST/DeclBase.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+
+#include "rename_manifest.hpp"
+
+struct TUResult;
+
+// 一个头文件在某个TU中遍历时产生的全部改写，包括它展开的宏体中的改写
+struct HeaderRecord
+{
+    std::map<std::string, std::set<clang::tooling::Replacement>> edits;
+    std::vector<ManifestRecord> renames;
+};
+
+// 跨TU的头文件登记表(--header-once)
+//
+// 键为头文件的绝对路径、内容的 MD5 和TU的配置(CompilerInvocation::getModuleHash() 与 -I 等搜索路径)。
+// 某个TU完整处理过的头文件登记后，之后的TU不再遍历其中的顶层声明，直接复用登记的改写。
+// 只登记有 include guard、#pragma once 或被 #import 的头文件。键不含TU中此前定义的宏和 -include 前缀头文件，
+// 因此除 include guard 外还有条件编译指令的头文件不登记：前面的宏定义不同时其中展开的声明可能不同。
+class HeaderRegistry
+{
+public:
+    std::shared_ptr<const HeaderRecord> lookup(llvm::StringRef key) const;
+    //同一个键已登记时保留先登记的
+    void publish(llvm::StringRef key, std::shared_ptr<const HeaderRecord> record);
+    void addReuse(size_t headers, size_t decls);
+
+    size_t getHeaderCount() const;
+    size_t getReuseCount() const { return reuseCount; }
+    size_t getSkippedDeclCount() const { return skippedDeclCount; }
+
+private:
+    mutable std::mutex mutex;
+    llvm::StringMap<std::shared_ptr<const HeaderRecord>> records;
+    std::atomic<size_t> reuseCount{0};
+    std::atomic<size_t> skippedDeclCount{0};
+};
+
+// 记录本TU实际词法分析过的文件及其中的条件编译指令
+// 从 preamble 加载的头文件不经过词法分析，无法确定其中有没有条件编译，不登记
+class HeaderDirectiveRecorder : public clang::PPCallbacks
+{
+public:
+    explicit HeaderDirectiveRecorder(const clang::SourceManager &aSourceManager);
+
+    void FileChanged(clang::SourceLocation Loc, FileChangeReason Reason, clang::SrcMgr::CharacteristicKind FileType,
+                     clang::FileID PrevFID) override;
+    void If(clang::SourceLocation Loc, clang::SourceRange ConditionRange, ConditionValueKind ConditionValue) override;
+    void Ifdef(clang::SourceLocation Loc, const clang::Token &MacroNameTok, const clang::MacroDefinition &MD) override;
+    void Ifndef(clang::SourceLocation Loc, const clang::Token &MacroNameTok, const clang::MacroDefinition &MD) override;
+
+    //fileID 经过词法分析，且除 guardMacro 的 #ifndef 外没有条件编译指令(#elif 等总跟在 #if 之后，只需看开头的指令)
+    bool isUnconditional(clang::FileID fileID, const clang::IdentifierInfo *guardMacro) const;
+
+private:
+    struct FileDirectives
+    {
+        unsigned conditionals = 0;
+        //文件中第一条条件编译指令为 #ifndef 时的宏
+        const clang::IdentifierInfo *firstIfndef = nullptr;
+    };
+    void addConditional(clang::SourceLocation loc, const clang::IdentifierInfo *ifndefMacro);
+
+    const clang::SourceManager &sourceManager;
+    llvm::DenseMap<clang::FileID, FileDirectives> files;
+};
+
+// 单个TU对登记表的使用：决定跳过哪些顶层声明，按所在头文件收集改写，遍历结束后复用和登记
+class HeaderOnceTracker
+{
+public:
+    HeaderOnceTracker(HeaderRegistry &aRegistry, clang::CompilerInstance &aCompilerInstance);
+
+    //directives 由预处理器持有，须在解析开始前设置；未设置时不登记任何头文件
+    void setDirectiveRecorder(const HeaderDirectiveRecorder *recorder) { directives = recorder; }
+
+    //顶层声明所在的头文件已由其它TU处理过时返回 true
+    bool isCovered(const clang::Decl *decl);
+    //nodeLoc 为改写所在节点的位置，改写归属于该位置展开后所在的文件
+    void record(clang::SourceLocation nodeLoc, const clang::tooling::Replacement &replacement,
+                const ManifestRecord &manifestRecord);
+    //跳过的头文件的改写并入 result；本TU无错误时登记其余头文件
+    void finish(TUResult &result);
+
+private:
+    struct FileState
+    {
+        std::string key;
+        std::shared_ptr<const HeaderRecord> covered;
+        //尚未被覆盖的头文件，收集其中的改写
+        std::shared_ptr<HeaderRecord> captured;
+        //没有 guard 之外的条件编译指令，结束时可以登记
+        bool publishable = false;
+    };
+    FileState &getState(clang::FileID fileID);
+
+    HeaderRegistry &registry;
+    clang::CompilerInstance &compilerInstance;
+    const HeaderDirectiveRecorder *directives = nullptr;
+    std::string configHash;
+    llvm::DenseMap<clang::FileID, FileState> states;
+    size_t skippedDecls = 0;
+};
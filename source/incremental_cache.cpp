@@ -0,0 +1,258 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "incremental_cache.hpp"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+static const int64_t CacheFormatVersion = 2;
+
+static void hashString(MD5 &hasher, StringRef str)
+{
+    //带上长度，避免不同的拼接方式得到相同的哈希
+    uint64_t size = str.size();
+    hasher.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&size), sizeof(size)));
+    hasher.update(str);
+}
+
+static std::string finalHash(MD5 &hasher)
+{
+    MD5::MD5Result hash;
+    hasher.final(hash);
+    return hash.digest().str().str();
+}
+
+IncrementalCache::IncrementalCache(StringRef aDirectory, StringRef aConfigFingerprint)
+: directory(aDirectory.str())
+, configFingerprint(aConfigFingerprint.str())
+{
+}
+
+bool IncrementalCache::init(raw_ostream &errs)
+{
+    if (std::error_code ec = sys::fs::create_directories(directory))
+    {
+        errs << "cannot create cache directory " << directory << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+std::string IncrementalCache::computeFingerprint(ArrayRef<std::string> files, ArrayRef<std::string> values)
+{
+    MD5 hasher;
+    hashString(hasher, std::to_string(CacheFormatVersion));
+    for (const std::string &file : files)
+    {
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(file);
+        hashString(hasher, file);
+        hashString(hasher, buffer ? (*buffer)->getBuffer() : StringRef());
+    }
+    for (const std::string &value : values)
+        hashString(hasher, value);
+    return finalHash(hasher);
+}
+
+std::string IncrementalCache::computeKey(StringRef mainFile, ArrayRef<CompileCommand> commands) const
+{
+    MD5 hasher;
+    hashString(hasher, configFingerprint);
+    hashString(hasher, mainFile);
+    for (const CompileCommand &command : commands)
+    {
+        hashString(hasher, command.Directory);
+        for (const std::string &arg : command.CommandLine)
+            hashString(hasher, arg);
+    }
+    return finalHash(hasher);
+}
+
+std::string IncrementalCache::getEntryPath(StringRef key) const
+{
+    SmallString<256> path(directory);
+    sys::path::append(path, key + ".json");
+    return path.str().str();
+}
+
+std::string IncrementalCache::hashFile(StringRef path)
+{
+    {
+        std::lock_guard<std::mutex> lock(fileHashesMutex);
+        auto cached = fileHashes.find(path);
+        if (cached != fileHashes.end())
+            return cached->second;
+    }
+    //不存在的文件哈希为空串，和任何记录都不相等
+    std::string hash;
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (buffer)
+    {
+        MD5 hasher;
+        hasher.update((*buffer)->getBuffer());
+        hash = finalHash(hasher);
+    }
+    std::lock_guard<std::mutex> lock(fileHashesMutex);
+    fileHashes[path] = hash;
+    return hash;
+}
+
+bool IncrementalCache::lookup(StringRef key, TUResult &result)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(getEntryPath(key));
+    if (!buffer)
+        return false;
+    //损坏或格式不符的条目按未命中处理
+    Expected<json::Value> parsed = json::parse((*buffer)->getBuffer());
+    if (!parsed)
+    {
+        consumeError(parsed.takeError());
+        return false;
+    }
+    const json::Object *entry = parsed->getAsObject();
+    if (!entry || entry->getInteger("version") != CacheFormatVersion || entry->getString("key") != key)
+        return false;
+    const json::Array *files = entry->getArray("files");
+    const json::Array *edits = entry->getArray("edits");
+    const json::Array *renames = entry->getArray("renames");
+    if (!files || !edits || !renames)
+        return false;
+
+    TUResult cached;
+    for (const json::Value &file : *files)
+    {
+        const json::Object *fileObject = file.getAsObject();
+        if (!fileObject)
+            return false;
+        Optional<StringRef> path = fileObject->getString("path");
+        Optional<StringRef> hash = fileObject->getString("hash");
+        if (!path || !hash || hashFile(*path) != *hash)
+            return false;
+        cached.includedFiles.insert(path->str());
+    }
+    for (const json::Value &edit : *edits)
+    {
+        const json::Object *editObject = edit.getAsObject();
+        if (!editObject)
+            return false;
+        Optional<StringRef> file = editObject->getString("file");
+        Optional<int64_t> offset = editObject->getInteger("offset");
+        Optional<int64_t> length = editObject->getInteger("length");
+        Optional<StringRef> text = editObject->getString("text");
+        if (!file || !offset || !length || !text)
+            return false;
+        cached.edits[file->str()].insert(tooling::Replacement(*file, *offset, *length, *text));
+    }
+    for (const json::Value &rename : *renames)
+    {
+        const json::Object *renameObject = rename.getAsObject();
+        if (!renameObject)
+            return false;
+        Optional<StringRef> kind = renameObject->getString("kind");
+        Optional<StringRef> oldName = renameObject->getString("old");
+        Optional<StringRef> newName = renameObject->getString("new");
+        Optional<StringRef> file = renameObject->getString("file");
+        Optional<int64_t> line = renameObject->getInteger("line");
+        Optional<int64_t> column = renameObject->getInteger("column");
+        ManifestRecord record;
+        if (!kind || !rename_manifest::parseKindName(*kind, record.kind) ||
+            !oldName || !newName || !file || !line || !column)
+            return false;
+        record.oldName = oldName->str();
+        record.newName = newName->str();
+        record.file = file->str();
+        record.line = *line;
+        record.column = *column;
+        cached.renames.push_back(std::move(record));
+    }
+    cached.mainFile = result.mainFile;
+    cached.fromCache = true;
+    result = std::move(cached);
+    return true;
+}
+
+bool IncrementalCache::store(StringRef key, const TUResult &result)
+{
+    json::Array files;
+    for (const std::string &path : result.includedFiles)
+    {
+        files.push_back(json::Object{{"path", path}, {"hash", hashFile(path)}});
+    }
+    json::Array edits;
+    for (const auto &fileEdits : result.edits)
+    {
+        for (const tooling::Replacement &replacement : fileEdits.second)
+        {
+            edits.push_back(json::Object{
+                {"file", fileEdits.first},
+                {"offset", int64_t(replacement.getOffset())},
+                {"length", int64_t(replacement.getLength())},
+                {"text", replacement.getReplacementText()},
+            });
+        }
+    }
+    json::Array renames;
+    for (const ManifestRecord &record : result.renames)
+    {
+        renames.push_back(json::Object{
+            {"kind", rename_manifest::getKindName(record.kind)},
+            {"old", record.oldName},
+            {"new", record.newName},
+            {"file", record.file},
+            {"line", int64_t(record.line)},
+            {"column", int64_t(record.column)},
+        });
+    }
+    json::Object entry{
+        {"version", CacheFormatVersion},
+        {"key", key},
+        {"files", std::move(files)},
+        {"edits", std::move(edits)},
+        {"renames", std::move(renames)},
+    };
+
+    //先写同目录下的临时文件再 rename，读者要么看到旧条目，要么看到完整的新条目
+    SmallString<256> tempPath;
+    int fd;
+    if (sys::fs::createUniqueFile(getEntryPath(key) + ".%%%%%%.tmp", fd, tempPath))
+        return false;
+    {
+        raw_fd_ostream os(fd, /*shouldClose=*/true);
+        os << json::Value(std::move(entry));
+        if (os.has_error())
+        {
+            os.clear_error();
+            sys::fs::remove(tempPath);
+            return false;
+        }
+    }
+    if (sys::fs::rename(tempPath, getEntryPath(key)))
+    {
+        sys::fs::remove(tempPath);
+        return false;
+    }
+    return true;
+}
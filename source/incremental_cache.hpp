@@ -0,0 +1,60 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <mutex>
+
+#include "objc_obfuscator.hpp"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringMap.h"
+
+// 增量模式的持久化缓存：每个TU一个条目，记录其依赖文件的内容哈希及产生的编辑。
+//
+// 条目按 (主文件, 编译参数, 配置指纹) 的哈希命名；命中后再校验主文件及所有被包含文件的内容哈希，
+// 全部一致才回放缓存的编辑和重命名清单。条目先写临时文件再 rename，多个进程同时读写同一目录是安全的。
+class IncrementalCache
+{
+public:
+    IncrementalCache(StringRef aDirectory, StringRef aConfigFingerprint);
+
+    bool init(raw_ostream &errs);
+    std::string computeKey(StringRef mainFile, ArrayRef<CompileCommand> commands) const;
+    //命中时填充 result 的编辑、清单和依赖文件
+    bool lookup(StringRef key, TUResult &result);
+    bool store(StringRef key, const TUResult &result);
+
+    //配置指纹：重命名表、索引等文件的内容以及其它影响结果的选项
+    static std::string computeFingerprint(ArrayRef<std::string> files, ArrayRef<std::string> values);
+
+private:
+    std::string getEntryPath(StringRef key) const;
+    //同一次运行中每个文件只哈希一次，头文件被多个TU共享
+    std::string hashFile(StringRef path);
+
+    std::string directory;
+    std::string configFingerprint;
+    std::mutex fileHashesMutex;
+    StringMap<std::string> fileHashes;
+};
@@ -0,0 +1,211 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "index_collector.hpp"
+#include "parallel_driver.hpp"
+
+#include <mutex>
+
+#include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/StringExtras.h"
+
+//字符串内容是否形如标识符，只有这样的字符串才可能是类名
+static bool looksLikeIdentifier(StringRef str)
+{
+    if (str.empty() || isDigit(str.front()))
+        return false;
+    return llvm::all_of(str, [](char c) { return isAlnum(c) || c == '_' || c == '$'; });
+}
+
+//除字母数字、'_'、'$' 以外的所有字节，与 LiteralScanner 的单词边界一致
+static const std::string NonIdentifierBytes = [] {
+    std::string bytes;
+    for (unsigned c = 0; c < 256; c++)
+    {
+        if (!isAlnum(static_cast<char>(c)) && c != '_' && c != '$')
+            bytes.push_back(static_cast<char>(c));
+    }
+    return bytes;
+}();
+
+IndexCollectCallback::IndexCollectCallback(CompilerInstance *aCompilerInstance, const SourceRoots &aRoots, IndexCollectResult &aResult)
+: compilerInstance(aCompilerInstance)
+, result(aResult)
+, classifier(aCompilerInstance->getSourceManager(), aRoots)
+{
+}
+
+void IndexCollectCallback::addSymbol(symbol_index::SymbolKind kind, const Decl *decl, StringRef name, StringRef owner)
+{
+    SmallString<128> usr;
+    if (index::generateUSRForDecl(decl, usr))
+        return;
+    SourceManager &sm = compilerInstance->getSourceManager();
+    FileID fileID = sm.getFileID(sm.getSpellingLoc(decl->getLocation()));
+    result.symbols.push_back({kind, name.str(), owner.str(), usr.str().str(), getAbsoluteFilePath(sm, fileID)});
+}
+
+void IndexCollectCallback::run(const MatchFinder::MatchResult &Result)
+{
+    if (const ObjCInterfaceDecl *interfaceDecl = Result.Nodes.getNodeAs<ObjCInterfaceDecl>("objcInterfaceDecl"))
+    {
+        //@class 前向声明也算引用，只有定义才记录为符号
+        if (!classifier.isUserLoc(interfaceDecl->getBeginLoc()))
+            return;
+        result.referencedNames.insert(interfaceDecl->getNameAsString());
+        if (interfaceDecl->isThisDeclarationADefinition())
+            addSymbol(symbol_index::SK_Interface, interfaceDecl, interfaceDecl->getName(), "");
+    }
+    else if (const ObjCCategoryDecl *categoryDecl = Result.Nodes.getNodeAs<ObjCCategoryDecl>("objcCategoryDecl"))
+    {
+        const ObjCInterfaceDecl *interfaceDecl = categoryDecl->getClassInterface();
+        if (!interfaceDecl || !classifier.isUserLoc(categoryDecl->getBeginLoc()))
+            return;
+        result.referencedNames.insert(interfaceDecl->getNameAsString());
+        addSymbol(symbol_index::SK_Category, categoryDecl, categoryDecl->getName(), interfaceDecl->getName());
+    }
+    else if (const ObjCProtocolDecl *protocolDecl = Result.Nodes.getNodeAs<ObjCProtocolDecl>("objcProtocolDecl"))
+    {
+        if (!classifier.isUserLoc(protocolDecl->getBeginLoc()))
+            return;
+        result.referencedNames.insert(protocolDecl->getNameAsString());
+        if (protocolDecl->isThisDeclarationADefinition())
+            addSymbol(symbol_index::SK_Protocol, protocolDecl, protocolDecl->getName(), "");
+    }
+    else if (const clang::StringLiteral *stringLiteral = Result.Nodes.getNodeAs<clang::StringLiteral>("stringLiteral"))
+    {
+        //记录以非标识符字节分隔的每一段，--literal-policy=delimited 改写的 @"XYZFoo.Cell"、键路径也能据此判断；
+        //整个字面量形如标识符时即为其本身(exact)
+        if (stringLiteral->getCharByteWidth() != 1 || !classifier.isUserLoc(stringLiteral->getBeginLoc()))
+            return;
+        SmallVector<StringRef, 8> segments;
+        SplitString(stringLiteral->getString(), segments, NonIdentifierBytes);
+        for (StringRef segment : segments)
+        {
+            if (looksLikeIdentifier(segment))
+                result.referencedNames.insert(segment.str());
+        }
+    }
+}
+
+//短名只由大写字母开头的字母数字组成，其余标识符不会与之相同
+static bool looksLikeShortName(StringRef name)
+{
+    return !name.empty() && name.front() >= 'A' && name.front() <= 'Z' && llvm::all_of(name, [](char c) { return isAlnum(c); });
+}
+
+//预处理器见过的所有标识符：宏名、typedef、函数、变量、枚举常量、泛型参数、SDK 中的名字等，
+//不区分用途，宁可多保留；从 PCH/模块加载的标识符表也一并列出
+static void collectIdentifiers(Preprocessor &preprocessor, std::set<std::string> &identifiers)
+{
+    IdentifierTable &table = preprocessor.getIdentifierTable();
+    for (const auto &entry : table)
+    {
+        if (looksLikeShortName(entry.getKey()))
+            identifiers.insert(entry.getKey().str());
+    }
+    if (IdentifierInfoLookup *external = table.getExternalIdentifierLookup())
+    {
+        std::unique_ptr<IdentifierIterator> iterator(external->getIdentifiers());
+        if (!iterator)
+            return;
+        for (StringRef name = iterator->Next(); !name.empty(); name = iterator->Next())
+        {
+            if (looksLikeShortName(name))
+                identifiers.insert(name.str());
+        }
+    }
+}
+
+IndexCollectConsumer::IndexCollectConsumer(CompilerInstance *aCI, const SourceRoots &aRoots, IndexCollectResult &aResult)
+    :compilerInstance(aCI)
+    ,result(aResult)
+    ,handlerMatchCallback(aCI, aRoots, aResult)
+{
+    matcher.addMatcher(objcInterfaceDecl().bind("objcInterfaceDecl"), &handlerMatchCallback);
+    matcher.addMatcher(objcCategoryDecl().bind("objcCategoryDecl"), &handlerMatchCallback);
+    matcher.addMatcher(objcProtocolDecl().bind("objcProtocolDecl"), &handlerMatchCallback);
+    matcher.addMatcher(stringLiteral().bind("stringLiteral"), &handlerMatchCallback);
+}
+
+void IndexCollectConsumer::HandleTranslationUnit(ASTContext &Context)
+{
+    collectIdentifiers(compilerInstance->getPreprocessor(), result.identifiers);
+    restrictTraversalToUserSource(Context, handlerMatchCallback.getClassifier());
+    matcher.matchAST(Context);
+}
+
+IndexCollectAction::IndexCollectAction(const SourceRoots &aRoots, IndexCollectResult &aResult)
+: roots(aRoots)
+, result(aResult)
+{
+}
+
+std::unique_ptr<ASTConsumer> IndexCollectAction::CreateASTConsumer(clang::CompilerInstance &CI, StringRef file)
+{
+    SourceManager &sm = CI.getSourceManager();
+    result.mainFile = getAbsoluteFilePath(sm, sm.getMainFileID());
+    return std::make_unique<IndexCollectConsumer>(&CI, roots, result);
+}
+
+void IndexCollectAction::EndSourceFileAction()
+{
+    if (getCompilerInstance().getDiagnostics().hasErrorOccurred())
+        result.mainFile.clear();
+}
+
+IndexCollectActionFactory::IndexCollectActionFactory(const SourceRoots &aRoots, IndexCollectResult &aResult)
+: roots(aRoots)
+, result(aResult)
+{
+}
+
+std::unique_ptr<FrontendAction> IndexCollectActionFactory::create()
+{
+    return std::make_unique<IndexCollectAction>(roots, result);
+}
+
+bool collectSymbolIndex(const CompilationDatabase &compilations, ArrayRef<std::string> files, unsigned jobs,
+                        const SourceRoots &roots, StringRef indexPath)
+{
+    std::vector<IndexCollectResult> results(files.size());
+    //每个TU都包含大量 SDK 标识符，TU 结束时就并入，不逐个保留
+    SymbolIndexBuilder builder;
+    std::mutex builderMutex;
+    unsigned failures = runActionsInParallel(compilations, files, jobs, [&](size_t i) {
+        return std::make_unique<IndexCollectActionFactory>(roots, results[i]);
+    }, [&](size_t i) {
+        std::lock_guard<std::mutex> lock(builderMutex);
+        builder.addIdentifiers(results[i].identifiers);
+        results[i].identifiers.clear();
+    });
+
+    for (const IndexCollectResult &result : results)
+    {
+        if (!result.mainFile.empty())
+            builder.add(result);
+    }
+    if (!builder.write(indexPath, errs()))
+        return false;
+    return failures == 0;
+}
@@ -0,0 +1,82 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include "objc_obfuscator.hpp"
+#include "symbol_index.hpp"
+
+// 第一阶段(collect)：记录用户定义的类/分类/协议，以及TU中可能被改写的名字
+class IndexCollectCallback : public MatchFinder::MatchCallback
+{
+public:
+    IndexCollectCallback(CompilerInstance *aCompilerInstance, const SourceRoots &aRoots, IndexCollectResult &aResult);
+
+    virtual void run(const MatchFinder::MatchResult &Result) override;
+    SourceClassifier &getClassifier() { return classifier; }
+
+private:
+    void addSymbol(symbol_index::SymbolKind kind, const Decl *decl, StringRef name, StringRef owner);
+
+    CompilerInstance *compilerInstance;
+    IndexCollectResult &result;
+    SourceClassifier classifier;
+};
+
+class IndexCollectConsumer : public ASTConsumer
+{
+public:
+    IndexCollectConsumer(CompilerInstance *aCI, const SourceRoots &aRoots, IndexCollectResult &aResult);
+    virtual void HandleTranslationUnit(ASTContext &Context) override;
+private:
+    CompilerInstance *compilerInstance;
+    IndexCollectResult &result;
+    MatchFinder matcher;
+    IndexCollectCallback handlerMatchCallback;
+};
+
+class IndexCollectAction : public ASTFrontendAction
+{
+public:
+    IndexCollectAction(const SourceRoots &aRoots, IndexCollectResult &aResult);
+    std::unique_ptr<ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, StringRef file) override;
+    //有编译错误的TU不写入索引，第二阶段会照常处理它
+    void EndSourceFileAction() override;
+private:
+    const SourceRoots &roots;
+    IndexCollectResult &result;
+};
+
+class IndexCollectActionFactory : public FrontendActionFactory
+{
+public:
+    IndexCollectActionFactory(const SourceRoots &aRoots, IndexCollectResult &aResult);
+    std::unique_ptr<FrontendAction> create() override;
+private:
+    const SourceRoots &roots;
+    IndexCollectResult &result;
+};
+
+// 并行遍历所有TU并写出索引
+bool collectSymbolIndex(const CompilationDatabase &compilations, ArrayRef<std::string> files, unsigned jobs,
+                        const SourceRoots &roots, StringRef indexPath);
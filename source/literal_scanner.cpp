@@ -0,0 +1,235 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "literal_scanner.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include "llvm/ADT/StringExtras.h"
+
+using namespace llvm;
+
+static bool isIdentifierChar(char c)
+{
+    return isAlnum(c) || c == '_' || c == '$';
+}
+
+LiteralScanner::LiteralScanner(const RenameMap &renameMap)
+{
+    std::vector<StringRef> exactKeys, patternKeys;
+    unanchored = !renameMap.getLiteralKeys(exactKeys, patternKeys);
+
+    //先建成 std::map 表示的字典树，再按层展开成连续的边表
+    struct TrieNode
+    {
+        std::map<uint8_t, uint32_t> children;
+        uint32_t exactLength = 0;
+        bool patternKey = false;
+    };
+    std::vector<TrieNode> trie(1);
+    auto insert = [&](StringRef key, bool exact) {
+        uint32_t node = 0;
+        for (char c : key)
+        {
+            auto found = trie[node].children.find(static_cast<uint8_t>(c));
+            if (found == trie[node].children.end())
+            {
+                trie.emplace_back();
+                found = trie[node].children.emplace(static_cast<uint8_t>(c), trie.size() - 1).first;
+            }
+            node = found->second;
+        }
+        if (exact)
+            trie[node].exactLength = key.size();
+        else
+            trie[node].patternKey = true;
+        firstBytes[static_cast<uint8_t>(key.front())] = true;
+    };
+    for (StringRef key : exactKeys)
+        insert(key, true);
+    for (StringRef key : patternKeys)
+        insert(key, false);
+
+    states.resize(trie.size());
+    for (size_t i = 0; i < trie.size(); i++)
+    {
+        states[i].firstEdge = edges.size();
+        states[i].edgeCount = trie[i].children.size();
+        states[i].exactLength = trie[i].exactLength;
+        states[i].patternKey = trie[i].patternKey;
+        for (const auto &child : trie[i].children)
+            edges.push_back({child.first, child.second});
+    }
+
+    //按层计算失败链接：子节点的失败状态是父节点失败状态沿同一字节的转移
+    std::deque<uint32_t> queue;
+    for (uint32_t e = 0; e < states[0].edgeCount; e++)
+        queue.push_back(edges[e].target);
+    while (!queue.empty())
+    {
+        uint32_t node = queue.front();
+        queue.pop_front();
+        const State &current = states[node];
+        for (uint32_t e = current.firstEdge; e < current.firstEdge + current.edgeCount; e++)
+        {
+            uint32_t child = edges[e].target;
+            State &childState = states[child];
+            childState.fail = step(current.fail, edges[e].byte);
+            const State &failState = states[childState.fail];
+            childState.outputLink = hasOutput(failState) ? childState.fail : failState.outputLink;
+            queue.push_back(child);
+        }
+    }
+}
+
+uint32_t LiteralScanner::step(uint32_t state, uint8_t byte) const
+{
+    while (true)
+    {
+        const State &current = states[state];
+        //字典树深处的状态大多只有一条出边
+        if (current.edgeCount == 1 && edges[current.firstEdge].byte == byte)
+            return edges[current.firstEdge].target;
+        const Edge *begin = edges.data() + current.firstEdge;
+        const Edge *end = begin + current.edgeCount;
+        const Edge *found = std::lower_bound(begin, end, byte, [](const Edge &edge, uint8_t b) { return edge.byte < b; });
+        if (found != end && found->byte == byte)
+            return found->target;
+        if (state == 0)
+            return 0;
+        state = current.fail;
+    }
+}
+
+void LiteralScanner::splitWords(StringRef text, SmallVectorImpl<Candidate> &candidates)
+{
+    const size_t size = text.size();
+    size_t i = 0;
+    while (i < size)
+    {
+        if (!isIdentifierChar(text[i]))
+        {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < size && isIdentifierChar(text[i]))
+            i++;
+        //类名不以数字开头
+        if (!isDigit(text[start]))
+            candidates.push_back({start, i - start});
+    }
+}
+
+void LiteralScanner::scan(StringRef text, LiteralPolicy policy, SmallVectorImpl<Candidate> &candidates) const
+{
+    //每个单词直接查表比逐字节走大自动机快得多：状态多时每一步的出边查找都不在缓存中
+    if (policy != LiteralPolicy::Substring)
+    {
+        splitWords(text, candidates);
+        return;
+    }
+    //精确键的所有出现位置，以及含有前缀/通配键的单词
+    SmallVector<Candidate, 8> exactHits;
+    SmallVector<Candidate, 8> tokens;
+    size_t tokenStart = 0;
+    bool tokenMatched = false;
+    uint32_t state = 0;
+    const size_t size = text.size();
+    for (size_t i = 0; i <= size; i++)
+    {
+        if (i == size || !isIdentifierChar(text[i]))
+        {
+            //单词结束；键只由标识符字符组成，自动机回到根状态
+            if (tokenMatched)
+                tokens.push_back({tokenStart, i - tokenStart});
+            tokenMatched = false;
+            state = 0;
+            if (i == size)
+                break;
+            continue;
+        }
+        if (i == 0 || !isIdentifierChar(text[i - 1]))
+        {
+            tokenStart = i;
+            tokenMatched = unanchored;
+        }
+        if (state == 0 && !firstBytes[static_cast<uint8_t>(text[i])])
+            continue;
+        state = step(state, static_cast<uint8_t>(text[i]));
+        for (uint32_t output = hasOutput(states[state]) ? state : states[state].outputLink; output;
+             output = states[output].outputLink)
+        {
+            const State &hit = states[output];
+            if (hit.exactLength)
+                exactHits.push_back({i + 1 - hit.exactLength, hit.exactLength});
+            if (hit.patternKey)
+                tokenMatched = true;
+        }
+    }
+
+    //最左最长：同一位置取最长的精确键，之后跳过与已选范围重叠的出现
+    std::sort(exactHits.begin(), exactHits.end(), [](const Candidate &a, const Candidate &b) {
+        return a.offset != b.offset ? a.offset < b.offset : a.length > b.length;
+    });
+    size_t start = candidates.size();
+    size_t end = 0;
+    for (const Candidate &hit : exactHits)
+    {
+        if (hit.offset < end)
+            continue;
+        candidates.push_back(hit);
+        end = hit.offset + hit.length;
+    }
+    //含有前缀/通配键的整个单词，不与精确键的出现重叠时才作为候选
+    for (const Candidate &token : tokens)
+    {
+        bool overlaps = llvm::any_of(llvm::makeArrayRef(candidates).drop_front(start), [&](const Candidate &hit) {
+            return hit.offset < token.offset + token.length && token.offset < hit.offset + hit.length;
+        });
+        if (!overlaps)
+            candidates.push_back(token);
+    }
+    std::sort(candidates.begin() + start, candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.offset < b.offset;
+    });
+}
+
+bool LiteralScanner::containsAny(StringRef text) const
+{
+    if (unanchored)
+        return true;
+    uint32_t state = 0;
+    for (char c : text)
+    {
+        uint8_t byte = static_cast<uint8_t>(c);
+        if (state == 0 && !firstBytes[byte])
+            continue;
+        state = step(state, byte);
+        if (hasOutput(states[state]) || states[state].outputLink)
+            return true;
+    }
+    return false;
+}
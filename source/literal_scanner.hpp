@@ -0,0 +1,101 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "rename_map.hpp"
+
+// 字符串字面量中类名的改写范围
+enum class LiteralPolicy
+{
+    //整个字面量等于类名
+    Exact,
+    //以非标识符字符分隔的类名，如 @"DemoViewController.Cell"、键路径
+    Delimited,
+    //精确规则中的类名出现在任何位置，包括更长的单词中，如 @"DemoViewControllerCell"
+    Substring,
+};
+
+// 在字符串字面量中查找可能需要改名的类名
+//
+// Delimited 只需按非标识符字符切出单词，逐个交给重命名表查询，不经过自动机。
+// Substring 和 containsAny 要找出现在任意位置的键：由重命名表的全部字面键(精确名、前缀、通配规则的字面部分)
+// 构建一个 Aho-Corasick 自动机，每段文本只线性扫描一遍，在根状态时按首字节表跳过不可能开始任何键的字节。
+// 扫描只给出候选范围，是否改名及新名仍由重命名表决定。构建后只读，可被多个线程同时使用。
+class LiteralScanner
+{
+public:
+    explicit LiteralScanner(const RenameMap &renameMap);
+
+    struct Candidate
+    {
+        size_t offset;
+        size_t length;
+    };
+
+    //text 中以非标识符字符分隔、不以数字开头的每个单词(Delimited 的候选)，按位置排序
+    static void splitWords(llvm::StringRef text, llvm::SmallVectorImpl<Candidate> &candidates);
+    //按 policy(Delimited 或 Substring)扫描 text，候选按位置排序且互不重叠
+    void scan(llvm::StringRef text, LiteralPolicy policy, llvm::SmallVectorImpl<Candidate> &candidates) const;
+
+    //text 中是否出现了任何字面键(不论边界)，找到第一个即返回；用于解析前的预筛选
+    bool containsAny(llvm::StringRef text) const;
+
+    size_t getStateCount() const { return states.size(); }
+
+private:
+    struct State
+    {
+        //出边在 edges 中的范围，按字节排序
+        uint32_t firstEdge = 0;
+        uint32_t edgeCount = 0;
+        uint32_t fail = 0;
+        //失败链上下一个有输出的状态，0 表示没有
+        uint32_t outputLink = 0;
+        //在此结束的最长精确键的长度，0 表示没有
+        uint32_t exactLength = 0;
+        //在此结束的键中有前缀/通配规则的字面部分
+        bool patternKey = false;
+    };
+    struct Edge
+    {
+        uint8_t byte;
+        uint32_t target;
+    };
+
+    uint32_t step(uint32_t state, uint8_t byte) const;
+    bool hasOutput(const State &state) const { return state.exactLength || state.patternKey; }
+
+    std::vector<State> states;
+    std::vector<Edge> edges;
+    //可以作为某个键首字节的字节
+    bool firstBytes[256] = {};
+    //有不含字面部分的规则，每个标识符都是候选
+    bool unanchored = false;
+};
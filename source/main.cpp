@@ -22,23 +22,943 @@
 //===----------------------------------------------------------------------===//
 
 #include "objc_obfuscator.hpp"
+#include "atomic_file.hpp"
+#include "compilation_database.hpp"
+#include "deobfuscator.hpp"
+#include "incremental_cache.hpp"
+#include "index_collector.hpp"
+#include "name_generator.hpp"
+#include "output_writer.hpp"
+#include "parallel_driver.hpp"
+#include "resource_rewriter.hpp"
+#include "server.hpp"
+#include "shard.hpp"
+#include "shared_file_cache.hpp"
+#include "tu_prefilter.hpp"
+#include "verifier.hpp"
+
+#include <chrono>
+
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/Support/Format.h"
 
 static llvm::cl::OptionCategory MyToolCategory("my-tool options");
 static cl::extrahelp CommonHelp(CommonOptionsParser::HelpMessage);
 static cl::extrahelp MoreHelp("\nMore help content ...\n");
 
+//与 CommonOptionsParser 的选项相同；编译数据库由 loadCompilations 自行加载
+static cl::opt<std::string> BuildPath("p",
+    cl::desc("Build path"),
+    cl::Optional, cl::cat(MyToolCategory));
+static cl::list<std::string> SourcePaths(cl::Positional,
+    cl::desc("<source0> [... <sourceN>]"),
+    cl::ZeroOrMore, cl::cat(MyToolCategory));
+static cl::list<std::string> ArgsAfter("extra-arg",
+    cl::desc("Additional argument to append to the compiler command line"),
+    cl::cat(MyToolCategory));
+static cl::list<std::string> ArgsBefore("extra-arg-before",
+    cl::desc("Additional argument to prepend to the compiler command line"),
+    cl::cat(MyToolCategory));
+static cl::opt<unsigned> Jobs("jobs",
+    cl::desc("Number of translation units processed in parallel (0 = all cores)"),
+    cl::init(0), cl::cat(MyToolCategory));
+static cl::alias JobsShort("j", cl::desc("Alias for --jobs"), cl::aliasopt(Jobs));
+static cl::opt<std::string> RenameMapFile("rename-map",
+    cl::desc("Rename map: one '<old> <new>' per line, <old> may be a prefix (XYZ*) or glob"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<std::string> NameSeed("name-seed",
+    cl::desc("Project seed of the names generated for '@' rules in the rename map"),
+    cl::value_desc("string"), cl::cat(MyToolCategory));
+static cl::opt<unsigned> NameLength("name-length",
+    cl::desc("Length of generated names, excluding the rule's prefix (default 12)"),
+    cl::init(12), cl::cat(MyToolCategory));
+static cl::opt<std::string> ReservedNamesFile("reserved-names",
+    cl::desc("Identifiers generated names must never equal, e.g. SDK class names (one per line)"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<bool> ShortNames("short-names",
+    cl::desc("With --index: give the classes selected by the rename map the shortest legal names, most referenced first"),
+    cl::cat(MyToolCategory));
+static cl::opt<unsigned> ShortNameMinLength("short-name-min-length",
+    cl::desc("Length of the first names handed out by --short-names (default 2)"),
+    cl::init(2), cl::cat(MyToolCategory));
+static cl::list<std::string> SystemRoots("system-root",
+    cl::desc("Directory of SDK/system sources that are never renamed (repeatable, default /Applications/Xcode.app)"),
+    cl::value_desc("dir"), cl::cat(MyToolCategory));
+static cl::list<std::string> VendorDirs("vendor-dir",
+    cl::desc("Directory name of vendored third-party sources that are never renamed, e.g. Pods (repeatable)"),
+    cl::value_desc("name"), cl::cat(MyToolCategory));
+static cl::opt<ObfEngine> Engine("engine",
+    cl::desc("AST traversal engine"),
+    cl::values(clEnumValN(ObfEngine::Matcher, "matcher", "AST matchers funnelling into one callback (default)"),
+               clEnumValN(ObfEngine::Visitor, "visitor", "single-pass RecursiveASTVisitor with typed dispatch")),
+    cl::init(ObfEngine::Matcher), cl::cat(MyToolCategory));
+static cl::opt<LiteralPolicy> LiteralPolicyOption("literal-policy",
+    cl::desc("Which class names inside string literals are renamed"),
+    cl::values(clEnumValN(LiteralPolicy::Exact, "exact", "only literals that are exactly a class name (default)"),
+               clEnumValN(LiteralPolicy::Delimited, "delimited", "class names delimited by non-identifier characters, e.g. key paths"),
+               clEnumValN(LiteralPolicy::Substring, "substring", "names of exact rules anywhere, also inside longer words")),
+    cl::init(LiteralPolicy::Exact), cl::cat(MyToolCategory));
+static cl::opt<std::string> CollectIndexFile("collect-index",
+    cl::desc("Phase 1: collect user-defined classes/categories/protocols of all TUs into <filename> and exit"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<std::string> IndexFile("index",
+    cl::desc("Phase 2: rewrite against the symbol index in <filename>, skipping TUs that reference no renamed symbol"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<bool> Prefilter("prefilter",
+    cl::desc("Skip TUs whose main file and reachable user headers contain no name from the rename map, without parsing them"),
+    cl::cat(MyToolCategory));
+static cl::opt<bool> HeaderOnce("header-once",
+    cl::desc("Traverse each guarded user header once per run and reuse its renames in the other TUs that include it"),
+    cl::cat(MyToolCategory));
+static cl::opt<bool> SkipFunctionBodies("skip-function-bodies",
+    cl::desc("Parse only the function bodies of the main file and of user headers that mention a renamed name"),
+    cl::cat(MyToolCategory));
+static cl::opt<std::string> IncrementalCacheDir("incremental-cache",
+    cl::desc("Reuse the edits of TUs whose sources, includes, flags and rename map are unchanged since the last run"),
+    cl::value_desc("directory"), cl::cat(MyToolCategory));
+static cl::opt<bool> ReusePreamble("reuse-preamble",
+    cl::desc("Precompile each distinct preamble (prefix header + leading imports) once and share it across TUs"),
+    cl::cat(MyToolCategory));
+static cl::opt<std::string> MaxMemory("max-memory",
+    cl::desc("Only start a TU while the estimated memory of the TUs in flight and the process RSS stay below <size>, e.g. 48G"),
+    cl::value_desc("size"), cl::cat(MyToolCategory));
+static cl::opt<std::string> MemoryProfile("memory-profile",
+    cl::desc("Per-TU memory peaks of the previous run used as --max-memory estimates; updated after the run"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::list<std::string> Resources("resource",
+    cl::desc("Also rename class names in this .storyboard/.xib/.plist file, or in those under this directory (repeatable)"),
+    cl::value_desc("path"), cl::cat(MyToolCategory));
+static cl::opt<bool> Verify("verify",
+    cl::desc("Re-parse the affected TUs against the rewritten sources in memory and report new errors; nothing is written if there are any"),
+    cl::cat(MyToolCategory));
+static cl::opt<bool> InPlace("in-place",
+    cl::desc("Write the renamed sources back over the originals"),
+    cl::cat(MyToolCategory));
+static cl::opt<std::string> OutputDir("output-dir",
+    cl::desc("Write the renamed sources under <directory>, mirroring their paths"),
+    cl::value_desc("directory"), cl::cat(MyToolCategory));
+static cl::opt<std::string> ExportFixes("export-fixes",
+    cl::desc("Export the merged replacements as YAML to <filename>"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<std::string> ManifestFile("manifest",
+    cl::desc("Write every rename (kind, old, new, file, line, column) as JSON Lines to <filename>"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<std::string> ManifestBinaryFile("manifest-binary",
+    cl::desc("Write the rename manifest in the compact binary format to <filename> (deobfuscate: read it)"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<std::string> ReverseIndexFile("reverse-index",
+    cl::desc("deobfuscate: save the reverse index built from --manifest-binary to <filename>, or load it when no manifest is given"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<bool> Stats("stats",
+    cl::desc("Print per-TU phase times, rewrites and RSS, per-handler counters and times, and the run's phases"),
+    cl::cat(MyToolCategory));
+static cl::opt<std::string> TraceFile("trace",
+    cl::desc("Write a Chrome trace of the whole run, including clang's -ftime-trace sections, to <filename>"),
+    cl::value_desc("filename"), cl::cat(MyToolCategory));
+static cl::opt<unsigned> TraceGranularity("trace-granularity",
+    cl::desc("Minimum duration in microseconds of a traced section (default 500)"),
+    cl::init(500), cl::cat(MyToolCategory));
+static cl::opt<std::string> Shard("shard",
+    cl::desc("Process only slice i of N (0 <= i < N) of the sorted input files; without source files, all files of the compilation database are the input"),
+    cl::value_desc("i/N"), cl::cat(MyToolCategory));
+static cl::opt<std::string> ServeSocket("serve",
+    cl::desc("Stay resident on the Unix socket <path> and rewrite the files sent by --connect, keeping the compilation database, rename map, preambles and file cache warm"),
+    cl::value_desc("path"), cl::cat(MyToolCategory));
+static cl::opt<std::string> ServeCacheSize("serve-cache-size",
+    cl::desc("Keep at most <size> of file contents cached between --serve requests, least recently used first out (default 1G)"),
+    cl::value_desc("size"), cl::init("1G"), cl::cat(MyToolCategory));
+static cl::opt<std::string> ConnectSocket("connect",
+    cl::desc("Send the source files to the server on <path> and print its output; needs no other option"),
+    cl::value_desc("path"), cl::cat(MyToolCategory));
+static cl::opt<bool> ShutdownServer("shutdown-server",
+    cl::desc("With --connect: stop the server"),
+    cl::cat(MyToolCategory));
+static cl::opt<bool> Verbose("verbose",
+    cl::desc("Print each rewritten declaration/expression, grouped per translation unit"),
+    cl::cat(MyToolCategory));
+
+//导出为 clang-apply-replacements 可识别的格式
+static bool exportFixes(StringRef path, const std::map<std::string, tooling::Replacements> &replacements, raw_ostream &log)
+{
+    TranslationUnitReplacements tur;
+    for (const auto &fileReplacements : replacements)
+    {
+        tur.Replacements.insert(tur.Replacements.end(), fileReplacements.second.begin(), fileReplacements.second.end());
+    }
+    return writeFileAtomically(path, [&](raw_ostream &os) {
+        yaml::Output yaml(os);
+        yaml << tur;
+    }, log);
+}
+
+// 重命名表、生成器、索引及由它们得到的重命名计划；服务模式下这些文件不变时跨请求复用
+struct RenameSetup
+{
+    RenameMap renameMap;
+    //生成器只依赖种子和旧名，保留名在运行前一次加入，worker 之间不共享可变状态
+    NameGenerator nameGenerator{NameSeed, NameLength};
+    std::unique_ptr<SymbolIndex> symbolIndex;
+    RenameMap renamePlan;
+    //--literal-policy 非 exact 或 --prefilter 时由生效的重命名表构建
+    std::unique_ptr<LiteralScanner> literalScanner;
+};
+
+static std::unique_ptr<RenameSetup> loadRenameSetup(RunPhases &phases, raw_ostream &log)
+{
+    auto setup = std::make_unique<RenameSetup>();
+    RenameMap &renameMap = setup->renameMap;
+    NameGenerator &nameGenerator = setup->nameGenerator;
+    if (RenameMapFile.empty())
+    {
+        log << "warning: no --rename-map given, nothing will be renamed\n";
+    }
+    else if (!renameMap.loadFile(RenameMapFile, log))
+    {
+        return nullptr;
+    }
+    if (ShortNames && IndexFile.empty())
+    {
+        log << "--short-names needs the usage counts of --index\n";
+        return nullptr;
+    }
+    if (renameMap.hasGeneratedRules() || ShortNames)
+    {
+        //短名模式下重命名表只用来选出要改名的类，不需要种子
+        if (!ShortNames && NameSeed.empty())
+        {
+            log << "the rename map has '@' rules, pass --name-seed\n";
+            return nullptr;
+        }
+        if (!ShortNames && NameLength < 4)
+        {
+            log << "--name-length must be at least 4\n";
+            return nullptr;
+        }
+        std::vector<StringRef> explicitNames;
+        renameMap.getExplicitNames(explicitNames);
+        for (StringRef name : explicitNames)
+        {
+            nameGenerator.addReserved(name);
+        }
+        if (!ReservedNamesFile.empty() && !nameGenerator.loadReservedFile(ReservedNamesFile, log))
+        {
+            return nullptr;
+        }
+        renameMap.setNameGenerator(&nameGenerator);
+    }
+
+    if (!IndexFile.empty())
+    {
+        RunPhases::Scope phase(phases, "index");
+        setup->symbolIndex = SymbolIndex::load(IndexFile, log);
+        if (!setup->symbolIndex)
+        {
+            return nullptr;
+        }
+        //索引中的所有类名、分类名、协议名，以及各TU中出现过的宏、typedef、函数、枚举常量、SDK 名字等都是已知标识符
+        for (const symbol_index::Symbol &symbol : setup->symbolIndex->symbols())
+        {
+            nameGenerator.addReserved(setup->symbolIndex->getString(symbol.name));
+        }
+        for (const symbol_index::Str &identifier : setup->symbolIndex->identifiers())
+        {
+            nameGenerator.addReserved(setup->symbolIndex->getString(identifier));
+        }
+        //按全局索引统一决定改名，不再在每个TU里各自判断
+        if (ShortNames)
+        {
+            ShortNameStats stats;
+            setup->symbolIndex->buildShortRenamePlan(renameMap, nameGenerator, ShortNameMinLength, setup->renamePlan, stats);
+            log << "short names: " << stats.classCount << " classes, class name strings " << stats.oldBytes
+                << " -> " << stats.newBytes << " bytes, projected saving "
+                << (stats.oldBytes - stats.newBytes) << " bytes\n";
+        }
+        else
+        {
+            setup->symbolIndex->buildRenamePlan(renameMap, setup->renamePlan);
+        }
+    }
+    //delimited 逐个单词查表，不需要自动机
+    if (LiteralPolicyOption == LiteralPolicy::Substring || Prefilter || SkipFunctionBodies)
+    {
+        setup->literalScanner = std::make_unique<LiteralScanner>(setup->symbolIndex ? setup->renamePlan : renameMap);
+    }
+    return setup;
+}
+
+// 一次运行所需的、与具体文件无关的状态；服务模式下跨请求保留
+struct ToolState
+{
+    const CompilationDatabase *compilations = nullptr;
+    SourceRoots roots;
+    std::unique_ptr<RenameSetup> setup;
+    PreambleCache preambleCache;
+    SharedFileCache *fileCache = nullptr;
+};
+
+//处理 files 并按选项输出结果；过程信息写入 log，--verbose 的逐条输出写入 out
+static int obfuscateFiles(ToolState &state, std::vector<std::string> files, RunPhases &phases, raw_ostream &log, raw_ostream &out)
+{
+    RenameSetup &setup = *state.setup;
+    ObfConfig config;
+    config.renameMap = &setup.renameMap;
+    config.roots = state.roots;
+    config.engine = Engine;
+    config.literalPolicy = LiteralPolicyOption;
+    config.literalScanner = setup.literalScanner.get();
+    config.verbose = Verbose;
+    config.collectStats = Stats;
+    config.skipFunctionBodies = SkipFunctionBodies;
+    if (ReusePreamble)
+    {
+        config.preambleCache = &state.preambleCache;
+    }
+    std::unique_ptr<HeaderRegistry> headerRegistry;
+    if (HeaderOnce)
+    {
+        headerRegistry = std::make_unique<HeaderRegistry>();
+        config.headerRegistry = headerRegistry.get();
+    }
+    unsigned preamblesBuilt = state.preambleCache.getBuildCount();
+    unsigned preamblesReused = state.preambleCache.getReuseCount();
+
+    if (setup.symbolIndex)
+    {
+        config.renameMap = &setup.renamePlan;
+    }
+    //索引只记录整个标识符和以非标识符字节分隔的字面量片段；substring 改写更长单词中的类名，无法由索引判断
+    if (setup.symbolIndex && LiteralPolicyOption == LiteralPolicy::Substring)
+    {
+        log << "--literal-policy=substring: not skipping TUs by index\n";
+    }
+    else if (setup.symbolIndex)
+    {
+        size_t total = files.size();
+        files.erase(std::remove_if(files.begin(), files.end(), [&](const std::string &file) {
+            return !setup.symbolIndex->mayReferenceAny(getNormalizedAbsolutePath(file), setup.renamePlan);
+        }), files.end());
+        log << "skipped " << (total - files.size()) << " of " << total << " TUs referencing no renamed symbol\n";
+    }
+    if (Prefilter)
+    {
+        RunPhases::Scope phase(phases, "prefilter");
+        TUPrefilter prefilter(*setup.literalScanner, state.roots);
+        size_t total = files.size();
+        files = prefilter.filter(*state.compilations, files, Jobs);
+        log << "prefilter: skipped " << (total - files.size()) << " of " << total
+            << " TUs containing no name from the rename map (scanned " << prefilter.getScannedFileCount()
+            << " files, " << prefilter.getScannedBytes() << " bytes)\n";
+    }
+
+    ParallelObfDriver driver(*state.compilations, config, Jobs);
+    driver.setFileCache(state.fileCache);
+    std::unique_ptr<IncrementalCache> cache;
+    if (!IncrementalCacheDir.empty())
+    {
+        std::vector<std::string> configValues(state.roots.systemRoots.begin(), state.roots.systemRoots.end());
+        configValues.insert(configValues.end(), state.roots.vendorDirs.begin(), state.roots.vendorDirs.end());
+        configValues.push_back(std::to_string(static_cast<int>(config.engine)));
+        configValues.push_back(std::to_string(static_cast<int>(config.literalPolicy)));
+        configValues.push_back(NameSeed);
+        configValues.push_back(std::to_string(NameLength));
+        configValues.push_back(ShortNames ? std::to_string(ShortNameMinLength) : "");
+        std::string fingerprint = IncrementalCache::computeFingerprint({RenameMapFile, IndexFile, ReservedNamesFile}, configValues);
+        cache = std::make_unique<IncrementalCache>(IncrementalCacheDir, fingerprint);
+        if (!cache->init(log))
+        {
+            return 1;
+        }
+        driver.setCache(cache.get());
+    }
+    std::unique_ptr<MemoryGovernor> governor;
+    if (!MaxMemory.empty())
+    {
+        uint64_t budget;
+        if (!MemoryGovernor::parseByteSize(MaxMemory, budget))
+        {
+            log << "invalid --max-memory '" << MaxMemory << "'\n";
+            return 1;
+        }
+        governor = std::make_unique<MemoryGovernor>(budget);
+        if (!MemoryProfile.empty() && !governor->loadProfile(MemoryProfile, log))
+        {
+            return 1;
+        }
+        driver.setMemoryGovernor(governor.get());
+    }
+    unsigned failures;
+    {
+        RunPhases::Scope phase(phases, "obfuscate");
+        failures = driver.run(files);
+    }
+    //资源文件不经过 clang，用同一份重命名表改写，结果与各TU一起合并、写出
+    std::vector<TUResult> resourceResults;
+    unsigned resourceErrors = 0;
+    if (!Resources.empty())
+    {
+        RunPhases::Scope phase(phases, "resources");
+        ResourceRewriter rewriter(*config.renameMap, Jobs);
+        std::vector<std::string> resourceFiles;
+        if (!rewriter.collect(Resources, resourceFiles, log))
+        {
+            return 1;
+        }
+        size_t renamed;
+        resourceErrors = rewriter.run(resourceFiles, resourceResults, renamed, log);
+        log << "renamed " << renamed << " class references in " << resourceFiles.size() << " resource files";
+        if (resourceErrors)
+        {
+            log << ", " << resourceErrors << " could not be processed";
+        }
+        log << "\n";
+    }
+    //统计和 trace 覆盖到写出为止，所有出口都经过这里
+    auto finish = [&](int code) {
+        if (Stats)
+        {
+            printRunStats(log, driver.getResults(), phases);
+        }
+        if (!TraceFile.empty() && !writeTrace(TraceFile, log))
+        {
+            return 1;
+        }
+        return code;
+    };
+    if (Verbose)
+    {
+        //各TU的输出在运行时各自缓冲，这里按文件顺序一次写出，不会交错
+        for (const TUResult &result : driver.getResults())
+        {
+            out << result.log;
+        }
+        out.flush();
+    }
+    if (ReusePreamble)
+    {
+        log << "built " << (state.preambleCache.getBuildCount() - preamblesBuilt) << " preambles, reused them for "
+            << (state.preambleCache.getReuseCount() - preamblesReused) << " TUs\n";
+    }
+    if (headerRegistry)
+    {
+        log << "header-once: recorded " << headerRegistry->getHeaderCount() << " headers, reused them "
+            << headerRegistry->getReuseCount() << " times, skipped " << headerRegistry->getSkippedDeclCount()
+            << " top-level declarations\n";
+    }
+    if (SkipFunctionBodies)
+    {
+        unsigned skippedBodies = 0;
+        for (const TUResult &result : driver.getResults())
+        {
+            skippedBodies += result.skippedBodies;
+        }
+        log << "skip-function-bodies: skipped " << skippedBodies << " function bodies\n";
+    }
+    if (governor)
+    {
+        log << "--max-memory held back TUs " << governor->getWaitCount() << " times\n";
+        if (!MemoryProfile.empty())
+        {
+            governor->writeProfile(MemoryProfile, log);
+        }
+    }
+    if (cache)
+    {
+        size_t hits = llvm::count_if(driver.getResults(), [](const TUResult &result) { return result.fromCache; });
+        log << "replayed " << hits << " of " << files.size() << " TUs from the incremental cache\n";
+    }
+
+    //各TU独立收集编辑，最后统一合并并检查冲突
+    std::map<std::string, tooling::Replacements> replacements;
+    unsigned conflicts;
+    {
+        RunPhases::Scope phase(phases, "merge");
+        ReplacementMerger merger;
+        for (const TUResult &result : driver.getResults())
+        {
+            merger.add(result);
+        }
+        merger.addEdits(driver.getFoldedEdits());
+        for (const TUResult &result : resourceResults)
+        {
+            merger.add(result);
+        }
+        conflicts = merger.finalize(replacements, log);
+    }
+    unsigned verifyErrors = 0;
+    if (Verify)
+    {
+        RunPhases::Scope phase(phases, "verify");
+        RewriteVerifier verifier(*state.compilations, Jobs);
+        verifyErrors = verifier.verify(replacements, files, driver.getResults(), log);
+        log << "verify: re-parsed " << verifier.getParsedCount() << " TUs, " << verifyErrors << " new errors\n";
+    }
+
+    if (!ExportFixes.empty() && !exportFixes(ExportFixes, replacements, log))
+    {
+        return finish(1);
+    }
+    if (!ManifestFile.empty() || !ManifestBinaryFile.empty())
+    {
+        RunPhases::Scope phase(phases, "manifest");
+        ManifestBuilder manifest;
+        for (const TUResult &result : driver.getResults())
+        {
+            manifest.add(result.renames);
+        }
+        for (const TUResult &result : resourceResults)
+        {
+            manifest.add(result.renames);
+        }
+        if (!ManifestFile.empty() && !manifest.writeJSONLines(ManifestFile, log))
+        {
+            return finish(1);
+        }
+        if (!ManifestBinaryFile.empty() && !manifest.writeBinary(ManifestBinaryFile, log))
+        {
+            return finish(1);
+        }
+        log << "recorded " << manifest.size() << " renames in the manifest\n";
+    }
+    if (InPlace || !OutputDir.empty())
+    {
+        //存在冲突时编辑集合不完整，不写任何文件
+        if (conflicts)
+        {
+            log << "not writing any file because of " << conflicts << " conflicting replacements\n";
+            return finish(1);
+        }
+        if (verifyErrors)
+        {
+            log << "not writing any file because verification found " << verifyErrors << " new errors\n";
+            return finish(1);
+        }
+        //资源中的类名没改而源码改了，运行时才会报 Unknown class
+        if (resourceErrors)
+        {
+            log << "not writing any file because " << resourceErrors << " resource files could not be processed\n";
+            return finish(1);
+        }
+        RunPhases::Scope phase(phases, "write");
+        OutputWriter writer(OutputDir, Jobs);
+        if (writer.write(replacements, log))
+        {
+            return finish(1);
+        }
+        log << "wrote " << writer.getWrittenCount() << " files\n";
+    }
+    return finish((failures || conflicts || verifyErrors || resourceErrors) ? 1 : 0);
+}
+
+//与 CommonOptionsParser 一样追加 --extra-arg-before/--extra-arg
+static std::unique_ptr<CompilationDatabase> addExtraArgs(std::unique_ptr<CompilationDatabase> database)
+{
+    auto adjusted = std::make_unique<ArgumentsAdjustingCompilations>(std::move(database));
+    adjusted->appendArgumentsAdjuster(getInsertArgumentAdjuster(ArgsBefore, ArgumentInsertPosition::BEGIN));
+    adjusted->appendArgumentsAdjuster(getInsertArgumentAdjuster(ArgsAfter, ArgumentInsertPosition::END));
+    return adjusted;
+}
+
+//目录中的编译数据库：compile_commands.json 流式加载并 intern，其它格式交给 clang 的插件
+static std::unique_ptr<CompilationDatabase> loadCompilations(StringRef buildPath, std::string &error, raw_ostream &log)
+{
+    SmallString<256> jsonPath(buildPath);
+    sys::path::append(jsonPath, "compile_commands.json");
+    if (!sys::fs::exists(jsonPath))
+    {
+        std::unique_ptr<CompilationDatabase> database = CompilationDatabase::autoDetectFromDirectory(buildPath, error);
+        return database ? addExtraArgs(std::move(database)) : nullptr;
+    }
+    std::unique_ptr<InternedCompilationDatabase> database = InternedCompilationDatabase::loadFromFile(jsonPath, error);
+    if (!database)
+    {
+        return nullptr;
+    }
+    if (Stats)
+    {
+        log << "loaded " << database->getEntryCount() << " compile commands sharing "
+            << database->getTemplateCount() << " distinct command lines\n";
+    }
+    //与 clang 的 JSON 插件相同：展开响应文件，为头文件推断命令，补全 target 和 driver mode
+    return addExtraArgs(inferTargetAndDriverMode(
+        inferMissingCompileCommands(expandResponseFiles(std::move(database), vfs::getRealFileSystem()))));
+}
+
+//-p 给出时从该目录加载，否则从第一个源文件所在目录向上查找；都找不到时与 CommonOptionsParser 一样不带参数运行
+static std::unique_ptr<CompilationDatabase> findCompilations(raw_ostream &log)
+{
+    std::string error;
+    std::unique_ptr<CompilationDatabase> database;
+    if (!BuildPath.empty())
+    {
+        database = loadCompilations(BuildPath, error, log);
+    }
+    else if (!SourcePaths.empty())
+    {
+        SmallString<256> directory(getNormalizedAbsolutePath(SourcePaths.front()));
+        sys::path::remove_filename(directory);
+        for (StringRef parent = directory; !parent.empty() && !database; parent = sys::path::parent_path(parent))
+        {
+            SmallString<256> jsonPath(parent);
+            sys::path::append(jsonPath, "compile_commands.json");
+            if (sys::fs::exists(jsonPath))
+            {
+                database = loadCompilations(parent, error, log);
+                if (!database)
+                {
+                    break;
+                }
+            }
+        }
+        if (!database && error.empty())
+        {
+            database = CompilationDatabase::autoDetectFromSource(SourcePaths.front(), error);
+            if (database)
+            {
+                database = addExtraArgs(std::move(database));
+            }
+        }
+    }
+    if (!database)
+    {
+        log << "Error while trying to load a compilation database:\n" << error << "\nRunning without flags.\n";
+        database = addExtraArgs(std::make_unique<FixedCompilationDatabase>(".", std::vector<std::string>()));
+    }
+    return database;
+}
+
+//文件的修改时间和大小，文件不存在时为空
+static std::string getFileStamp(StringRef path)
+{
+    sys::fs::file_status status;
+    if (sys::fs::status(path, status))
+        return std::string();
+    return std::to_string(status.getLastModificationTime().time_since_epoch().count()) + ":" +
+           std::to_string(status.getSize());
+}
+
+// 常驻服务：每个请求前校验重命名表等输入和编译数据库，变化时重新加载；
+// preamble 和文件缓存一直保留，依赖的头文件变化由它们各自按请求校验
+static int serve(ToolState &state, const CompilationDatabase &initialCompilations)
+{
+    if (!TraceFile.empty() || !CollectIndexFile.empty())
+    {
+        errs() << "--serve does not support --trace or --collect-index\n";
+        return 1;
+    }
+    uint64_t cacheCapacity;
+    if (!MemoryGovernor::parseByteSize(ServeCacheSize, cacheCapacity))
+    {
+        errs() << "invalid --serve-cache-size '" << ServeCacheSize << "'\n";
+        return 1;
+    }
+    SharedFileCache fileCache(state.roots, cacheCapacity);
+    state.fileCache = &fileCache;
+    state.compilations = &initialCompilations;
+    std::unique_ptr<CompilationDatabase> reloadedCompilations;
+    //编译数据库按 -p 目录中 compile_commands.json 的修改时间校验；由源文件路径推断或 -- 给出时不重新加载
+    std::string buildPath = BuildPath;
+    SmallString<256> compileCommandsFile(buildPath);
+    sys::path::append(compileCommandsFile, "compile_commands.json");
+    std::string compilationsStamp = buildPath.empty() ? std::string() : getFileStamp(compileCommandsFile);
+    //重命名表、索引、保留名按内容校验，修改时间的精度不足以区分连续两次保存
+    std::string setupFingerprint;
+
+    bool served = runServer(ServeSocket, [&](ArrayRef<std::string> files, raw_ostream &log) {
+        fileCache.beginRequest();
+        RunPhases phases;
+        if (!buildPath.empty())
+        {
+            std::string stamp = getFileStamp(compileCommandsFile);
+            if (stamp != compilationsStamp)
+            {
+                std::string error;
+                std::unique_ptr<CompilationDatabase> compilations = loadCompilations(buildPath, error, log);
+                if (!compilations)
+                {
+                    log << "cannot reload the compilation database: " << error << "\n";
+                    return 1;
+                }
+                log << "reloaded the compilation database\n";
+                reloadedCompilations = std::move(compilations);
+                state.compilations = reloadedCompilations.get();
+                compilationsStamp = stamp;
+            }
+        }
+        std::string fingerprint = IncrementalCache::computeFingerprint({RenameMapFile, IndexFile, ReservedNamesFile}, {});
+        if (!state.setup || fingerprint != setupFingerprint)
+        {
+            if (state.setup)
+                log << "reloading the rename map, index and reserved names\n";
+            state.setup = loadRenameSetup(phases, log);
+            if (!state.setup)
+                return 1;
+            setupFingerprint = fingerprint;
+        }
+        int code = obfuscateFiles(state, files.vec(), phases, log, log);
+        log << "file cache: " << fileCache.getStatHits() << " stat hits, " << fileCache.getReadHits()
+            << " reads served from memory, " << fileCache.getReadCount() << " files read, " << fileCache.getEvictions()
+            << " evicted\n";
+        return code;
+    }, errs());
+    return served ? 0 : 1;
+}
+
+//客户端不加载编译数据库和任何选项，在解析选项之前处理：
+//--connect=<path> [--shutdown-server] [源文件...]
+static bool runAsClient(int argc, const char **argv, int &code)
+{
+    StringRef socketPath;
+    bool shutdown = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        StringRef arg(argv[i]);
+        if (arg == "--")
+            break;
+        if (arg.consume_front("--connect=") || arg.consume_front("-connect="))
+            socketPath = arg;
+        else if (arg == "--shutdown-server" || arg == "-shutdown-server")
+            shutdown = true;
+        else if (!arg.startswith("-"))
+            files.push_back(arg.str());
+    }
+    if (socketPath.empty())
+        return false;
+    code = runClient(socketPath, files, shutdown, errs());
+    return true;
+}
+
+//merge <分片输出...>：合并各分片的 --export-fixes 和 --manifest-binary，检查冲突后按输出选项写出
+static int runMerge(ArrayRef<std::string> inputs)
+{
+    if (inputs.empty())
+    {
+        errs() << "merge needs the --export-fixes and --manifest-binary files of the shards\n";
+        return 1;
+    }
+    ReplacementMerger merger;
+    ManifestBuilder manifest;
+    for (const std::string &input : inputs)
+    {
+        TUResult result;
+        if (!loadShardOutput(input, result, errs()))
+        {
+            return 1;
+        }
+        merger.add(result);
+        manifest.add(result.renames);
+    }
+    std::map<std::string, tooling::Replacements> replacements;
+    unsigned conflicts = merger.finalize(replacements, errs());
+    errs() << "merged " << inputs.size() << " shard outputs: edits to " << replacements.size() << " files, "
+           << manifest.size() << " renames, " << conflicts << " conflicts\n";
+
+    if (!ExportFixes.empty() && !exportFixes(ExportFixes, replacements, errs()))
+    {
+        return 1;
+    }
+    if (!ManifestFile.empty() && !manifest.writeJSONLines(ManifestFile, errs()))
+    {
+        return 1;
+    }
+    if (!ManifestBinaryFile.empty() && !manifest.writeBinary(ManifestBinaryFile, errs()))
+    {
+        return 1;
+    }
+    if (InPlace || !OutputDir.empty())
+    {
+        if (conflicts)
+        {
+            errs() << "not writing any file because of " << conflicts << " conflicting replacements\n";
+            return 1;
+        }
+        OutputWriter writer(OutputDir, Jobs);
+        if (writer.write(replacements, errs()))
+        {
+            return 1;
+        }
+        errs() << "wrote " << writer.getWrittenCount() << " files\n";
+    }
+    return conflicts ? 1 : 0;
+}
+
+//deobfuscate [日志...]：按重命名清单把日志、符号表中的新名换回原名；不给文件或给 "-" 时读标准输入，写到标准输出
+static int runDeobfuscate(ArrayRef<std::string> inputs)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<ReverseIndex> index;
+    if (!ManifestBinaryFile.empty())
+    {
+        std::unique_ptr<RenameManifest> manifest = RenameManifest::load(ManifestBinaryFile, errs());
+        if (!manifest)
+        {
+            return 1;
+        }
+        std::string image;
+        ReverseIndex::BuildStats buildStats;
+        ReverseIndex::build(*manifest, image, buildStats);
+        if (buildStats.ambiguous)
+        {
+            errs() << "warning: " << buildStats.ambiguous
+                   << " new names map to more than one original name, using the first in sort order\n";
+        }
+        if (!ReverseIndexFile.empty() &&
+            !writeFileAtomically(ReverseIndexFile, [&](raw_ostream &os) { os << image; }, errs()))
+        {
+            return 1;
+        }
+        index = ReverseIndex::create(MemoryBuffer::getMemBufferCopy(image, ManifestBinaryFile), errs());
+    }
+    else if (!ReverseIndexFile.empty())
+    {
+        index = ReverseIndex::load(ReverseIndexFile, errs());
+    }
+    else
+    {
+        errs() << "deobfuscate needs --manifest-binary or --reverse-index\n";
+        return 1;
+    }
+    if (!index)
+    {
+        return 1;
+    }
+
+    Deobfuscator deobfuscator(*index, Jobs);
+    std::vector<std::string> paths(inputs.begin(), inputs.end());
+    if (paths.empty())
+    {
+        paths.push_back("-");
+    }
+    bool success = true;
+    for (const std::string &path : paths)
+    {
+        success &= deobfuscator.run(path, outs(), errs());
+    }
+    outs().flush();
+    if (Stats)
+    {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        errs() << "deobfuscated " << deobfuscator.getBytesRead() << " bytes in " << format("%.3f", seconds) << " s ("
+               << format("%.1f", seconds > 0 ? deobfuscator.getBytesRead() / seconds / 1e6 : 0.0) << " MB/s), "
+               << deobfuscator.getReplacedCount() << " names restored, " << index->getNameCount()
+               << " names in the index\n";
+    }
+    return success ? 0 : 1;
+}
 
 int main(int argc, const char **argv)
 {
-    auto OptionsParser = CommonOptionsParser::create(argc, argv, MyToolCategory);
-    ClangTool Tool(OptionsParser->getCompilations(),
-                   OptionsParser->getSourcePathList());
-#if 0
-  CommonOptionsParser OptionsParser(argc, argv, MyToolCategory);
-  ClangTool Tool(OptionsParser.getCompilations(),
-      OptionsParser.getSourcePathList());
-#endif
-    // auto action = newFrontendActionFactory<ObfASTFrontendAction>();
-    auto action = newFrontendActionFactory<clang::SyntaxOnlyAction>();
-    return Tool.run(action.get());
-}
\ No newline at end of file
+    int clientCode;
+    if (runAsClient(argc, argv, clientCode))
+    {
+        return clientCode;
+    }
+    //merge 子命令：其后的位置参数是分片的输出文件；deobfuscate 子命令：其后的位置参数是要还原的日志
+    std::vector<const char *> arguments(argv, argv + argc);
+    StringRef subcommand = argc > 1 ? argv[1] : "";
+    bool merge = subcommand == "merge";
+    bool deobfuscate = subcommand == "deobfuscate";
+    if (merge || deobfuscate)
+    {
+        arguments.erase(arguments.begin() + 1);
+    }
+    int argumentCount = arguments.size();
+    cl::HideUnrelatedOptions(MyToolCategory);
+    std::string fixedError;
+    //"--" 之后的编译参数用于所有文件，同时从 argumentCount 中去掉
+    std::unique_ptr<CompilationDatabase> fixedCompilations =
+        FixedCompilationDatabase::loadFromCommandLine(argumentCount, arguments.data(), fixedError);
+    cl::ParseCommandLineOptions(argumentCount, arguments.data());
+    if (merge)
+    {
+        return runMerge(SourcePaths);
+    }
+    if (deobfuscate)
+    {
+        return runDeobfuscate(SourcePaths);
+    }
+    if (InPlace && !OutputDir.empty())
+    {
+        errs() << "--in-place and --output-dir are mutually exclusive\n";
+        return 1;
+    }
+    ShardSpec shard;
+    if (!Shard.empty())
+    {
+        if (!parseShardSpec(Shard, shard))
+        {
+            errs() << "invalid --shard '" << Shard << "', expected i/N with 0 <= i < N\n";
+            return 1;
+        }
+        //多个分片会各自改写共同包含的头文件，只能由 merge 统一写出
+        if (InPlace || !OutputDir.empty() || !ServeSocket.empty() || !CollectIndexFile.empty())
+        {
+            errs() << "--shard writes no files; pass --export-fixes and --manifest-binary and apply them with merge\n";
+            return 1;
+        }
+    }
+    if (SourcePaths.empty() && BuildPath.empty() && ServeSocket.empty())
+    {
+        errs() << "no input files\n";
+        return 1;
+    }
+    std::unique_ptr<CompilationDatabase> compilations =
+        fixedCompilations ? addExtraArgs(std::move(fixedCompilations)) : findCompilations(errs());
+    std::vector<std::string> files(SourcePaths.begin(), SourcePaths.end());
+    //没有给出源文件时处理编译数据库中的全部文件，适合分片运行；服务模式下源文件由客户端给出
+    if (files.empty() && ServeSocket.empty())
+    {
+        files = compilations->getAllFiles();
+    }
+    if (ServeSocket.empty() && files.empty())
+    {
+        errs() << "no input files\n";
+        return 1;
+    }
+    if (!Shard.empty())
+    {
+        size_t total = files.size();
+        files = selectShard(files, shard);
+        errs() << "shard " << shard.index << "/" << shard.count << ": " << files.size() << " of " << total << " files\n";
+    }
+    if (!TraceFile.empty())
+    {
+        enableTrace(TraceGranularity);
+    }
+    ToolState state;
+    state.compilations = compilations.get();
+    SourceRoots &roots = state.roots;
+    //与文件路径一样规范化，相对路径、.. 和多余的 / 不会让前缀失配
+    for (const std::string &root : SystemRoots)
+    {
+        roots.systemRoots.push_back(getNormalizedAbsolutePath(root));
+    }
+    if (roots.systemRoots.empty())
+    {
+        roots.systemRoots.push_back("/Applications/Xcode.app");
+    }
+    roots.vendorDirs.assign(VendorDirs.begin(), VendorDirs.end());
+
+    if (!ServeSocket.empty())
+    {
+        return serve(state, *compilations);
+    }
+
+    if (!CollectIndexFile.empty())
+    {
+        bool collected = collectSymbolIndex(*compilations, files, Jobs, roots, CollectIndexFile);
+        if (!TraceFile.empty() && !writeTrace(TraceFile, errs()))
+        {
+            return 1;
+        }
+        return collected ? 0 : 1;
+    }
+
+    RunPhases phases;
+    state.setup = loadRenameSetup(phases, errs());
+    if (!state.setup)
+    {
+        return 1;
+    }
+    return obfuscateFiles(state, files, phases, errs(), outs());
+}
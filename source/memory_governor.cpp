@@ -0,0 +1,158 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "memory_governor.hpp"
+#include "atomic_file.hpp"
+#include "run_stats.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using namespace llvm;
+
+//没有任何记录时的预计峰值
+static const uint64_t DefaultEstimate = 256ull << 20;
+
+MemoryGovernor::MemoryGovernor(uint64_t aBudgetBytes)
+: budget(aBudgetBytes)
+{
+}
+
+bool MemoryGovernor::parseByteSize(StringRef text, uint64_t &bytes)
+{
+    text = text.trim();
+    unsigned shift = 0;
+    if (!text.empty())
+    {
+        switch (toLower(text.back()))
+        {
+        case 'k': shift = 10; break;
+        case 'm': shift = 20; break;
+        case 'g': shift = 30; break;
+        case 't': shift = 40; break;
+        default: break;
+        }
+    }
+    if (shift)
+        text = text.drop_back();
+    if (text.getAsInteger(10, bytes) || bytes == 0)
+        return false;
+    //加上单位后超出 64 位的值视为无效，而不是截断成一个很小的预算
+    if (bytes > (UINT64_MAX >> shift))
+        return false;
+    bytes <<= shift;
+    return true;
+}
+
+bool MemoryGovernor::loadProfile(StringRef path, raw_ostream &errs)
+{
+    if (!sys::fs::exists(path))
+        return true;
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+    {
+        errs << "cannot read memory profile " << path << ": " << buffer.getError().message() << "\n";
+        return false;
+    }
+    StringRef content = (*buffer)->getBuffer();
+    while (!content.empty())
+    {
+        StringRef line, bytesText, file;
+        std::tie(line, content) = content.split('\n');
+        std::tie(bytesText, file) = line.split(' ');
+        uint64_t bytes;
+        if (!file.empty() && !bytesText.getAsInteger(10, bytes))
+            profile[file] = bytes;
+    }
+    return true;
+}
+
+bool MemoryGovernor::writeProfile(StringRef path, raw_ostream &errs) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    //按路径排序，便于比较两次运行
+    std::map<StringRef, uint64_t> sorted;
+    for (const auto &entry : profile)
+        sorted.emplace(entry.first(), entry.second);
+    return writeFileAtomically(path, [&](raw_ostream &os) {
+        for (const auto &entry : sorted)
+            os << entry.second << " " << entry.first << "\n";
+    }, errs);
+}
+
+uint64_t MemoryGovernor::estimate(StringRef mainFile) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto recorded = profile.find(mainFile);
+    if (recorded != profile.end())
+        return recorded->second;
+    return largestObserved ? largestObserved : DefaultEstimate;
+}
+
+uint64_t MemoryGovernor::acquire(StringRef mainFile)
+{
+    uint64_t granted = estimate(mainFile);
+    std::unique_lock<std::mutex> lock(mutex);
+    bool waited = false;
+    while (inFlightCount && (inFlightBytes + granted > budget || getCurrentRSS() > budget))
+    {
+        waited = true;
+        released.wait(lock);
+    }
+    waitCount += waited;
+    inFlightBytes += granted;
+    inFlightCount++;
+    return granted;
+}
+
+void MemoryGovernor::release(StringRef mainFile, uint64_t granted, uint64_t peakBytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlightBytes -= granted;
+        inFlightCount--;
+        if (peakBytes)
+        {
+            profile[mainFile] = peakBytes;
+            largestObserved = std::max(largestObserved, peakBytes);
+        }
+    }
+    releaseFreeMemory();
+    released.notify_all();
+}
+
+void releaseFreeMemory()
+{
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+}
@@ -0,0 +1,74 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+// 内存受限模式(--max-memory)的准入控制
+//
+// 每个TU开始解析前按其预计峰值申请额度：进行中TU的预计之和加上新TU超过预算，或进程当前 RSS
+// 已超过预算时，worker 等待其它TU结束。没有TU在进行时总是放行，保证不会卡死。
+// 预计峰值取上次运行记录的该TU的 AST/SourceManager/Preprocessor 占用(--memory-profile)，
+// 没有记录时取本次运行中已完成TU的最大值，再没有则取默认值。
+class MemoryGovernor
+{
+public:
+    explicit MemoryGovernor(uint64_t aBudgetBytes);
+
+    //"4096M"、"48G"、"1073741824" 等
+    static bool parseByteSize(llvm::StringRef text, uint64_t &bytes);
+
+    //每行 "<bytes> <主文件绝对路径>"；文件不存在时视为空
+    bool loadProfile(llvm::StringRef path, llvm::raw_ostream &errs);
+    bool writeProfile(llvm::StringRef path, llvm::raw_ostream &errs) const;
+
+    uint64_t estimate(llvm::StringRef mainFile) const;
+    //阻塞到可以开始解析该TU，返回申请到的额度
+    uint64_t acquire(llvm::StringRef mainFile);
+    //TU 结束，peakBytes 为实测值(0 表示未解析)，同时归还额度
+    void release(llvm::StringRef mainFile, uint64_t granted, uint64_t peakBytes);
+
+    unsigned getWaitCount() const { return waitCount; }
+
+private:
+    uint64_t budget;
+    mutable std::mutex mutex;
+    std::condition_variable released;
+    uint64_t inFlightBytes = 0;
+    unsigned inFlightCount = 0;
+    uint64_t largestObserved = 0;
+    unsigned waitCount = 0;
+    llvm::StringMap<uint64_t> profile;
+};
+
+//把 glibc 等分配器缓存的空闲内存还给系统，TU 结束后调用
+void releaseFreeMemory();
@@ -0,0 +1,143 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "name_generator.hpp"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+
+static const char FirstChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char RestChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+static const uint64_t FirstCount = sizeof(FirstChars) - 1;
+static const uint64_t RestCount = sizeof(RestChars) - 1;
+
+//大写开头、在 ObjC/C 源码中已有含义的名字
+static const char *const BuiltinNames[] = {
+    "BOOL", "Class", "EOF", "FALSE", "I", "IMP", "NO", "NULL", "Nil", "Protocol", "SEL", "TRUE", "YES",
+};
+
+NameGenerator::NameGenerator(StringRef aSeed, unsigned aLength)
+: seed(aSeed.str())
+, length(aLength ? aLength : 1)
+{
+}
+
+bool NameGenerator::loadReservedFile(StringRef path, raw_ostream &errs)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+    {
+        errs << "cannot read reserved names " << path << ": " << buffer.getError().message() << "\n";
+        return false;
+    }
+    //每行一个标识符，# 开头为注释
+    StringRef content = (*buffer)->getBuffer();
+    while (!content.empty())
+    {
+        StringRef line;
+        std::tie(line, content) = content.split('\n');
+        line = line.split('#').first.trim();
+        if (!line.empty())
+            addReserved(line);
+    }
+    return true;
+}
+
+void NameGenerator::generateOnce(StringRef oldName, StringRef prefix, unsigned attempt,
+                                 SmallVectorImpl<char> &out) const
+{
+    out.assign(prefix.begin(), prefix.end());
+    //每个 MD5 块给出 16 个字符，名字更长时按块序号继续生成
+    for (uint32_t block = 0; out.size() < prefix.size() + length; block++)
+    {
+        //各字段带长度，避免 ("ab", "c") 与 ("a", "bc") 得到相同的输入
+        MD5 hash;
+        uint8_t header[16];
+        support::endian::write32le(header, seed.size());
+        support::endian::write32le(header + 4, oldName.size());
+        support::endian::write32le(header + 8, attempt);
+        support::endian::write32le(header + 12, block);
+        hash.update(makeArrayRef(header));
+        hash.update(seed);
+        hash.update(oldName);
+        MD5::MD5Result digest;
+        hash.final(digest);
+        for (uint8_t byte : digest.Bytes)
+        {
+            if (out.size() == prefix.size() + length)
+                break;
+            if (out.size() == prefix.size())
+                out.push_back(FirstChars[byte % (sizeof(FirstChars) - 1)]);
+            else
+                out.push_back(RestChars[byte % (sizeof(RestChars) - 1)]);
+        }
+    }
+}
+
+StringRef NameGenerator::generate(StringRef oldName, StringRef prefix, SmallVectorImpl<char> &out,
+                                  unsigned attempt) const
+{
+    do
+    {
+        generateOnce(oldName, prefix, attempt++, out);
+    } while (isReserved(StringRef(out.data(), out.size())));
+    return StringRef(out.data(), out.size());
+}
+
+ShortNameSequence::ShortNameSequence(const NameGenerator &aGenerator, unsigned aMinLength)
+: generator(aGenerator)
+, length(aMinLength ? aMinLength : 1)
+{
+}
+
+void ShortNameSequence::next(SmallVectorImpl<char> &out)
+{
+    while (true)
+    {
+        //长度为 length 的名字共 26 * 62^(length-1) 个，用完后换更长的
+        uint64_t capacity = FirstCount;
+        for (unsigned i = 1; i < length; i++)
+            capacity *= RestCount;
+        if (index == capacity)
+        {
+            length++;
+            index = 0;
+            continue;
+        }
+        out.resize(length);
+        uint64_t value = index++;
+        for (unsigned i = length; i-- > 1;)
+        {
+            out[i] = RestChars[value % RestCount];
+            value /= RestCount;
+        }
+        out[0] = FirstChars[value];
+        StringRef name(out.data(), out.size());
+        if (!generator.isReserved(name) && llvm::find(BuiltinNames, name) == std::end(BuiltinNames))
+            return;
+    }
+}
@@ -0,0 +1,83 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/raw_ostream.h"
+
+// 无状态的确定性新名生成器
+//
+// 新名 = 前缀 + 由 (项目种子, 旧名, 重试序号) 的带密钥哈希导出的字符，首字符为大写字母，其余为字母数字。
+// 相同的种子和旧名在任意线程、机器和增量重跑中都得到相同的新名，worker 之间无需任何协调。
+// 生成的名字与已知标识符(保留名)冲突时，按重试序号 1, 2, ... 依次重新生成，结果同样确定。
+// 保留名在运行前一次加入，之后只读，可被多个线程同时使用。
+class NameGenerator
+{
+public:
+    NameGenerator(llvm::StringRef aSeed, unsigned aLength);
+    NameGenerator(const NameGenerator &) = delete;
+    NameGenerator &operator=(const NameGenerator &) = delete;
+
+    //已知的标识符：旧名、显式给出的新名、SDK 类名等，生成的名字不会与之相同
+    void addReserved(llvm::StringRef name) { reserved.insert(name); }
+    bool loadReservedFile(llvm::StringRef path, llvm::raw_ostream &errs);
+    bool isReserved(llvm::StringRef name) const { return reserved.count(name) != 0; }
+
+    //生成 prefix + 哈希字符，写入 out 并返回；跳过所有保留名。
+    //attempt 为起始重试序号，全局计划中两个旧名撞到同一新名时用于确定性地错开
+    llvm::StringRef generate(llvm::StringRef oldName, llvm::StringRef prefix,
+                             llvm::SmallVectorImpl<char> &out, unsigned attempt = 0) const;
+
+    unsigned getLength() const { return length; }
+
+private:
+    void generateOnce(llvm::StringRef oldName, llvm::StringRef prefix, unsigned attempt,
+                      llvm::SmallVectorImpl<char> &out) const;
+
+    std::string seed;
+    unsigned length;
+    llvm::StringSet<> reserved;
+};
+
+// 最短名序列：按长度从短到长依次给出合法类名(首字符大写字母，其余为字母数字)，
+// 跳过生成器的保留名(含索引记录的各TU中的宏、typedef、函数、枚举常量、SDK 名字等)和
+// ObjC/C 中有特殊含义的名字(BOOL、YES、Nil 等)。
+// 给出的顺序只取决于 minLength 和保留名，同样是确定的。
+class ShortNameSequence
+{
+public:
+    ShortNameSequence(const NameGenerator &aGenerator, unsigned aMinLength);
+    void next(llvm::SmallVectorImpl<char> &out);
+
+private:
+    const NameGenerator &generator;
+    unsigned length;
+    //当前长度下的序号
+    uint64_t index = 0;
+};
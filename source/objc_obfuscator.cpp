@@ -24,10 +24,129 @@
 // https://github.com/fenglh/ObjcClassNameObfuscator
 #include "objc_obfuscator.hpp"
 
-MatchCallbackHandler::MatchCallbackHandler(Rewriter &aRewriter, CompilerInstance *aCompilerInstance)
+#include <chrono>
+
+#include "clang/Lex/Lexer.h"
+#include "llvm/Support/TimeProfiler.h"
+
+std::string getAbsoluteFilePath(const SourceManager &sm, FileID fileID)
+{
+    const FileEntry *entry = sm.getFileEntryForID(fileID);
+    if (!entry)
+        return "";
+    //同一个头文件在不同TU中可能以不同的相对路径引入
+    SmallString<256> path(entry->getName());
+    sm.getFileManager().makeAbsolutePath(path);
+    sys::path::remove_dots(path, true);
+    return path.str().str();
+}
+
+std::string getNormalizedAbsolutePath(StringRef path)
+{
+    SmallString<256> absolutePath(path);
+    sys::fs::make_absolute(absolutePath);
+    sys::path::remove_dots(absolutePath, true);
+    return absolutePath.str().str();
+}
+
+void restrictTraversalToUserSource(ASTContext &context, SourceClassifier &classifier, HeaderOnceTracker *headerOnce)
+{
+    std::vector<Decl *> userDecls;
+    for (Decl *decl : context.getTranslationUnitDecl()->decls())
+    {
+        if (classifier.isUserExpansionLoc(decl->getBeginLoc()) && !(headerOnce && headerOnce->isCovered(decl)))
+            userDecls.push_back(decl);
+    }
+    context.setTraversalScope(userDecls);
+}
+
+void TUResult::addRename(const SourceManager &sm, SourceLocation loc, unsigned length,
+                         StringRef oldName, StringRef newName, rename_manifest::EntryKind kind)
+{
+    std::pair<FileID, unsigned> decomposed = sm.getDecomposedLoc(loc);
+    //统一成绝对路径才能跨TU合并
+    std::string filePath = getAbsoluteFilePath(sm, decomposed.first);
+    if (filePath.empty())
+        return;
+    edits[filePath].insert(tooling::Replacement(filePath, decomposed.second, length, newName));
+
+    ManifestRecord record;
+    record.kind = kind;
+    record.oldName = oldName.str();
+    record.newName = newName.str();
+    record.file = std::move(filePath);
+    record.line = sm.getLineNumber(decomposed.first, decomposed.second);
+    record.column = sm.getColumnNumber(decomposed.first, decomposed.second);
+    renames.push_back(std::move(record));
+}
+
+IncludeRecorder::IncludeRecorder(const SourceManager &aSourceManager, std::set<std::string> &aFiles)
+: sourceManager(aSourceManager)
+, files(aFiles)
+{
+}
+
+void IncludeRecorder::FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                                  SrcMgr::CharacteristicKind FileType, FileID PrevFID)
+{
+    if (Reason != EnterFile)
+        return;
+    std::string path = getAbsoluteFilePath(sourceManager, sourceManager.getFileID(Loc));
+    if (!path.empty())
+        files.insert(std::move(path));
+}
+
+FunctionBodySkipper::FunctionBodySkipper(const SourceManager &aSourceManager, const LangOptions &aLangOptions,
+                                         const SourceRoots &roots, const LiteralScanner *aScanner)
+: sourceManager(aSourceManager)
+, langOptions(aLangOptions)
+, classifier(aSourceManager, roots)
+, scanner(aScanner)
+{
+}
+
+void FunctionBodySkipper::MacroDefined(const Token &MacroNameTok, const MacroDirective *MD)
+{
+    if (keyMacroDefined || !scanner)
+        return;
+    const MacroInfo *info = MD->getMacroInfo();
+    if (!classifier.isUserLoc(info->getDefinitionLoc()))
+        return;
+    CharSourceRange range = CharSourceRange::getTokenRange(info->getDefinitionLoc(), info->getDefinitionEndLoc());
+    keyMacroDefined = scanner->containsAny(Lexer::getSourceText(range, sourceManager, langOptions));
+}
+
+bool FunctionBodySkipper::shouldSkip(const Decl *decl)
+{
+    SourceLocation loc = sourceManager.getExpansionLoc(decl->getLocation());
+    FileID fileID = sourceManager.getFileID(loc);
+    if (fileID == sourceManager.getMainFileID())
+        return false;
+    if (!classifier.isUserLoc(loc))
+        return true;
+    if (!scanner || keyMacroDefined)
+        return false;
+    auto inserted = keyFreeFiles.try_emplace(fileID, false);
+    if (inserted.second)
+    {
+        bool invalid = false;
+        StringRef text = sourceManager.getBufferData(fileID, &invalid);
+        inserted.first->second = !invalid && !scanner->containsAny(text);
+    }
+    return inserted.first->second;
+}
+
+MatchCallbackHandler::MatchCallbackHandler(Rewriter &aRewriter, CompilerInstance *aCompilerInstance, const ObfConfig &aConfig, TUResult &aResult)
 : rewriter(aRewriter)
 , compilerInstance(aCompilerInstance)
+, config(aConfig)
+, result(aResult)
+, verboseLog(aResult.log)
+, stats(aConfig.collectStats ? &aResult.stats : nullptr)
+, classifier(aCompilerInstance->getSourceManager(), aConfig.roots)
 {
+    if (aConfig.headerRegistry)
+        headerOnce = std::make_unique<HeaderOnceTracker>(*aConfig.headerRegistry, *aCompilerInstance);
 }
 
 
@@ -45,7 +164,22 @@ void MatchCallbackHandler::run(const MatchFinder::MatchResult &Result)
     const ExplicitCastExpr *explicitCastExpr        = Result.Nodes.getNodeAs<ExplicitCastExpr>("explicitCastExpr");
     const clang::StringLiteral *stringLiteral       = Result.Nodes.getNodeAs<clang::StringLiteral>("stringLiteral");
     const TypedefDecl *typedefDecl                  = Result.Nodes.getNodeAs<TypedefDecl>("typedefDecl");
-    
+    if (stats)
+    {
+        //每次回调只绑定一个节点
+        if (interfaceDecl) countMatch(HK_Interface);
+        if (implDecl) countMatch(HK_Implementation);
+        if (categoryDecl) countMatch(HK_Category);
+        if (categoryImplDecl) countMatch(HK_CategoryImpl);
+        if (explicitCastExpr) countMatch(HK_Cast);
+        if (varDecl) countMatch(HK_Var);
+        if (objcIvarDecl) countMatch(HK_Ivar);
+        if (objcPropertyDecl) countMatch(HK_Property);
+        if (methodDecl) countMatch(HK_Method);
+        if (messageExpr) countMatch(HK_Message);
+        if (stringLiteral) countMatch(HK_Literal);
+        if (typedefDecl) countMatch(HK_Typedef);
+    }
 
     if (isUserSourceDecl(interfaceDecl)) handleInterfaceDecl(interfaceDecl);
     if (isUserSourceDecl(implDecl)) handleImplementationDecl(implDecl);
@@ -57,136 +191,233 @@ void MatchCallbackHandler::run(const MatchFinder::MatchResult &Result)
     if (isUserSourceDecl(objcPropertyDecl)) handleObjcPropertyDecl(objcPropertyDecl);
     if (isUserSourceDecl(methodDecl)) handleMethodDecl(methodDecl);
     if (isUserSourceDecl(messageExpr)) handleMessageExpr(messageExpr);
-    if (stringLiteral) handleStringLiteral(stringLiteral);
+    if (isUserSourceDecl(stringLiteral)) handleStringLiteral(stringLiteral);
     if (isUserSourceDecl(typedefDecl)) handleTypedefDecl(typedefDecl);
 }
 
-void MatchCallbackHandler::ReplaceText(SourceLocation Start, unsigned OrigLength, StringRef NewStr)
+void MatchCallbackHandler::ReplaceText(SourceLocation Start, unsigned OrigLength, StringRef NewStr,
+                                       rename_manifest::EntryKind kind, StringRef oldName)
 {
-    if (compilerInstance->getSourceManager().isMacroBodyExpansion(Start))
+    auto start = std::chrono::steady_clock::now();
+    SourceManager &sm = compilerInstance->getSourceManager();
+    SourceLocation nodeLoc = Start;
+    if (sm.isMacroBodyExpansion(Start))
+    {
+    Start = sm.getSpellingLoc(Start);
+    }
+    //Rewriter 无法改写的位置(非文件位置)同样不记录
+    if (!rewriter.ReplaceText(Start, OrigLength, NewStr))
     {
-    Start = compilerInstance->getSourceManager().getSpellingLoc(Start);
+        size_t renameCount = result.renames.size();
+        result.addRename(sm, Start, OrigLength, oldName, NewStr, kind);
+        //同时按节点所在的头文件记录，供后续TU复用
+        if (headerOnce && result.renames.size() > renameCount)
+        {
+            const ManifestRecord &record = result.renames.back();
+            headerOnce->record(nodeLoc, tooling::Replacement(record.file, sm.getDecomposedLoc(Start).second,
+                                                             OrigLength, NewStr), record);
+        }
     }
-    rewriter.ReplaceText(Start, OrigLength, NewStr);
+    result.rewriteSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 }
 
 //需要混淆的类名
-bool MatchCallbackHandler::isNeedObfuscateClassName(string name)
+bool MatchCallbackHandler::isNeedObfuscateClassName(const IdentifierInfo *identifier)
+{
+    return !getNewClassName(identifier).empty();
+}
+
+StringRef MatchCallbackHandler::getNewClassName(const IdentifierInfo *identifier)
 {
-    return name == "DemoViewController";
+    if (!identifier || !config.renameMap)
+        return StringRef();
+    auto cached = newNameCache.find(identifier);
+    if (cached != newNameCache.end())
+        return cached->second;
+
+    SmallString<64> scratch;
+    StringRef newName = config.renameMap->lookup(identifier->getName(), scratch);
+    //前缀/通配规则的结果在 scratch 里，需要拷贝出来
+    if (newName.data() == scratch.data())
+        newName = newNameSaver.save(newName);
+    newNameCache[identifier] = newName;
+    return newName;
 }
 
-string MatchCallbackHandler::getNewClassName(string oldName)
+StringRef MatchCallbackHandler::getNewClassName(StringRef oldName)
 {
-    return "NewViewController";
+    //字符串中的类名优先走 IdentifierInfo 缓存；本TU中未出现过的标识符直接查表
+    IdentifierTable &identifiers = compilerInstance->getPreprocessor().getIdentifierTable();
+    IdentifierTable::iterator it = identifiers.find(oldName);
+    if (it != identifiers.end())
+        return getNewClassName(it->getValue());
+    if (!config.renameMap)
+        return StringRef();
+    SmallString<64> scratch;
+    StringRef newName = config.renameMap->lookup(oldName, scratch);
+    if (newName.data() == scratch.data())
+        newName = newNameSaver.save(newName);
+    return newName;
 }
 
 void MatchCallbackHandler::handleInterfaceDecl(const ObjCInterfaceDecl* interfaceDecl)
 {
-    string oldClassName = interfaceDecl->getNameAsString();
-    if (isNeedObfuscateClassName(oldClassName)) {
-        string newClassName = getNewClassName(oldClassName);
+    StatsTimer timer(stats, HK_Interface);
+    StringRef newClassName = getNewClassName(interfaceDecl->getIdentifier());
+    if (!newClassName.empty()) {
+        StringRef oldClassName = interfaceDecl->getName();
         SourceLocation loc = interfaceDecl->getLocation();
-        ReplaceText(loc, oldClassName.length(), getNewClassName(oldClassName));
-        cout << "cls:" << oldClassName << "->:" << newClassName << endl;
+        ReplaceText(loc, oldClassName.size(), newClassName, rename_manifest::EK_Interface, oldClassName);
+        if (config.verbose)
+            verboseLog << "cls:" << oldClassName << "->:" << newClassName << "\n";
     }
 }
 
 void MatchCallbackHandler::handleImplementationDecl(const ObjCImplementationDecl* objcImplementationDecl)
 {
-    string oldClassName = objcImplementationDecl->getNameAsString();
-    if (isNeedObfuscateClassName(oldClassName)) {
-        string newClassName = getNewClassName(oldClassName);
+    StatsTimer timer(stats, HK_Implementation);
+    StringRef newClassName = getNewClassName(objcImplementationDecl->getIdentifier());
+    if (!newClassName.empty()) {
+        StringRef oldClassName = objcImplementationDecl->getName();
         SourceLocation loc = objcImplementationDecl->getLocation();
-        ReplaceText(loc, oldClassName.length(), getNewClassName(oldClassName));
-        cout << fileNameOfNode(objcImplementationDecl) << ":cls:" << oldClassName << "->:" << newClassName << endl;
+        ReplaceText(loc, oldClassName.size(), newClassName, rename_manifest::EK_Implementation, oldClassName);
+        if (config.verbose)
+            verboseLog << fileNameOfNode(objcImplementationDecl) << ":cls:" << oldClassName << "->:" << newClassName << "\n";
     }
 }
 
 void MatchCallbackHandler::handleCategoryDecl(const ObjCCategoryDecl* objcCategoryDecl)
 {
-    string oldClassName = objcCategoryDecl->getClassInterface()->getNameAsString();
-
-    if (isNeedObfuscateClassName(oldClassName)) {
-        string newClassName = getNewClassName(oldClassName);
+    StatsTimer timer(stats, HK_Category);
+    const ObjCInterfaceDecl *interfaceDecl = objcCategoryDecl->getClassInterface();
+    if (!interfaceDecl)
+        return;
+    StringRef newClassName = getNewClassName(interfaceDecl->getIdentifier());
+    if (!newClassName.empty()) {
+        StringRef oldClassName = interfaceDecl->getName();
         SourceLocation loc = objcCategoryDecl->getLocation();
-        ReplaceText(loc, oldClassName.length(), getNewClassName(oldClassName));
-        cout << fileNameOfNode(objcCategoryDecl) << ":Category:" << oldClassName << "->" << newClassName << endl;
+        ReplaceText(loc, oldClassName.size(), newClassName, rename_manifest::EK_Category, oldClassName);
+        if (config.verbose)
+            verboseLog << fileNameOfNode(objcCategoryDecl) << ":Category:" << oldClassName << "->" << newClassName << "\n";
     }
 }
 
 //处理分类定义
 void MatchCallbackHandler::handleCategoryImplDecl(const ObjCCategoryImplDecl* objcCategoryImplDecl) 
 {
-    string oldClassName = objcCategoryImplDecl->getNameAsString();
-    if (isNeedObfuscateClassName(oldClassName)) 
+    StatsTimer timer(stats, HK_CategoryImpl);
+    //getName() 是分类名，getLocation() 才是类名的位置，所以要按所属类查表
+    const ObjCInterfaceDecl *interfaceDecl = objcCategoryImplDecl->getClassInterface();
+    if (!interfaceDecl)
+        return;
+    StringRef newClassName = getNewClassName(interfaceDecl->getIdentifier());
+    if (!newClassName.empty()) 
     {
-        string newClassName = getNewClassName(oldClassName);
+        StringRef oldClassName = interfaceDecl->getName();
         SourceLocation loc = objcCategoryImplDecl->getLocation();
-        ReplaceText(loc, oldClassName.length(), getNewClassName(oldClassName));
-        cout << fileNameOfNode(objcCategoryImplDecl) << ":CategoryImpl:" << oldClassName << "->" << newClassName << endl;
+        ReplaceText(loc, oldClassName.size(), newClassName, rename_manifest::EK_CategoryImpl, oldClassName);
+        if (config.verbose)
+            verboseLog << fileNameOfNode(objcCategoryImplDecl) << ":CategoryImpl:" << oldClassName << "->" << newClassName << "\n";
     }
 }
 
 void MatchCallbackHandler::handleMessageExpr(const ObjCMessageExpr* messageExpr)
 {
-    if (messageExpr->isClassMessage()) 
-    { //是类方法
+    StatsTimer timer(stats, HK_Message);
+    //isClassMessage() 对 [super foo] 这类 SuperClass 接收者同样为真，此时没有 TypeSourceInfo
+    if (messageExpr->getReceiverKind() != ObjCMessageExpr::Class)
+        return;
+    //接收者可能是 typedef 或宏展开，统一走 TypeLoc 并核对原始 token，避免按类名长度误写
+    if (!handleTypeLoc(messageExpr->getClassReceiverTypeInfo()->getTypeLoc(), rename_manifest::EK_Message))
+        return;
+    if (config.verbose)
+    {
         const ObjCInterfaceDecl* objcInterfaceDecl = messageExpr->getReceiverInterface();
-        if (isUserSourceDecl(objcInterfaceDecl)) 
-        {
-            string oldClassName = objcInterfaceDecl->getNameAsString();
-            if (isNeedObfuscateClassName(oldClassName)) 
-            {
-                string newClassName = getNewClassName(oldClassName);
-                SourceLocation loc = messageExpr->getClassReceiverTypeInfo()->getTypeLoc().getBeginLoc();
-                ReplaceText(loc, oldClassName.length(), newClassName);
-                cout << "messageExpr:" << "[" << oldClassName << " " 
-                    << messageExpr->getSelector().getAsString() 
-                    << "]" "->" << "[" << newClassName << " " 
-                    << messageExpr->getSelector().getAsString() << "]" << endl;
-            }
-        }
+        StringRef oldClassName = objcInterfaceDecl->getName();
+        StringRef newClassName = getNewClassName(objcInterfaceDecl->getIdentifier());
+        verboseLog << "messageExpr:" << "[" << oldClassName << " " 
+            << messageExpr->getSelector().getAsString() 
+            << "]" "->" << "[" << newClassName << " " 
+            << messageExpr->getSelector().getAsString() << "]" << "\n";
     }
 }
 
  void MatchCallbackHandler::handleExplicitCastExpr(const ExplicitCastExpr* explicitCastExpr) 
  {
+     StatsTimer timer(stats, HK_Cast);
      //        explicitCastExpr->getd
      QualType qualType = explicitCastExpr->getTypeAsWritten();
-     SourceLocation typeBeginLoc = explicitCastExpr->getTypeInfoAsWritten()->getTypeLoc().getBeginLoc();
-     SourceLocation typeEndLoc = explicitCastExpr->getTypeInfoAsWritten()->getTypeLoc().getEndLoc();
-     //宏替换后，是否会处理多余的空格?
-     bool success = recursiveHandleQualType(typeBeginLoc, typeEndLoc, qualType);
-     if (success) 
+     bool success = handleTypeLoc(explicitCastExpr->getTypeInfoAsWritten()->getTypeLoc(), rename_manifest::EK_Cast);
+     if (success && config.verbose) 
      {
          string rewriteString = rewriter.getRewrittenText(SourceRange(explicitCastExpr->getBeginLoc(), explicitCastExpr->getExprLoc()));
-         cout << "Explicit:" << qualType.getAsString() << "->" << rewriteString << endl;
+         verboseLog << "Explicit:" << qualType.getAsString() << "->" << rewriteString << "\n";
      }
  }
 
 void MatchCallbackHandler::handleStringLiteral(const clang::StringLiteral* stringLiteral)
 {
+     StatsTimer timer(stats, HK_Literal);
+     //getString() 只支持单字节字符串
+     if (stringLiteral->getCharByteWidth() != 1)
+     {
+         return;
+     }
      clang::StringRef content = stringLiteral->getString();
-     std::string contentString = content.str();
-     if (isNeedObfuscateClassName(contentString)) 
+     if (config.literalPolicy == LiteralPolicy::Exact)
      {
-         SourceLocation loc = stringLiteral->getBeginLoc();
-         string newClassName = getNewClassName(contentString);
-         ReplaceText(loc.getLocWithOffset(-1), contentString.length() + 2, newClassName);
-         cout << "StringLiteral:" << contentString << " ->" << newClassName << endl;
+         StringRef newClassName = getNewClassName(content);
+         if (!newClassName.empty())
+             replaceInLiteral(stringLiteral, 0, content.size(), content, newClassName);
+         return;
+     }
+     //delimited 逐个单词查表；只有 substring 需要自动机
+     SmallVector<LiteralScanner::Candidate, 4> candidates;
+     if (config.literalPolicy == LiteralPolicy::Delimited || !config.literalScanner)
+         LiteralScanner::splitWords(content, candidates);
+     else
+         config.literalScanner->scan(content, config.literalPolicy, candidates);
+     for (const LiteralScanner::Candidate &candidate : candidates)
+     {
+         StringRef oldClassName = content.substr(candidate.offset, candidate.length);
+         StringRef newClassName = getNewClassName(oldClassName);
+         if (!newClassName.empty())
+             replaceInLiteral(stringLiteral, candidate.offset, candidate.length, oldClassName, newClassName);
      }
  }
 
+void MatchCallbackHandler::replaceInLiteral(const clang::StringLiteral* stringLiteral, size_t offset, size_t length,
+                                            StringRef oldName, StringRef newName)
+{
+     //只改写引号内的内容；字节位置经过 Lexer 换算，字面量前面有转义字符或由多段拼接时同样准确
+     if (length == 0)
+         return;
+     const SourceManager &sm = compilerInstance->getSourceManager();
+     const LangOptions &langOpts = compilerInstance->getLangOpts();
+     const TargetInfo &target = compilerInstance->getTarget();
+     SourceLocation begin = stringLiteral->getLocationOfByte(offset, sm, langOpts, target);
+     SourceLocation last = stringLiteral->getLocationOfByte(offset + length - 1, sm, langOpts, target);
+     //类名跨越了拼接的两段或自身含有转义时源码中不是连续的原文，不改写
+     if (begin.isInvalid() || begin.getLocWithOffset(length - 1) != last)
+         return;
+     ReplaceText(begin, length, newName, rename_manifest::EK_Literal, oldName);
+     if (config.verbose)
+         verboseLog << "StringLiteral:" << stringLiteral->getString() << ":" << oldName << " ->" << newName << "\n";
+}
+
  void MatchCallbackHandler::handleTypedefDecl(const TypedefDecl* typedefDecl)
  {
+     StatsTimer timer(stats, HK_Typedef);
      //underlyingType
-     QualType type = typedefDecl->getUnderlyingType();
-     recursiveHandleQualType(typedefDecl->getBeginLoc(), typedefDecl->getEndLoc(), type);
+     if (TypeSourceInfo *typeSourceInfo = typedefDecl->getTypeSourceInfo())
+     {
+         handleTypeLoc(typeSourceInfo->getTypeLoc(), rename_manifest::EK_Typedef);
+     }
  }
 
  void MatchCallbackHandler::handleVarDecl(const VarDecl* varDecl) 
  {
+     StatsTimer timer(stats, HK_Var);
      ////隐式实现的，并非在显示的写源码中则不作处理。例如：编译器会实现 property 的实例变量
      if (varDecl->isImplicit())
      {
@@ -205,19 +436,18 @@ void MatchCallbackHandler::handleStringLiteral(const clang::StringLiteral* strin
      {
          return;
      }
-     SourceLocation typeBeginLoc = typeSourceInfo->getTypeLoc().getBeginLoc();
-     SourceLocation typeEndLoc = typeSourceInfo->getTypeLoc().getEndLoc();
-     bool success = recursiveHandleQualType(typeBeginLoc, typeEndLoc, qualType);
-     if (success) 
+     bool success = handleTypeLoc(typeSourceInfo->getTypeLoc(), rename_manifest::EK_Var);
+     if (success && config.verbose) 
      {
          SourceLocation beginLoc = compilerInstance->getSourceManager().getSpellingLoc(varDecl->getBeginLoc());
          SourceLocation endLoc = compilerInstance->getSourceManager().getSpellingLoc(varDecl->getEndLoc());
          string rewriteString = rewriter.getRewrittenText(SourceRange(beginLoc, endLoc));
-         cout << "VarDecl:" << qualType.getAsString() << " " << varDecl->getNameAsString() << "->" << rewriteString << endl;
+         verboseLog << "VarDecl:" << qualType.getAsString() << " " << varDecl->getNameAsString() << "->" << rewriteString << "\n";
      }
  }
  void MatchCallbackHandler::handleObjcIVarDecl(const ObjCIvarDecl* objcIvarDecl) 
  {
+     StatsTimer timer(stats, HK_Ivar);
      ////隐式实现的，并非在显示的写源码中则不作处理。例如：编译器会实现 property 的实例变量
      if (objcIvarDecl->isImplicit()) 
      {
@@ -235,38 +465,36 @@ void MatchCallbackHandler::handleStringLiteral(const clang::StringLiteral* strin
      {
          return;
      }
-     SourceLocation typeBeginLoc = typeSourceInfo->getTypeLoc().getBeginLoc();
-     SourceLocation typeEndLoc = typeSourceInfo->getTypeLoc().getEndLoc();
-     bool success = recursiveHandleQualType(typeBeginLoc, typeEndLoc, qualType);
-     if (success) 
+     bool success = handleTypeLoc(typeSourceInfo->getTypeLoc(), rename_manifest::EK_Ivar);
+     if (success && config.verbose) 
      {
          SourceLocation beginLoc = compilerInstance->getSourceManager().getSpellingLoc(objcIvarDecl->getBeginLoc());
          SourceLocation endLoc = compilerInstance->getSourceManager().getSpellingLoc(objcIvarDecl->getEndLoc());
          string rewriteString = rewriter.getRewrittenText(SourceRange(beginLoc, endLoc));
-         cout << "ObjcIVar:" << qualType.getAsString() << " " << objcIvarDecl->getNameAsString() << "->" << rewriteString << endl;
+         verboseLog << "ObjcIVar:" << qualType.getAsString() << " " << objcIvarDecl->getNameAsString() << "->" << rewriteString << "\n";
      }
  }
 
  void MatchCallbackHandler::handleObjcPropertyDecl(const ObjCPropertyDecl* objcPropertyDecl)
  {
+     StatsTimer timer(stats, HK_Property);
 
      QualType qualType = objcPropertyDecl->getType();
      TypeSourceInfo* typeSourceInfo = objcPropertyDecl->getTypeSourceInfo();
      if (!typeSourceInfo) {
          return;
      }
-     SourceLocation typeBeginLoc = typeSourceInfo->getTypeLoc().getBeginLoc();
-     SourceLocation typeEndLoc = typeSourceInfo->getTypeLoc().getEndLoc();
-     bool success = recursiveHandleQualType(typeBeginLoc, typeEndLoc, qualType);
-     if (success) {
+     bool success = handleTypeLoc(typeSourceInfo->getTypeLoc(), rename_manifest::EK_Property);
+     if (success && config.verbose) {
          SourceLocation beginLoc = compilerInstance->getSourceManager().getSpellingLoc(objcPropertyDecl->getBeginLoc());
          SourceLocation endLoc = compilerInstance->getSourceManager().getSpellingLoc(objcPropertyDecl->getEndLoc());
          string rewriteString = rewriter.getRewrittenText(SourceRange(beginLoc, endLoc));
-         cout << "ObjcProperty:" << qualType.getAsString() << " " << objcPropertyDecl->getNameAsString() << "->" << rewriteString << endl;
+         verboseLog << "ObjcProperty:" << qualType.getAsString() << " " << objcPropertyDecl->getNameAsString() << "->" << rewriteString << "\n";
      }
  }
  void MatchCallbackHandler::handleMethodDecl(const ObjCMethodDecl* methodDecl) 
  {
+     StatsTimer timer(stats, HK_Method);
      if (methodDecl->isImplicit()) {
          return;
      }
@@ -278,76 +506,108 @@ void MatchCallbackHandler::handleStringLiteral(const clang::StringLiteral* strin
      if (!typeSourceInfo) {
         return;
      }
-     SourceLocation typeBeginLoc = typeSourceInfo->getTypeLoc().getBeginLoc();
-     SourceLocation typeEndLoc = typeSourceInfo->getTypeLoc().getEndLoc();
-     bool handleReturnTypeSuccess = recursiveHandleQualType(typeBeginLoc, typeEndLoc, qualType);
+     bool handleReturnTypeSuccess = handleTypeLoc(typeSourceInfo->getTypeLoc(), rename_manifest::EK_Method);
      ArrayRef<ParmVarDecl*> params = methodDecl->parameters();
      bool handleParamersTypeSuccess = false;
      for (ArrayRef< ParmVarDecl* >::iterator i = params.begin(), e = params.end(); i != e; i++) 
      {
         ParmVarDecl* p = *i;
-        QualType type = p->getType();
-        handleParamersTypeSuccess = handleParamersTypeSuccess || recursiveHandleQualType(p->getBeginLoc(), p->getEndLoc(), type);
+        TypeSourceInfo* paramTypeSourceInfo = p->getTypeSourceInfo();
+        //每个参数都要处理，不能因为前面已经成功而短路
+        if (paramTypeSourceInfo && handleTypeLoc(paramTypeSourceInfo->getTypeLoc(), rename_manifest::EK_Method))
+        {
+            handleParamersTypeSuccess = true;
+        }
      }
 
-     if (handleReturnTypeSuccess || handleParamersTypeSuccess) 
+     if ((handleReturnTypeSuccess || handleParamersTypeSuccess) && config.verbose) 
      {
          auto range = SourceRange(methodDecl->getBeginLoc(), methodDecl->getDeclaratorEndLoc().getLocWithOffset(-1));
          string rewriteString = rewriter.getRewrittenText(range);
-         cout << "Method:" << getMethodDeclStringOfMethoddecl(methodDecl) << "->" << rewriteString << endl;
+         verboseLog << "Method:" << getMethodDeclStringOfMethoddecl(methodDecl) << "->" << rewriteString << "\n";
      }
  }
 
- bool MatchCallbackHandler::recursiveHandleQualType(SourceLocation start, SourceLocation end, QualType type)
+ bool MatchCallbackHandler::handleTypeLoc(TypeLoc typeLoc, rename_manifest::EntryKind kind)
  {
-     if (start.isInvalid() || end.isInvalid())
-     {
-         return  false;
-     }
+     //只统计最外层，嵌套的泛型参数计在其中
+     StatsTimer timer(stats ? &stats->typeLocCalls : nullptr, stats ? &stats->typeLocSeconds : nullptr);
+     return handleNestedTypeLoc(typeLoc, kind);
+ }
 
+ bool MatchCallbackHandler::handleNestedTypeLoc(TypeLoc typeLoc, rename_manifest::EntryKind kind)
+ {
+     //沿 TypeLoc 直接取得每个类名的位置，不复制、不搜索源码文本
      bool success = false;
-     SourceLocation slideLoc = start;
-     if (isa<ObjCObjectPointerType>(type)) 
+     while (!typeLoc.isNull())
      {
-         const ObjCObjectPointerType* pointerType = type->getAs<ObjCObjectPointerType>();
-         const ObjCInterfaceDecl* IDecl = pointerType->getInterfaceDecl();
-         if (isUserSourceDecl(IDecl) && isNeedObfuscateClassName(IDecl->getNameAsString())) 
+         typeLoc = typeLoc.getUnqualifiedLoc();
+         if (auto attributedLoc = typeLoc.getAs<AttributedTypeLoc>())
          {
-             string oldClassName = IDecl->getNameAsString();
-             string newClassName = getNewClassName(oldClassName);
-             const char* startBuffer = compilerInstance->getSourceManager().getCharacterData(slideLoc);
-             const char* endBuffer = compilerInstance->getSourceManager().getCharacterData(end);
-             int offset = endBuffer - startBuffer;
-             string originTypeDefineStr(startBuffer, offset);
-
-             int index = originTypeDefineStr.find(oldClassName, 0);
-
-             slideLoc = slideLoc.getLocWithOffset(index);
-             ReplaceText(slideLoc, oldClassName.length(), newClassName);
-             slideLoc = slideLoc.getLocWithOffset(index + oldClassName.length());
-             success = true;
+             typeLoc = attributedLoc.getModifiedLoc();
          }
-
-         if (pointerType->isSpecialized()) 
+         else if (auto parenLoc = typeLoc.getAs<ParenTypeLoc>())
+         {
+             typeLoc = parenLoc.getInnerLoc();
+         }
+         else if (auto objcPointerLoc = typeLoc.getAs<ObjCObjectPointerTypeLoc>())
+         {
+             typeLoc = objcPointerLoc.getPointeeLoc();
+         }
+         else if (auto pointerLoc = typeLoc.getAs<PointerTypeLoc>())
+         {
+             //Foo **
+             typeLoc = pointerLoc.getPointeeLoc();
+         }
+         else if (auto interfaceLoc = typeLoc.getAs<ObjCInterfaceTypeLoc>())
+         {
+             //ObjCInterfaceTypeLoc 也是 ObjCObjectTypeLoc，必须先判断
+             return handleInterfaceTypeLoc(interfaceLoc, kind) || success;
+         }
+         else if (auto objectLoc = typeLoc.getAs<ObjCObjectTypeLoc>())
          {
-             const ArrayRef< QualType > params = pointerType->getTypeArgs();
-             unsigned index = 0;
-             for (ArrayRef< QualType >::iterator i = params.begin(), e = params.end(); i != e; i++, index++) 
+             //泛型参数可以嵌套，如 NSDictionary<NSString *, NSArray<Foo *> *> *
+             for (unsigned i = 0, e = objectLoc.getNumTypeArgs(); i != e; i++)
              {
-                 QualType t = *i;
-                 success = recursiveHandleQualType(slideLoc, end, t) || success;
+                 if (TypeSourceInfo *typeArgInfo = objectLoc.getTypeArgTInfo(i))
+                     success = handleNestedTypeLoc(typeArgInfo->getTypeLoc(), kind) || success;
              }
+             typeLoc = objectLoc.getBaseLoc();
+         }
+         else
+         {
+             break;
          }
      }
-     else if (isa<ObjCObjectType>(type)) 
+     return success;
+ }
+
+ bool MatchCallbackHandler::handleInterfaceTypeLoc(ObjCInterfaceTypeLoc interfaceLoc, rename_manifest::EntryKind kind)
+ {
+     const ObjCInterfaceDecl *IDecl = interfaceLoc.getIFaceDecl();
+     if (!isUserSourceDecl(IDecl))
      {
+         return false;
      }
-     else if (isa<AttributedType>(type)) 
+     StringRef newClassName = getNewClassName(IDecl->getIdentifier());
+     if (newClassName.empty())
      {
-         const AttributedType* attributedType = type->getAs<AttributedType>();
-         success = recursiveHandleQualType(slideLoc, end, attributedType->getModifiedType());
+         return false;
      }
-     return success;
+     //@compatibility_alias 等情况下该位置写的不是类名本身，按原始 token 核对
+     StringRef oldClassName = IDecl->getName();
+     SourceManager &sm = compilerInstance->getSourceManager();
+     SourceLocation nameLoc = interfaceLoc.getNameLoc();
+     SourceLocation spellingLoc = sm.getSpellingLoc(nameLoc);
+     bool invalid = false;
+     const char *spelling = sm.getCharacterData(spellingLoc, &invalid);
+     if (invalid || Lexer::MeasureTokenLength(spellingLoc, sm, compilerInstance->getLangOpts()) != oldClassName.size() ||
+         StringRef(spelling, oldClassName.size()) != oldClassName)
+     {
+         return false;
+     }
+     ReplaceText(nameLoc, oldClassName.size(), newClassName, kind, oldClassName);
+     return true;
  }
 
  string MatchCallbackHandler::getMethodDeclStringOfMethoddecl(const ObjCMethodDecl* methodDecl) 
@@ -416,24 +676,186 @@ void MatchCallbackHandler::handleStringLiteral(const clang::StringLiteral* strin
  }
 
 // action
+ObfASTFrontendAction::ObfASTFrontendAction(const ObfConfig &aConfig, TUResult &aResult)
+: config(aConfig)
+, result(aResult)
+{
+}
+
+bool ObfASTFrontendAction::BeginSourceFileAction(CompilerInstance &CI)
+{
+    CI.getPreprocessor().addPPCallbacks(std::make_unique<IncludeRecorder>(CI.getSourceManager(), result.includedFiles));
+    return true;
+}
+
 //创建AST Consumer
 std::unique_ptr<ASTConsumer> ObfASTFrontendAction::CreateASTConsumer(clang::CompilerInstance &CI, StringRef file)
 {
-    size_t index = file.str().find_last_of("/");
-    StringRef fileName = file.str().substr(index + 1, -1); //获取文件名，截取'/'后面的部分
-    cout << "deal with file:" << fileName.str() << endl;
+    if (config.verbose)
+    {
+        //获取文件名，截取'/'后面的部分
+        raw_string_ostream(result.log) << "deal with file:" << sys::path::filename(file) << "\n";
+    }
 
+    result.mainFile = getAbsoluteFilePath(CI.getSourceManager(), CI.getSourceManager().getMainFileID());
     rewriter.setSourceMgr(CI.getSourceManager(), CI.getLangOpts());
-    return std::make_unique<ObfASTConsumer>(rewriter, &CI);
+    auto consumer = std::make_unique<ObfASTConsumer>(rewriter, &CI, config, result);
+    if (config.skipFunctionBodies)
+    {
+        //ParseAST 按 FrontendOpts 决定是否询问 consumer
+        CI.getFrontendOpts().SkipFunctionBodies = true;
+        auto skipper = std::make_unique<FunctionBodySkipper>(CI.getSourceManager(), CI.getLangOpts(), config.roots,
+                                                             config.literalScanner);
+        consumer->setBodySkipper(skipper.get());
+        CI.getPreprocessor().addPPCallbacks(std::move(skipper));
+    }
+    if (HeaderOnceTracker *headerOnce = consumer->getHeaderOnce())
+    {
+        auto recorder = std::make_unique<HeaderDirectiveRecorder>(CI.getSourceManager());
+        headerOnce->setDirectiveRecorder(recorder.get());
+        CI.getPreprocessor().addPPCallbacks(std::move(recorder));
+    }
+    return consumer;
 }
 
 void ObfASTFrontendAction::EndSourceFileAction()
 {
+    result.hasErrors = getCompilerInstance().getDiagnostics().hasErrorOccurred();
+}
+
+ObfFrontendActionFactory::ObfFrontendActionFactory(const ObfConfig &aConfig, TUResult &aResult)
+: config(aConfig)
+, result(aResult)
+{
+}
+
+std::unique_ptr<FrontendAction> ObfFrontendActionFactory::create()
+{
+    return std::make_unique<ObfASTFrontendAction>(config, result);
+}
+
+bool ObfFrontendActionFactory::runInvocation(std::shared_ptr<CompilerInvocation> Invocation, FileManager *Files,
+                                             std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                                             DiagnosticConsumer *DiagConsumer)
+{
+    auto start = std::chrono::steady_clock::now();
+    //持有到解析结束，preamble 在此期间被替换也不会删除它的 PCH
+    std::shared_ptr<const PreambleCache::Entry> preamble;
+    if (config.preambleCache)
+    {
+        preamble = config.preambleCache->apply(*Invocation, *Files, PCHContainerOps);
+        //preamble 中的头文件不会再经过预处理，依赖关系从构建 preamble 时的记录补上
+        if (preamble)
+            result.includedFiles.insert(preamble->files.begin(), preamble->files.end());
+    }
+    bool success = FrontendActionFactory::runInvocation(Invocation, Files, PCHContainerOps, DiagConsumer);
+    result.totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return success;
+}
+
+ObfASTVisitor::ObfASTVisitor(MatchCallbackHandler &aHandler)
+: handler(aHandler)
+{
+}
+
+bool ObfASTVisitor::VisitObjCInterfaceDecl(ObjCInterfaceDecl *interfaceDecl)
+{
+    handler.countMatch(HK_Interface);
+    if (handler.isUserSourceDecl(interfaceDecl)) handler.handleInterfaceDecl(interfaceDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitObjCImplementationDecl(ObjCImplementationDecl *implDecl)
+{
+    handler.countMatch(HK_Implementation);
+    if (handler.isUserSourceDecl(implDecl)) handler.handleImplementationDecl(implDecl);
+    return true;
 }
 
-ObfASTConsumer::ObfASTConsumer(Rewriter& aRewriter, CompilerInstance* aCI)
-    :handlerMatchCallback(aRewriter, aCI)
+bool ObfASTVisitor::VisitObjCCategoryDecl(ObjCCategoryDecl *categoryDecl)
 {
+    handler.countMatch(HK_Category);
+    if (handler.isUserSourceDecl(categoryDecl)) handler.handleCategoryDecl(categoryDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitObjCCategoryImplDecl(ObjCCategoryImplDecl *categoryImplDecl)
+{
+    handler.countMatch(HK_CategoryImpl);
+    if (handler.isUserSourceDecl(categoryImplDecl)) handler.handleCategoryImplDecl(categoryImplDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitObjCMethodDecl(ObjCMethodDecl *methodDecl)
+{
+    handler.countMatch(HK_Method);
+    if (handler.isUserSourceDecl(methodDecl)) handler.handleMethodDecl(methodDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitVarDecl(VarDecl *varDecl)
+{
+    handler.countMatch(HK_Var);
+    if (handler.isUserSourceDecl(varDecl)) handler.handleVarDecl(varDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitObjCIvarDecl(ObjCIvarDecl *objcIvarDecl)
+{
+    handler.countMatch(HK_Ivar);
+    if (handler.isUserSourceDecl(objcIvarDecl)) handler.handleObjcIVarDecl(objcIvarDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitObjCPropertyDecl(ObjCPropertyDecl *objcPropertyDecl)
+{
+    handler.countMatch(HK_Property);
+    if (handler.isUserSourceDecl(objcPropertyDecl)) handler.handleObjcPropertyDecl(objcPropertyDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitObjCMessageExpr(ObjCMessageExpr *messageExpr)
+{
+    //对应 objcMessageExpr(isClassMessage())
+    if (!messageExpr->isClassMessage())
+        return true;
+    handler.countMatch(HK_Message);
+    if (messageExpr->getReceiverKind() == ObjCMessageExpr::Class && handler.isUserSourceDecl(messageExpr))
+        handler.handleMessageExpr(messageExpr);
+    return true;
+}
+
+bool ObfASTVisitor::VisitExplicitCastExpr(ExplicitCastExpr *explicitCastExpr)
+{
+    handler.countMatch(HK_Cast);
+    if (handler.isUserSourceDecl(explicitCastExpr)) handler.handleExplicitCastExpr(explicitCastExpr);
+    return true;
+}
+
+bool ObfASTVisitor::VisitTypedefDecl(TypedefDecl *typedefDecl)
+{
+    handler.countMatch(HK_Typedef);
+    if (handler.isUserSourceDecl(typedefDecl)) handler.handleTypedefDecl(typedefDecl);
+    return true;
+}
+
+bool ObfASTVisitor::VisitStringLiteral(clang::StringLiteral *stringLiteral)
+{
+    handler.countMatch(HK_Literal);
+    if (handler.isUserSourceDecl(stringLiteral)) handler.handleStringLiteral(stringLiteral);
+    return true;
+}
+
+ObfASTConsumer::ObfASTConsumer(Rewriter& aRewriter, CompilerInstance* aCI, const ObfConfig& aConfig, TUResult& aResult)
+    :handlerMatchCallback(aRewriter, aCI, aConfig, aResult)
+    ,visitor(handlerMatchCallback)
+    ,compilerInstance(aCI)
+    ,engine(aConfig.engine)
+    ,collectStats(aConfig.collectStats)
+    ,result(aResult)
+{
+    if (engine != ObfEngine::Matcher)
+        return;
     //类声明
     matcher.addMatcher(objcInterfaceDecl().bind("objcInterfaceDecl"), &handlerMatchCallback);
     //类定义
@@ -460,8 +882,41 @@ ObfASTConsumer::ObfASTConsumer(Rewriter& aRewriter, CompilerInstance* aCI)
     matcher.addMatcher(stringLiteral().bind("stringLiteral"), &handlerMatchCallback);
 }
 
+bool ObfASTConsumer::shouldSkipFunctionBody(Decl *D)
+{
+    if (!bodySkipper || !bodySkipper->shouldSkip(D))
+        return false;
+    result.skippedBodies++;
+    return true;
+}
+
 void ObfASTConsumer::HandleTranslationUnit(ASTContext& Context)
 {
-    //运行匹配器
-    matcher.matchAST(Context);
+    llvm::TimeTraceScope traceScope("ObfTraversal");
+    auto start = std::chrono::steady_clock::now();
+    HeaderOnceTracker *headerOnce = handlerMatchCallback.getHeaderOnce();
+    restrictTraversalToUserSource(Context, handlerMatchCallback.getClassifier(), headerOnce);
+    if (engine == ObfEngine::Visitor)
+    {
+        visitor.TraverseAST(Context);
+    }
+    else
+    {
+        //运行匹配器
+        matcher.matchAST(Context);
+    }
+    if (headerOnce)
+    {
+        headerOnce->finish(result);
+    }
+    result.traversalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    //AST 和 Rewriter 此时都还在内存中
+    SourceManager &sm = Context.getSourceManager();
+    SourceManager::MemoryBufferSizes bufferSizes = sm.getMemoryBufferSizes();
+    result.memoryBytes = Context.getASTAllocatedMemory() + Context.getSideTableAllocatedMemory() +
+                         sm.getContentCacheSize() + sm.getDataStructureSizes() +
+                         bufferSizes.malloc_bytes + bufferSizes.mmap_bytes +
+                         compilerInstance->getPreprocessor().getTotalMemory();
+    if (collectStats)
+        result.stats.rssBytes = getCurrentRSS();
 }
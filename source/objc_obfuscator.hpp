@@ -2,16 +2,33 @@
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <set>
 
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
 #include "clang/AST/ASTConsumer.h"
+#include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
 #include "clang/Rewrite/Core/Rewriter.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/StringSaver.h"
+
+#include "header_registry.hpp"
+#include "literal_scanner.hpp"
+#include "preamble_cache.hpp"
+#include "rename_manifest.hpp"
+#include "rename_map.hpp"
+#include "run_stats.hpp"
+#include "source_classifier.hpp"
 
 using namespace std;
 using namespace llvm;
@@ -19,17 +36,127 @@ using namespace clang;
 using namespace clang::tooling;
 using namespace clang::ast_matchers;
 
+// 遍历引擎
+enum class ObfEngine
+{
+    //12个 MatchFinder 匹配器共用一个回调
+    Matcher,
+    //单遍 RecursiveASTVisitor，按节点类型直接分派
+    Visitor,
+};
+
+// 各TU共享的只读配置
+struct ObfConfig
+{
+    const RenameMap *renameMap = nullptr;
+    SourceRoots roots;
+    ObfEngine engine = ObfEngine::Matcher;
+    //非空时，开头相同的TU共享预编译的 preamble
+    PreambleCache *preambleCache = nullptr;
+    //字符串字面量中类名的改写范围；Substring 时由 literalScanner 查找候选
+    LiteralPolicy literalPolicy = LiteralPolicy::Exact;
+    const LiteralScanner *literalScanner = nullptr;
+    //非空时，其它TU处理过的头文件不再遍历，复用登记的改写(--header-once)
+    HeaderRegistry *headerRegistry = nullptr;
+    //只解析主文件和含重命名键的用户头文件中的函数/方法体(--skip-function-bodies)
+    bool skipFunctionBodies = false;
+    //逐条记录改写过程，按TU缓冲，结束后统一输出
+    bool verbose = false;
+    //按TU统计各 handle 函数的命中次数、耗时和内存(--stats)
+    bool collectStats = false;
+};
+
+//文件的绝对路径，去掉 . 和 ..；同一文件在不同TU中得到相同的结果
+std::string getAbsoluteFilePath(const SourceManager &sm, FileID fileID);
+//命令行给出的路径按当前目录转成绝对路径，去掉 . 和 ..
+std::string getNormalizedAbsolutePath(StringRef path);
+//只遍历用户源码中的顶层声明，系统/第三方头文件的子树整个跳过；headerOnce 非空时再跳过其它TU处理过的头文件
+void restrictTraversalToUserSource(ASTContext &context, SourceClassifier &classifier,
+                                   HeaderOnceTracker *headerOnce = nullptr);
+
+// 按文件(绝对路径)归类的编辑集合，std::set 保证顺序确定、相同编辑去重
+typedef std::map<std::string, std::set<tooling::Replacement>> FileEdits;
+
+// 单个翻译单元的混淆结果，每个worker独立持有，不与其它TU共享
+struct TUResult
+{
+    std::string mainFile;
+    FileEdits edits;
+    //整个TU(预处理、解析、遍历)的耗时
+    double totalSeconds = 0;
+    //遍历AST(匹配+改写)的耗时
+    double traversalSeconds = 0;
+    //其中记录改写(Rewriter + 编辑/清单)的耗时
+    double rewriteSeconds = 0;
+    //预处理时进入过的所有文件(含主文件)，增量模式据此判断TU是否变化
+    std::set<std::string> includedFiles;
+    bool hasErrors = false;
+    //结果来自增量缓存，未重新解析
+    bool fromCache = false;
+    //本TU的重命名清单
+    std::vector<ManifestRecord> renames;
+    //verbose 模式下的逐条输出
+    std::string log;
+    //--stats 时的统计
+    TUStats stats;
+    //遍历结束时本TU的 AST、SourceManager、Preprocessor 占用的字节数，内存受限模式据此预计下次的峰值
+    uint64_t memoryBytes = 0;
+    //--skip-function-bodies 时跳过解析的函数/方法体个数
+    unsigned skippedBodies = 0;
+
+    //记录一处改写：编辑及对应的清单条目
+    void addRename(const SourceManager &sm, SourceLocation loc, unsigned length,
+                   StringRef oldName, StringRef newName, rename_manifest::EntryKind kind);
+};
+
+// 记录预处理过程中进入的文件
+class IncludeRecorder : public PPCallbacks
+{
+public:
+    IncludeRecorder(const SourceManager &aSourceManager, std::set<std::string> &aFiles);
+    void FileChanged(SourceLocation Loc, FileChangeReason Reason,
+                     SrcMgr::CharacteristicKind FileType, FileID PrevFID) override;
+private:
+    const SourceManager &sourceManager;
+    std::set<std::string> &files;
+};
+
+// --skip-function-bodies：决定哪些函数/方法体可以不解析
+// 主文件的函数体总是解析；系统/第三方源码的函数体总是跳过，其中的节点本来就不改写；
+// 用户头文件只有在文本中不含任何重命名键、且此前没有定义过含键的用户宏时才跳过
+class FunctionBodySkipper : public PPCallbacks
+{
+public:
+    //scanner 为空时不跳过用户头文件中的函数体
+    FunctionBodySkipper(const SourceManager &aSourceManager, const LangOptions &aLangOptions,
+                        const SourceRoots &roots, const LiteralScanner *aScanner);
+    void MacroDefined(const Token &MacroNameTok, const MacroDirective *MD) override;
+    bool shouldSkip(const Decl *decl);
+private:
+    const SourceManager &sourceManager;
+    const LangOptions &langOptions;
+    SourceClassifier classifier;
+    const LiteralScanner *scanner;
+    //宏展开后的函数体可能引用类名，定义过含键的用户宏后不再跳过用户头文件
+    bool keyMacroDefined = false;
+    //按 FileID 缓存用户头文件的文本扫描结果
+    DenseMap<FileID, bool> keyFreeFiles;
+};
+
 // 匹配回调
 class MatchCallbackHandler : public MatchFinder::MatchCallback
 {
 public:
-    MatchCallbackHandler(Rewriter &aRewriter, CompilerInstance *aCompilerInstance);
+    MatchCallbackHandler(Rewriter &aRewriter, CompilerInstance *aCompilerInstance, const ObfConfig &aConfig, TUResult &aResult);
 
     virtual void run(const MatchFinder::MatchResult &Result) override;
 
-    void ReplaceText(SourceLocation Start, unsigned OrigLength,StringRef NewStr);
-    bool isNeedObfuscateClassName(string name);
-    string getNewClassName(string oldName);
+    void ReplaceText(SourceLocation Start, unsigned OrigLength, StringRef NewStr,
+                     rename_manifest::EntryKind kind, StringRef oldName);
+    bool isNeedObfuscateClassName(const IdentifierInfo *identifier);
+    //返回新类名，不需要混淆时返回空
+    StringRef getNewClassName(const IdentifierInfo *identifier);
+    StringRef getNewClassName(StringRef oldName);
     void handleInterfaceDecl(const ObjCInterfaceDecl* interfaceDecl);
     void handleImplementationDecl(const ObjCImplementationDecl* objcImplementationDecl);
     void handleCategoryDecl(const ObjCCategoryDecl* objcCategoryDecl);
@@ -37,12 +164,18 @@ public:
     void handleMessageExpr(const ObjCMessageExpr* messageExpr);
     void handleExplicitCastExpr(const ExplicitCastExpr* explicitCastExpr);
     void handleStringLiteral(const clang::StringLiteral* stringLiteral);
+    //改写字面量内容中 [offset, offset + length) 的类名
+    void replaceInLiteral(const clang::StringLiteral* stringLiteral, size_t offset, size_t length,
+                          StringRef oldName, StringRef newName);
     void handleTypedefDecl(const TypedefDecl* typedefDecl);
     void handleVarDecl(const VarDecl* varDecl);
     void handleObjcIVarDecl(const ObjCIvarDecl* objcIvarDecl);
     void handleObjcPropertyDecl(const ObjCPropertyDecl* objcPropertyDecl);
     void handleMethodDecl(const ObjCMethodDecl* methodDecl);
-    bool recursiveHandleQualType(SourceLocation start, SourceLocation end, QualType type);
+    //改写类型中出现的所有类名，包括嵌套的泛型参数
+    bool handleTypeLoc(TypeLoc typeLoc, rename_manifest::EntryKind kind);
+    bool handleNestedTypeLoc(TypeLoc typeLoc, rename_manifest::EntryKind kind);
+    bool handleInterfaceTypeLoc(ObjCInterfaceTypeLoc interfaceLoc, rename_manifest::EntryKind kind);
     string getMethodDeclStringOfMethoddecl(const ObjCMethodDecl* methodDecl);
     string getClassNameOfMethodDecl(const ObjCMethodDecl* methodDecl);
    
@@ -50,13 +183,12 @@ public:
    template <typename Node>
    bool isUserSourceDecl(const Node node) {
          if(!node)return false;
-        string filename = sourcePathNode(node);
-        if (filename.empty())
-            return false;
-        //非XCode中的源码都认为是用户源码
-        if(filename.find("/Applications/Xcode.app/") == 0)
-            return false;
-        return true;
+        StatsTimer timer(stats ? &stats->classifyCalls : nullptr, stats ? &stats->classifySeconds : nullptr);
+        return classifier.isUserLoc(node->getSourceRange().getBegin());
+    }
+    //匹配器/visitor 到达的节点数
+    void countMatch(HandlerKind kind) {
+        if (stats) stats->matchHits[kind]++;
     }
     //获取decl所在的文件
     template <typename Node>
@@ -80,30 +212,102 @@ public:
         return fileName.str();
     }
 
+    SourceClassifier &getClassifier() { return classifier; }
+    //未开启 --header-once 时为空
+    HeaderOnceTracker *getHeaderOnce() { return headerOnce.get(); }
+
 private:
     Rewriter &rewriter;
     CompilerInstance *compilerInstance;
+    const ObfConfig &config;
+    TUResult &result;
+    raw_string_ostream verboseLog;
+    //未开启 --stats 时为空
+    TUStats *stats;
+    SourceClassifier classifier;
+    std::unique_ptr<HeaderOnceTracker> headerOnce;
+    //按 IdentifierInfo* 缓存重命名表的查询结果，每个标识符只查一次表
+    DenseMap<const IdentifierInfo *, StringRef> newNameCache;
+    BumpPtrAllocator newNameAllocator;
+    StringSaver newNameSaver{newNameAllocator};
+};
+
+// 单遍遍历：每种节点直接分派到对应的 handle 函数，省去 getNodeAs 的逐个查找
+class ObfASTVisitor : public RecursiveASTVisitor<ObfASTVisitor>
+{
+public:
+    explicit ObfASTVisitor(MatchCallbackHandler &aHandler);
+
+    //与 MatchFinder 的遍历范围保持一致
+    bool shouldVisitImplicitCode() const { return true; }
+    bool shouldVisitTemplateInstantiations() const { return true; }
+
+    bool VisitObjCInterfaceDecl(ObjCInterfaceDecl *interfaceDecl);
+    bool VisitObjCImplementationDecl(ObjCImplementationDecl *implDecl);
+    bool VisitObjCCategoryDecl(ObjCCategoryDecl *categoryDecl);
+    bool VisitObjCCategoryImplDecl(ObjCCategoryImplDecl *categoryImplDecl);
+    bool VisitObjCMethodDecl(ObjCMethodDecl *methodDecl);
+    bool VisitVarDecl(VarDecl *varDecl);
+    bool VisitObjCIvarDecl(ObjCIvarDecl *objcIvarDecl);
+    bool VisitObjCPropertyDecl(ObjCPropertyDecl *objcPropertyDecl);
+    bool VisitObjCMessageExpr(ObjCMessageExpr *messageExpr);
+    bool VisitExplicitCastExpr(ExplicitCastExpr *explicitCastExpr);
+    bool VisitTypedefDecl(TypedefDecl *typedefDecl);
+    bool VisitStringLiteral(clang::StringLiteral *stringLiteral);
+
+private:
+    MatchCallbackHandler &handler;
 };
 
 // AST 构造器
 class ObfASTConsumer : public ASTConsumer
 {
 public:
-    ObfASTConsumer(Rewriter& aRewriter, CompilerInstance* aCI);
+    ObfASTConsumer(Rewriter& aRewriter, CompilerInstance* aCI, const ObfConfig& aConfig, TUResult& aResult);
     virtual void HandleTranslationUnit(ASTContext& Context) override;
+    bool shouldSkipFunctionBody(Decl *D) override;
+    //由 action 挂到 Preprocessor 上，生命周期覆盖整个解析过程
+    void setBodySkipper(FunctionBodySkipper *skipper) { bodySkipper = skipper; }
+    HeaderOnceTracker *getHeaderOnce() { return handlerMatchCallback.getHeaderOnce(); }
 private:
     MatchFinder matcher;
     MatchCallbackHandler handlerMatchCallback;
+    ObfASTVisitor visitor;
+    CompilerInstance *compilerInstance;
+    ObfEngine engine;
+    bool collectStats;
+    TUResult &result;
+    //未开启 --skip-function-bodies 时为空
+    FunctionBodySkipper *bodySkipper = nullptr;
 };
 
 // action
 class ObfASTFrontendAction : public ASTFrontendAction
 {
 public:
+    ObfASTFrontendAction(const ObfConfig &aConfig, TUResult &aResult);
+    bool BeginSourceFileAction(CompilerInstance &CI) override;
     //创建AST Consumer
     std::unique_ptr<ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, StringRef file) override;
     //源文件操作结束
     void EndSourceFileAction() override;
 private:
     Rewriter rewriter;
+    const ObfConfig &config;
+    TUResult &result;
+};
+
+// 为每个TU创建绑定到其结果的 action
+class ObfFrontendActionFactory : public FrontendActionFactory
+{
+public:
+    ObfFrontendActionFactory(const ObfConfig &aConfig, TUResult &aResult);
+    std::unique_ptr<FrontendAction> create() override;
+    //在创建 CompilerInstance 前挂上共享的 preamble
+    bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation, FileManager *Files,
+                       std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                       DiagnosticConsumer *DiagConsumer) override;
+private:
+    const ObfConfig &config;
+    TUResult &result;
 };
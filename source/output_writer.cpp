@@ -0,0 +1,158 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "output_writer.hpp"
+
+#include <mutex>
+
+#include "clang/Basic/DiagnosticOptions.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+
+OutputWriter::OutputWriter(StringRef aOutputDir, unsigned aJobs)
+: outputDir(aOutputDir.str())
+, jobs(aJobs)
+{
+}
+
+std::string OutputWriter::getOutputPath(StringRef sourcePath) const
+{
+    if (outputDir.empty())
+        return sourcePath.str();
+    //当前目录下的文件保持相对路径，其它文件按完整路径放到输出目录下
+    SmallString<256> cwd;
+    StringRef relativePath = sourcePath;
+    if (!sys::fs::current_path(cwd) && relativePath.startswith(cwd) &&
+        relativePath.size() > cwd.size() && sys::path::is_separator(relativePath[cwd.size()]))
+        relativePath = relativePath.drop_front(cwd.size() + 1);
+    else
+        relativePath = sys::path::relative_path(relativePath);
+    SmallString<256> outputPath(outputDir);
+    sys::path::append(outputPath, relativePath);
+    return outputPath.str().str();
+}
+
+bool OutputWriter::writeFile(StringRef sourcePath, const tooling::Replacements &replacements, std::string &error)
+{
+    //每个文件独立的 SourceManager，可以在多个线程中同时处理
+    FileManager files((FileSystemOptions()));
+    DiagnosticsEngine diagnostics(new DiagnosticIDs(), new DiagnosticOptions(), new IgnoringDiagConsumer());
+    SourceManager sourceManager(diagnostics, files);
+    auto entry = files.getFile(sourcePath);
+    if (!entry)
+    {
+        error = entry.getError().message();
+        return false;
+    }
+    FileID fileID = sourceManager.getOrCreateFileID(*entry, SrcMgr::C_User);
+    StringRef original = sourceManager.getBufferData(fileID);
+
+    //新旧内容相同的编辑不算修改
+    tooling::Replacements effective;
+    for (const tooling::Replacement &replacement : replacements)
+    {
+        if (replacement.getOffset() + replacement.getLength() <= original.size() &&
+            original.substr(replacement.getOffset(), replacement.getLength()) == replacement.getReplacementText())
+            continue;
+        consumeError(effective.add(replacement));
+    }
+    if (effective.empty())
+        return true;
+
+    Rewriter rewriter(sourceManager, LangOptions());
+    if (!tooling::applyAllReplacements(effective, rewriter))
+    {
+        error = "cannot apply replacements";
+        return false;
+    }
+    const RewriteBuffer *buffer = rewriter.getRewriteBufferFor(fileID);
+    if (!buffer)
+        return true;
+
+    std::string outputPath = getOutputPath(sourcePath);
+    if (std::error_code ec = sys::fs::create_directories(sys::path::parent_path(outputPath)))
+    {
+        error = ec.message();
+        return false;
+    }
+    SmallString<256> tempPath;
+    int fd;
+    if (std::error_code ec = sys::fs::createUniqueFile(outputPath + ".obf-%%%%%%.tmp", fd, tempPath))
+    {
+        error = ec.message();
+        return false;
+    }
+    {
+        raw_fd_ostream os(fd, /*shouldClose=*/true);
+        buffer->write(os);
+        os.close();
+        if (os.has_error())
+        {
+            error = os.error().message();
+            os.clear_error();
+            sys::fs::remove(tempPath);
+            return false;
+        }
+    }
+    //原地改写时保留原文件的权限
+    sys::fs::file_status status;
+    if (!sys::fs::status(sourcePath, status))
+        sys::fs::setPermissions(tempPath, status.permissions());
+    if (std::error_code ec = sys::fs::rename(tempPath, outputPath))
+    {
+        error = ec.message();
+        sys::fs::remove(tempPath);
+        return false;
+    }
+    writtenCount++;
+    return true;
+}
+
+unsigned OutputWriter::write(const std::map<std::string, tooling::Replacements> &replacements, raw_ostream &errs)
+{
+    std::atomic<unsigned> failures(0);
+    std::mutex errsMutex;
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (const auto &fileReplacements : replacements)
+        {
+            if (fileReplacements.second.empty())
+                continue;
+            const std::string &path = fileReplacements.first;
+            const tooling::Replacements &fileEdits = fileReplacements.second;
+            pool.async([&, path]() {
+                TraceTaskScope traceScope("ObfWriteFile", path);
+                std::string error;
+                if (!writeFile(path, fileEdits, error))
+                {
+                    std::lock_guard<std::mutex> lock(errsMutex);
+                    errs << "cannot write " << getOutputPath(path) << ": " << error << "\n";
+                    failures++;
+                }
+            });
+        }
+        pool.wait();
+    }
+    return failures;
+}
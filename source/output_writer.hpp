@@ -0,0 +1,51 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+
+#include "objc_obfuscator.hpp"
+
+// 把合并后的编辑写回源码
+//
+// 每个文件只写一次(无论被多少个TU改过)，只写真正有变化的文件；内容从 RewriteBuffer
+// 直接流式写入同目录下的临时文件，再 rename 到目标位置，中途失败不会留下半个文件。
+class OutputWriter
+{
+public:
+    //outputDir 为空表示原地改写
+    OutputWriter(StringRef aOutputDir, unsigned aJobs);
+
+    //返回写失败的文件个数
+    unsigned write(const std::map<std::string, tooling::Replacements> &replacements, raw_ostream &errs);
+    unsigned getWrittenCount() const { return writtenCount; }
+
+private:
+    std::string getOutputPath(StringRef sourcePath) const;
+    bool writeFile(StringRef sourcePath, const tooling::Replacements &replacements, std::string &error);
+
+    std::string outputDir;
+    unsigned jobs;
+    std::atomic<unsigned> writtenCount{0};
+};
@@ -0,0 +1,173 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "parallel_driver.hpp"
+
+#include <atomic>
+
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+void ReplacementMerger::add(const TUResult &aResult)
+{
+    addEdits(aResult.edits);
+    for (const ManifestRecord &record : aResult.renames)
+    {
+        oldNamesByNewName[record.newName].insert(record.oldName);
+    }
+}
+
+void ReplacementMerger::addEdits(const FileEdits &someEdits)
+{
+    for (const auto &fileEdits : someEdits)
+    {
+        edits[fileEdits.first].insert(fileEdits.second.begin(), fileEdits.second.end());
+    }
+}
+
+unsigned ReplacementMerger::finalize(std::map<std::string, tooling::Replacements> &out, raw_ostream &errs) const
+{
+    unsigned conflicts = 0;
+    //FileEdits 本身有序，输出与TU的处理顺序、线程数无关
+    for (const auto &fileEdits : edits)
+    {
+        tooling::Replacements &replacements = out[fileEdits.first];
+        for (const tooling::Replacement &replacement : fileEdits.second)
+        {
+            if (llvm::Error err = replacements.add(replacement))
+            {
+                errs << "conflict: " << replacement.toString() << ": " << toString(std::move(err)) << "\n";
+                conflicts++;
+            }
+        }
+    }
+    //各TU独立生成新名，只在这里统一检查是否有两个类撞名
+    for (const auto &entry : oldNamesByNewName)
+    {
+        if (entry.second.size() < 2)
+            continue;
+        errs << "conflict: " << entry.second.size() << " names renamed to '" << entry.first << "':";
+        for (const std::string &oldName : entry.second)
+            errs << " " << oldName;
+        errs << "\n";
+        conflicts++;
+    }
+    return conflicts;
+}
+
+unsigned runActionsInParallel(const CompilationDatabase &compilations, ArrayRef<std::string> files, unsigned jobs,
+                              function_ref<std::unique_ptr<FrontendActionFactory>(size_t)> makeFactory,
+                              function_ref<void(size_t)> finished, SharedFileCache *fileCache,
+                              function_ref<IntrusiveRefCntPtr<llvm::vfs::FileSystem>(
+                                  IntrusiveRefCntPtr<llvm::vfs::FileSystem>)> mountFileSystem)
+{
+    std::atomic<unsigned> failures(0);
+    {
+        //jobs 为0时使用全部核心
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            pool.async([&, i]() {
+                TraceTaskScope traceScope("ObfTU", files[i]);
+                //每个线程独立的VFS，允许各自的工作目录
+                IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs = llvm::vfs::createPhysicalFileSystem();
+                if (fileCache)
+                    fs = createCachingFileSystem(fs, *fileCache);
+                if (mountFileSystem)
+                    fs = mountFileSystem(fs);
+                ClangTool tool(compilations, {files[i]}, std::make_shared<PCHContainerOperations>(), fs);
+                //返回空表示这个TU不需要解析
+                std::unique_ptr<FrontendActionFactory> factory = makeFactory(i);
+                if (!factory)
+                    return;
+                if (tool.run(factory.get()))
+                {
+                    errs() << "failed to run action on " << files[i] << "\n";
+                    failures++;
+                }
+                if (finished)
+                    finished(i);
+            });
+        }
+        pool.wait();
+    }
+    return failures;
+}
+
+ParallelObfDriver::ParallelObfDriver(const CompilationDatabase &aCompilations, const ObfConfig &aConfig, unsigned aJobs)
+: compilations(aCompilations)
+, config(aConfig)
+, jobs(aJobs)
+{
+}
+
+unsigned ParallelObfDriver::run(ArrayRef<std::string> files)
+{
+    results.clear();
+    results.resize(files.size());
+    foldedEdits.clear();
+    std::vector<std::string> cacheKeys(files.size());
+    std::vector<uint64_t> grantedBytes(files.size());
+    auto storeInCache = [&](size_t i) {
+        const TUResult &result = results[i];
+        if (!result.fromCache && !result.hasErrors && !result.includedFiles.empty())
+            cache->store(cacheKeys[i], result);
+    };
+
+    unsigned failures = runActionsInParallel(compilations, files, jobs, [&](size_t i) -> std::unique_ptr<FrontendActionFactory> {
+        if (cache || governor)
+            results[i].mainFile = getNormalizedAbsolutePath(files[i]);
+        if (cache)
+        {
+            cacheKeys[i] = cache->computeKey(results[i].mainFile, compilations.getCompileCommands(results[i].mainFile));
+            if (cache->lookup(cacheKeys[i], results[i]))
+                return nullptr;
+        }
+        if (governor)
+            grantedBytes[i] = governor->acquire(results[i].mainFile);
+        return std::make_unique<ObfFrontendActionFactory>(config, results[i]);
+    }, [&](size_t i) {
+        if (!governor)
+            return;
+        //CompilerInstance 已销毁，归还额度并释放分配器缓存的内存
+        TUResult &result = results[i];
+        governor->release(result.mainFile, grantedBytes[i], result.memoryBytes);
+        if (cache)
+            storeInCache(i);
+        {
+            std::lock_guard<std::mutex> lock(foldedEditsMutex);
+            for (auto &fileEdits : result.edits)
+                foldedEdits[fileEdits.first].insert(fileEdits.second.begin(), fileEdits.second.end());
+        }
+        FileEdits().swap(result.edits);
+        std::set<std::string>().swap(result.includedFiles);
+    }, fileCache);
+
+    if (cache && !governor)
+    {
+        for (size_t i = 0; i < files.size(); i++)
+            storeInCache(i);
+    }
+    return failures;
+}
@@ -0,0 +1,89 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <mutex>
+
+#include "objc_obfuscator.hpp"
+#include "incremental_cache.hpp"
+#include "memory_governor.hpp"
+#include "shared_file_cache.hpp"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/STLExtras.h"
+
+// 在线程池中对每个文件运行 makeFactory(i) 创建的 action，返回失败的TU个数。
+// finished(i) 在该TU解析结束、其 AST 已释放后在同一线程中调用；fileCache 非空时文件访问经过它；
+// mountFileSystem 非空时用它包装每个线程的文件系统
+unsigned runActionsInParallel(const CompilationDatabase &compilations, ArrayRef<std::string> files, unsigned jobs,
+                              function_ref<std::unique_ptr<FrontendActionFactory>(size_t)> makeFactory,
+                              function_ref<void(size_t)> finished = nullptr, SharedFileCache *fileCache = nullptr,
+                              function_ref<IntrusiveRefCntPtr<llvm::vfs::FileSystem>(
+                                  IntrusiveRefCntPtr<llvm::vfs::FileSystem>)> mountFileSystem = nullptr);
+
+// 合并各TU的编辑：相同编辑去重，重叠编辑以及不同旧名得到同一新名均视为冲突
+class ReplacementMerger
+{
+public:
+    void add(const TUResult &aResult);
+    void addEdits(const FileEdits &someEdits);
+    //生成最终的编辑集合，返回冲突的个数
+    unsigned finalize(std::map<std::string, tooling::Replacements> &out, raw_ostream &errs) const;
+    const FileEdits &getEdits() const { return edits; }
+private:
+    FileEdits edits;
+    //新名 -> 改成该新名的所有旧名
+    std::map<std::string, std::set<std::string>> oldNamesByNewName;
+};
+
+// 并行驱动：每个文件一个 ClangTool，在线程池中执行 ObfASTFrontendAction
+class ParallelObfDriver
+{
+public:
+    ParallelObfDriver(const CompilationDatabase &aCompilations, const ObfConfig &aConfig, unsigned aJobs);
+
+    //设置后，未变化的TU直接回放缓存的编辑，重新解析的TU写回缓存
+    void setCache(IncrementalCache *aCache) { cache = aCache; }
+    //设置后按内存预算准入TU；每个TU结束时立即写缓存，并把编辑并入 getFoldedEdits()，
+    //TUResult 中只留下清单等小对象，峰值内存不随已处理的TU数增长
+    void setMemoryGovernor(MemoryGovernor *aGovernor) { governor = aGovernor; }
+    //设置后各TU共享 stat 结果和文件内容，服务模式下跨请求保留
+    void setFileCache(SharedFileCache *aFileCache) { fileCache = aFileCache; }
+    //返回失败的TU个数
+    unsigned run(ArrayRef<std::string> files);
+    const std::vector<TUResult> &getResults() const { return results; }
+    //内存受限模式下已从 TUResult 移出的编辑
+    const FileEdits &getFoldedEdits() const { return foldedEdits; }
+
+private:
+    const CompilationDatabase &compilations;
+    const ObfConfig &config;
+    unsigned jobs;
+    IncrementalCache *cache = nullptr;
+    MemoryGovernor *governor = nullptr;
+    SharedFileCache *fileCache = nullptr;
+    std::vector<TUResult> results;
+    std::mutex foldedEditsMutex;
+    FileEdits foldedEdits;
+};
@@ -0,0 +1,159 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "preamble_cache.hpp"
+#include "objc_obfuscator.hpp"
+
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+
+namespace {
+
+// 记录 preamble 构建过程中进入的文件
+class PreambleFileRecorder : public PreambleCallbacks
+{
+public:
+    explicit PreambleFileRecorder(std::set<std::string> &aFiles)
+    : files(aFiles)
+    {
+    }
+    void BeforeExecute(CompilerInstance &CI) override { sourceManager = &CI.getSourceManager(); }
+    std::unique_ptr<PPCallbacks> createPPCallbacks() override
+    {
+        if (!sourceManager)
+            return nullptr;
+        return std::make_unique<IncludeRecorder>(*sourceManager, files);
+    }
+
+private:
+    std::set<std::string> &files;
+    const SourceManager *sourceManager = nullptr;
+};
+
+bool isReady(const std::shared_future<std::shared_ptr<const PreambleCache::Entry>> &future)
+{
+    return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+} // namespace
+
+std::shared_ptr<const PreambleCache::Entry> PreambleCache::apply(CompilerInvocation &invocation, FileManager &files,
+                                                 std::shared_ptr<PCHContainerOperations> pchContainerOps)
+{
+    FrontendOptions &frontendOpts = invocation.getFrontendOpts();
+    if (frontendOpts.Inputs.size() != 1 || !frontendOpts.Inputs[0].isFile())
+        return nullptr;
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> mainBuffer = files.getBufferForFile(frontendOpts.Inputs[0].getFile());
+    if (!mainBuffer)
+        return nullptr;
+    PreambleBounds bounds = ComputePreambleBounds(*invocation.getLangOpts(), (*mainBuffer)->getMemBufferRef(), 0);
+    const std::vector<std::string> &prefixHeaders = invocation.getPreprocessorOpts().Includes;
+    if (bounds.Size == 0 && prefixHeaders.empty())
+        return nullptr;
+
+    MD5 hasher;
+    hasher.update(invocation.getModuleHash());
+    for (const std::string &header : prefixHeaders)
+    {
+        hasher.update(header);
+        if (auto headerBuffer = files.getBufferForFile(header))
+            hasher.update((*headerBuffer)->getBuffer());
+    }
+    hasher.update((*mainBuffer)->getBuffer().take_front(bounds.Size));
+    MD5::MD5Result hash;
+    hasher.final(hash);
+    std::string key = hash.digest().str().str();
+    std::shared_ptr<const Entry> stale;
+
+    std::shared_ptr<const Entry> entry;
+    bool isBuilder = false;
+    //键只覆盖前缀头文件和 preamble 原文，被它们包含的头文件变化后条目失效，替换为重新构建的 preamble
+    for (int attempt = 0; attempt < 2 && !entry; attempt++)
+    {
+        std::shared_future<std::shared_ptr<const Entry>> future;
+        std::promise<std::shared_ptr<const Entry>> promise;
+        isBuilder = false;
+        {
+            std::lock_guard<std::mutex> lock(entriesMutex);
+            auto found = entries.find(key);
+            //别的线程已在重新构建时直接等待它的结果
+            if (found == entries.end() || (attempt > 0 && isReady(found->second) && found->second.get() == stale))
+            {
+                future = promise.get_future().share();
+                entries[key] = future;
+                isBuilder = true;
+            }
+            else
+            {
+                future = found->second;
+            }
+        }
+        if (isBuilder)
+            promise.set_value(build(invocation, **mainBuffer, bounds, files, pchContainerOps));
+
+        entry = future.get();
+        if (!entry)
+            return nullptr;
+        if (!entry->preamble->CanReuse(invocation, (*mainBuffer)->getMemBufferRef(), bounds, files.getVirtualFileSystem()))
+        {
+            //刚构建的 preamble 也不能用时不再重试
+            if (isBuilder)
+                return nullptr;
+            stale = entry;
+            entry = nullptr;
+        }
+    }
+    if (!entry)
+        return nullptr;
+    if (!isBuilder)
+        reuseCount++;
+
+    IntrusiveRefCntPtr<llvm::vfs::FileSystem> vfs = &files.getVirtualFileSystem();
+    //主文件被重映射到这个缓冲区，所有权交给之后创建的 CompilerInstance
+    entry->preamble->AddImplicitPreamble(invocation, vfs, mainBuffer->release());
+    return entry;
+}
+
+std::shared_ptr<const PreambleCache::Entry> PreambleCache::build(const CompilerInvocation &invocation, const llvm::MemoryBuffer &mainBuffer,
+                                                                 PreambleBounds bounds, FileManager &files,
+                                                                 std::shared_ptr<PCHContainerOperations> pchContainerOps)
+{
+    auto entry = std::make_shared<Entry>();
+    PreambleFileRecorder callbacks(entry->files);
+    IntrusiveRefCntPtr<DiagnosticsEngine> diagnostics = CompilerInstance::createDiagnostics(
+        new DiagnosticOptions(), new IgnoringDiagConsumer(), /*ShouldOwnClient=*/true);
+    //PCH 写入临时文件，复用时通过 ImplicitPCHInclude 从磁盘加载，不需要改 VFS
+    llvm::ErrorOr<PrecompiledPreamble> preamble = PrecompiledPreamble::Build(
+        invocation, &mainBuffer, bounds, *diagnostics, &files.getVirtualFileSystem(), pchContainerOps,
+        /*StoreInMemory=*/false, callbacks);
+    if (!preamble)
+        return nullptr;
+    entry->preamble = std::make_unique<PrecompiledPreamble>(std::move(*preamble));
+    //构建用的主文件不属于 preamble，复用它的TU不依赖这个文件
+    SmallString<256> mainFile(invocation.getFrontendOpts().Inputs[0].getFile());
+    files.makeAbsolutePath(mainFile);
+    llvm::sys::path::remove_dots(mainFile, true);
+    entry->files.erase(mainFile.str().str());
+    buildCount++;
+    return entry;
+}
@@ -0,0 +1,73 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/CompilerInvocation.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Frontend/PrecompiledPreamble.h"
+
+// 跨TU共享的预编译 preamble
+//
+// preamble 即主文件开头的 #import 区域加上 -include 的前缀头文件。键为
+// CompilerInvocation::getModuleHash()(语言/目标/宏/头文件搜索等选项)、前缀头文件内容和
+// preamble 原文；相同键的TU只构建一次，之后通过 AddImplicitPreamble 直接加载。
+// preamble 中的声明从 PCH 反序列化，其位置仍映射到原头文件，改名照常记录。
+class PreambleCache
+{
+public:
+    struct Entry
+    {
+        std::unique_ptr<clang::PrecompiledPreamble> preamble;
+        //构建 preamble 时进入过的文件，增量模式需要它们的哈希
+        std::set<std::string> files;
+    };
+
+    //可复用时修改 invocation 使其加载 preamble，返回对应条目；否则不做修改并返回空。
+    //依赖的头文件变化后旧条目被替换，调用方须持有返回值直到 TU 解析结束
+    std::shared_ptr<const Entry> apply(clang::CompilerInvocation &invocation, clang::FileManager &files,
+                       std::shared_ptr<clang::PCHContainerOperations> pchContainerOps);
+
+    unsigned getBuildCount() const { return buildCount; }
+    unsigned getReuseCount() const { return reuseCount; }
+
+private:
+    std::shared_ptr<const Entry> build(const clang::CompilerInvocation &invocation, const llvm::MemoryBuffer &mainBuffer,
+                                       clang::PreambleBounds bounds, clang::FileManager &files,
+                                       std::shared_ptr<clang::PCHContainerOperations> pchContainerOps);
+
+    std::mutex entriesMutex;
+    //同一个键只构建一次，其它线程等待构建结果
+    std::map<std::string, std::shared_future<std::shared_ptr<const Entry>>> entries;
+    std::atomic<unsigned> buildCount{0};
+    std::atomic<unsigned> reuseCount{0};
+};
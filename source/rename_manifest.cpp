@@ -0,0 +1,177 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+
+#include "rename_manifest.hpp"
+#include "atomic_file.hpp"
+#include "string_table.hpp"
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+
+using namespace llvm;
+using namespace rename_manifest;
+
+StringRef rename_manifest::getKindName(EntryKind kind)
+{
+    switch (kind)
+    {
+    case EK_Interface: return "interface";
+    case EK_Implementation: return "implementation";
+    case EK_Category: return "category";
+    case EK_CategoryImpl: return "category-impl";
+    case EK_Message: return "message";
+    case EK_Var: return "var";
+    case EK_Ivar: return "ivar";
+    case EK_Property: return "property";
+    case EK_Method: return "method";
+    case EK_Cast: return "cast";
+    case EK_Typedef: return "typedef";
+    case EK_Literal: return "literal";
+    case EK_CustomClass: return "custom-class";
+    case EK_PlistClass: return "plist-class";
+    }
+    return "unknown";
+}
+
+bool rename_manifest::parseKindName(StringRef name, EntryKind &kind)
+{
+    int value = StringSwitch<int>(name)
+        .Case("interface", EK_Interface)
+        .Case("implementation", EK_Implementation)
+        .Case("category", EK_Category)
+        .Case("category-impl", EK_CategoryImpl)
+        .Case("message", EK_Message)
+        .Case("var", EK_Var)
+        .Case("ivar", EK_Ivar)
+        .Case("property", EK_Property)
+        .Case("method", EK_Method)
+        .Case("cast", EK_Cast)
+        .Case("typedef", EK_Typedef)
+        .Case("literal", EK_Literal)
+        .Case("custom-class", EK_CustomClass)
+        .Case("plist-class", EK_PlistClass)
+        .Default(-1);
+    if (value < 0)
+        return false;
+    kind = static_cast<EntryKind>(value);
+    return true;
+}
+
+void ManifestBuilder::add(ArrayRef<ManifestRecord> aRecords)
+{
+    records.insert(aRecords.begin(), aRecords.end());
+}
+
+bool ManifestBuilder::writeJSONLines(StringRef path, raw_ostream &errs) const
+{
+    //整个文件一次性缓冲写出，不逐行刷新；deobfuscate 只依赖清单，宁可没有也不能截断
+    return writeFileAtomically(path, [&](raw_ostream &os) {
+        for (const ManifestRecord &record : records)
+        {
+            os << json::Value(json::Object{
+                {"kind", getKindName(record.kind)},
+                {"old", record.oldName},
+                {"new", record.newName},
+                {"file", record.file},
+                {"line", int64_t(record.line)},
+                {"column", int64_t(record.column)},
+            }) << "\n";
+        }
+    }, errs);
+}
+
+bool ManifestBuilder::writeBinary(StringRef path, raw_ostream &errs) const
+{
+    StringTableBuilder strings;
+    std::string table;
+    raw_string_ostream tableStream(table);
+    support::endian::Writer writer(tableStream, support::little);
+    for (const ManifestRecord &record : records)
+    {
+        writer.write<uint32_t>(record.kind);
+        strings.writeRef(writer, record.oldName);
+        strings.writeRef(writer, record.newName);
+        strings.writeRef(writer, record.file);
+        writer.write<uint32_t>(record.line);
+        writer.write<uint32_t>(record.column);
+    }
+    tableStream.flush();
+
+    return writeFileAtomically(path, [&](raw_ostream &os) {
+        os.write(Magic, sizeof(Magic));
+        support::endian::Writer headerWriter(os, support::little);
+        headerWriter.write<uint32_t>(Version);
+        headerWriter.write<uint32_t>(records.size());
+        headerWriter.write<uint32_t>(strings.data().size());
+        headerWriter.write<uint32_t>(0);
+        os << table << strings.data();
+    }, errs);
+}
+
+std::unique_ptr<RenameManifest> RenameManifest::load(StringRef path, raw_ostream &errs)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!buffer)
+    {
+        errs << "cannot read rename manifest " << path << ": " << buffer.getError().message() << "\n";
+        return nullptr;
+    }
+    StringRef data = (*buffer)->getBuffer();
+    const Header *header = reinterpret_cast<const Header *>(data.data());
+    if (data.size() < sizeof(Header) || memcmp(header->magic, Magic, sizeof(Magic)) != 0)
+    {
+        errs << path << ": not a binary rename manifest\n";
+        return nullptr;
+    }
+    if (header->version != Version)
+    {
+        errs << path << ": unsupported rename manifest version " << header->version << "\n";
+        return nullptr;
+    }
+    uint64_t entriesSize = uint64_t(header->entryCount) * sizeof(Entry);
+    if (sizeof(Header) + entriesSize + header->stringsSize != data.size())
+    {
+        errs << path << ": truncated rename manifest\n";
+        return nullptr;
+    }
+
+    std::unique_ptr<RenameManifest> manifest(new RenameManifest());
+    const char *cursor = data.data() + sizeof(Header);
+    manifest->entryTable = makeArrayRef(reinterpret_cast<const Entry *>(cursor), header->entryCount);
+    cursor += entriesSize;
+    manifest->strings = StringRef(cursor, header->stringsSize);
+    manifest->buffer = std::move(*buffer);
+    return manifest;
+}
+
+StringRef RenameManifest::getString(const Str &str) const
+{
+    //越界的引用按空串处理，避免损坏的清单导致越界读
+    if (uint64_t(str.offset) + str.length > strings.size())
+        return StringRef();
+    return strings.substr(str.offset, str.length);
+}
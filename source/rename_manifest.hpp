@@ -0,0 +1,146 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+// 重命名清单：每一处改写记录一条 (kind, old, new, file, line, column)
+//
+// 文本格式为 JSON Lines，每行一个对象；二进制格式(小端)：
+//   Header
+//   Entry[entryCount]     按 (file, line, column, kind, old, new) 排序
+//   char[stringsSize]     字符串表，Str 为其中的 (offset, length)
+namespace rename_manifest {
+
+enum EntryKind : uint32_t
+{
+    EK_Interface = 0,
+    EK_Implementation = 1,
+    EK_Category = 2,
+    EK_CategoryImpl = 3,
+    EK_Message = 4,
+    EK_Var = 5,
+    EK_Ivar = 6,
+    EK_Property = 7,
+    EK_Method = 8,
+    EK_Cast = 9,
+    EK_Typedef = 10,
+    EK_Literal = 11,
+    //.storyboard/.xib 的 customClass 属性
+    EK_CustomClass = 12,
+    //Info.plist 等 plist 中的类名
+    EK_PlistClass = 13,
+};
+
+const char Magic[8] = {'O', 'B', 'F', 'M', 'A', 'N', 'I', 'F'};
+const uint32_t Version = 1;
+
+struct Str
+{
+    llvm::support::ulittle32_t offset;
+    llvm::support::ulittle32_t length;
+};
+
+struct Header
+{
+    char magic[8];
+    llvm::support::ulittle32_t version;
+    llvm::support::ulittle32_t entryCount;
+    llvm::support::ulittle32_t stringsSize;
+    llvm::support::ulittle32_t reserved;
+};
+
+struct Entry
+{
+    llvm::support::ulittle32_t kind;
+    Str oldName;
+    Str newName;
+    Str file;
+    llvm::support::ulittle32_t line;
+    llvm::support::ulittle32_t column;
+};
+
+llvm::StringRef getKindName(EntryKind kind);
+bool parseKindName(llvm::StringRef name, EntryKind &kind);
+
+} // namespace rename_manifest
+
+// 收集阶段的清单记录，每个TU各自持有
+struct ManifestRecord
+{
+    rename_manifest::EntryKind kind;
+    std::string oldName;
+    std::string newName;
+    std::string file;
+    unsigned line = 0;
+    unsigned column = 0;
+
+    bool operator<(const ManifestRecord &other) const
+    {
+        return std::tie(file, line, column, kind, oldName, newName) <
+               std::tie(other.file, other.line, other.column, other.kind, other.oldName, other.newName);
+    }
+    bool operator==(const ManifestRecord &other) const
+    {
+        return !(*this < other) && !(other < *this);
+    }
+};
+
+// 汇总所有TU的清单，头文件中的同一处改写只保留一条，输出与TU顺序无关
+class ManifestBuilder
+{
+public:
+    void add(llvm::ArrayRef<ManifestRecord> aRecords);
+    size_t size() const { return records.size(); }
+    bool writeJSONLines(llvm::StringRef path, llvm::raw_ostream &errs) const;
+    bool writeBinary(llvm::StringRef path, llvm::raw_ostream &errs) const;
+
+private:
+    std::set<ManifestRecord> records;
+};
+
+// 只读的二进制清单，文件通过 MemoryBuffer 映射到内存，不做反序列化
+class RenameManifest
+{
+public:
+    static std::unique_ptr<RenameManifest> load(llvm::StringRef path, llvm::raw_ostream &errs);
+
+    llvm::ArrayRef<rename_manifest::Entry> entries() const { return entryTable; }
+    llvm::StringRef getString(const rename_manifest::Str &str) const;
+
+private:
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    llvm::ArrayRef<rename_manifest::Entry> entryTable;
+    llvm::StringRef strings;
+};
@@ -0,0 +1,266 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "rename_map.hpp"
+#include "name_generator.hpp"
+
+#include <algorithm>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+
+static bool isIdentifierChar(char c)
+{
+    return isAlnum(c) || c == '_' || c == '$';
+}
+
+static bool isValidPattern(StringRef pattern)
+{
+    if (pattern.empty() || isDigit(pattern.front()))
+        return false;
+    return llvm::all_of(pattern, [](char c) { return isIdentifierChar(c) || c == '*'; });
+}
+
+//@ 或 @前缀：新名由 NameGenerator 生成
+static bool isGeneratedPattern(StringRef pattern)
+{
+    if (!pattern.startswith("@"))
+        return false;
+    StringRef prefix = pattern.drop_front();
+    if (!prefix.empty() && isDigit(prefix.front()))
+        return false;
+    return llvm::all_of(prefix, isIdentifierChar);
+}
+
+//通配匹配，记录每个 * 匹配到的内容；* 优先匹配最短的内容，结果确定
+static bool matchGlob(StringRef pattern, StringRef name, SmallVectorImpl<StringRef> &captures)
+{
+    while (!pattern.empty())
+    {
+        char c = pattern.front();
+        if (c == '*')
+        {
+            StringRef rest = pattern.drop_front();
+            for (size_t n = 0; n <= name.size(); n++)
+            {
+                captures.push_back(name.take_front(n));
+                if (matchGlob(rest, name.drop_front(n), captures))
+                    return true;
+                captures.pop_back();
+            }
+            return false;
+        }
+        if (name.empty() || c != name.front())
+            return false;
+        pattern = pattern.drop_front();
+        name = name.drop_front();
+    }
+    return name.empty();
+}
+
+bool RenameMap::loadFile(StringRef path, raw_ostream &errs)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+    {
+        errs << "cannot read rename map " << path << ": " << buffer.getError().message() << "\n";
+        return false;
+    }
+    return loadBuffer((*buffer)->getBuffer(), path, errs);
+}
+
+bool RenameMap::loadBuffer(StringRef content, StringRef bufferName, raw_ostream &errs)
+{
+    bool success = true;
+    unsigned lineNo = 0;
+    while (!content.empty())
+    {
+        StringRef line;
+        std::tie(line, content) = content.split('\n');
+        lineNo++;
+        line = line.split('#').first.trim();
+        if (line.empty())
+            continue;
+
+        StringRef oldPattern, newPattern;
+        std::tie(oldPattern, newPattern) = line.split(' ');
+        if (newPattern.empty())
+            std::tie(oldPattern, newPattern) = line.split('\t');
+        newPattern = newPattern.trim();
+
+        std::string error;
+        if (newPattern.empty() || newPattern.find_first_of(" \t") != StringRef::npos)
+            error = "expected '<old> <new>'";
+        if (error.empty() && addRule(oldPattern, newPattern, error))
+            continue;
+        errs << bufferName << ":" << lineNo << ": " << error << "\n";
+        success = false;
+    }
+    return success;
+}
+
+bool RenameMap::addRule(StringRef oldPattern, StringRef newPattern, std::string &error)
+{
+    bool generated = isGeneratedPattern(newPattern);
+    if (!isValidPattern(oldPattern) || (!generated && !isValidPattern(newPattern)))
+    {
+        error = ("invalid rule '" + oldPattern + " " + newPattern + "'").str();
+        return false;
+    }
+    //* 个数必须一致，否则多个旧名会映射到同一个新名；生成的新名由整个旧名决定
+    if (!generated && oldPattern.count('*') != newPattern.count('*'))
+    {
+        error = ("rule '" + oldPattern + " " + newPattern + "' maps several names to one").str();
+        return false;
+    }
+
+    if (!oldPattern.contains('*'))
+    {
+        if (!exactNames.try_emplace(oldPattern, saver.save(newPattern)).second)
+        {
+            error = ("duplicate name '" + oldPattern + "'").str();
+            return false;
+        }
+        generatedRuleCount += generated;
+        return true;
+    }
+
+    StringRef prefix = oldPattern.drop_back();
+    if (oldPattern.count('*') == 1 && oldPattern.endswith("*") && (generated || newPattern.endswith("*")))
+    {
+        StringRef newPrefix = generated ? newPattern : newPattern.drop_back();
+        if (!prefixRules.try_emplace(prefix, saver.save(newPrefix)).second)
+        {
+            error = ("duplicate prefix rule '" + oldPattern + "'").str();
+            return false;
+        }
+        auto pos = std::lower_bound(prefixLengths.begin(), prefixLengths.end(), prefix.size(), std::greater<size_t>());
+        if (pos == prefixLengths.end() || *pos != prefix.size())
+            prefixLengths.insert(pos, prefix.size());
+        generatedRuleCount += generated;
+        return true;
+    }
+
+    StringRef pattern = saver.save(oldPattern);
+    StringRef literalPrefix = pattern.take_front(pattern.find('*'));
+    StringRef literalSuffix = pattern.drop_front(pattern.rfind('*') + 1);
+    globRules.push_back({pattern, saver.save(newPattern), literalPrefix, literalSuffix});
+    generatedRuleCount += generated;
+    return true;
+}
+
+void RenameMap::getExplicitNames(std::vector<StringRef> &names) const
+{
+    for (const auto &entry : exactNames)
+    {
+        names.push_back(entry.first());
+        if (!entry.second.startswith("@"))
+            names.push_back(entry.second);
+    }
+}
+
+bool RenameMap::getLiteralKeys(std::vector<StringRef> &exactKeys, std::vector<StringRef> &patternKeys) const
+{
+    bool anchored = true;
+    for (const auto &entry : exactNames)
+        exactKeys.push_back(entry.first());
+    for (const auto &entry : prefixRules)
+    {
+        if (entry.first().empty())
+            anchored = false;
+        else
+            patternKeys.push_back(entry.first());
+    }
+    for (const GlobRule &rule : globRules)
+    {
+        SmallVector<StringRef, 4> parts;
+        rule.pattern.split(parts, '*', -1, /*KeepEmpty=*/false);
+        if (parts.empty())
+        {
+            anchored = false;
+            continue;
+        }
+        patternKeys.push_back(*std::max_element(parts.begin(), parts.end(), [](StringRef a, StringRef b) {
+            return a.size() < b.size();
+        }));
+    }
+    return anchored;
+}
+
+StringRef RenameMap::lookup(StringRef name, SmallVectorImpl<char> &scratch, unsigned attempt) const
+{
+    //@ 规则：按整个旧名生成，没有生成器时不改名
+    auto generate = [&](StringRef replacement) -> StringRef {
+        if (!generator)
+            return StringRef();
+        return generator->generate(name, replacement.drop_front(), scratch, attempt);
+    };
+
+    auto exact = exactNames.find(name);
+    if (exact != exactNames.end())
+        return exact->second.startswith("@") ? generate(exact->second) : exact->second;
+
+    for (size_t length : prefixLengths)
+    {
+        if (length > name.size())
+            continue;
+        auto prefix = prefixRules.find(name.take_front(length));
+        if (prefix == prefixRules.end())
+            continue;
+        if (prefix->second.startswith("@"))
+            return generate(prefix->second);
+        scratch.assign(prefix->second.begin(), prefix->second.end());
+        scratch.append(name.begin() + length, name.end());
+        return StringRef(scratch.data(), scratch.size());
+    }
+
+    SmallVector<StringRef, 4> captures;
+    for (const GlobRule &rule : globRules)
+    {
+        if (!name.startswith(rule.literalPrefix) || !name.endswith(rule.literalSuffix))
+            continue;
+        captures.clear();
+        if (!matchGlob(rule.pattern, name, captures))
+            continue;
+        if (rule.replacement.startswith("@"))
+            return generate(rule.replacement);
+        scratch.clear();
+        size_t captureIndex = 0;
+        for (char c : rule.replacement)
+        {
+            if (c == '*')
+            {
+                StringRef capture = captures[captureIndex++];
+                scratch.append(capture.begin(), capture.end());
+            }
+            else
+                scratch.push_back(c);
+        }
+        return StringRef(scratch.data(), scratch.size());
+    }
+    return StringRef();
+}
@@ -0,0 +1,97 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/raw_ostream.h"
+
+class NameGenerator;
+
+// 重命名表：精确名、前缀规则、通配规则
+//
+// 文件格式，每行 "旧名 新名"，# 开头为注释：
+//   DemoViewController  NewViewController    精确匹配
+//   XYZ*                ABC*                 前缀替换
+//   *Cell               Q*Item               通配，新名中的 * 依次代入旧名中 * 匹配到的部分
+//   XYZ*                @QX                  新名由 NameGenerator 按整个旧名生成，@ 后为可选的新名前缀
+//
+// 优先级：精确匹配 > 最长前缀 > 文件中先出现的通配规则。
+// 加载完成后只读，可被多个线程同时查询。
+class RenameMap
+{
+public:
+    RenameMap() = default;
+    RenameMap(const RenameMap &) = delete;
+    RenameMap &operator=(const RenameMap &) = delete;
+
+    bool loadFile(llvm::StringRef path, llvm::raw_ostream &errs);
+    bool loadBuffer(llvm::StringRef content, llvm::StringRef bufferName, llvm::raw_ostream &errs);
+    bool addRule(llvm::StringRef oldPattern, llvm::StringRef newPattern, std::string &error);
+
+    //@ 规则使用的生成器，须在查询前设置
+    void setNameGenerator(const NameGenerator *aGenerator) { generator = aGenerator; }
+    bool hasGeneratedRules() const { return generatedRuleCount != 0; }
+
+    //返回新名，不需要重命名时返回空。精确匹配直接返回表内的字符串，
+    //前缀/通配/@ 规则的结果写入 scratch，均不产生堆分配(scratch 足够大时)。
+    //attempt 只对 @ 规则有效，见 NameGenerator::generate
+    llvm::StringRef lookup(llvm::StringRef name, llvm::SmallVectorImpl<char> &scratch, unsigned attempt = 0) const;
+
+    //精确规则中的旧名和显式新名，生成的新名不能与它们相同
+    void getExplicitNames(std::vector<llvm::StringRef> &names) const;
+
+    //字符串扫描用的字面键：精确规则的旧名(exactKeys)，前缀规则的前缀和通配规则中最长的字面部分(patternKeys)。
+    //存在没有任何字面部分的规则(如 "*")时返回 false，此时任何标识符都可能需要改名
+    bool getLiteralKeys(std::vector<llvm::StringRef> &exactKeys, std::vector<llvm::StringRef> &patternKeys) const;
+
+    size_t size() const { return exactNames.size() + prefixRules.size() + globRules.size(); }
+    bool empty() const { return size() == 0; }
+
+private:
+    struct GlobRule
+    {
+        llvm::StringRef pattern;
+        llvm::StringRef replacement;
+        //通配符前后的字面部分，用于快速排除
+        llvm::StringRef literalPrefix;
+        llvm::StringRef literalSuffix;
+    };
+
+    llvm::BumpPtrAllocator allocator;
+    llvm::StringSaver saver{allocator};
+    llvm::StringMap<llvm::StringRef> exactNames;
+    //key 为去掉 * 的前缀，value 为新前缀
+    llvm::StringMap<llvm::StringRef> prefixRules;
+    //出现过的前缀长度，从长到短
+    std::vector<size_t> prefixLengths;
+    std::vector<GlobRule> globRules;
+    const NameGenerator *generator = nullptr;
+    unsigned generatedRuleCount = 0;
+};
@@ -0,0 +1,292 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "resource_rewriter.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+namespace {
+
+//plist 中值为类名的键
+bool isClassNameKey(StringRef key)
+{
+    return StringSwitch<bool>(key)
+        .Cases("NSPrincipalClass", "NSExtensionPrincipalClass", true)
+        .Cases("UISceneClassName", "UISceneDelegateClassName", true)
+        .Default(false);
+}
+
+bool isNameChar(char c)
+{
+    return isAlnum(c) || c == '_' || c == '-' || c == ':' || c == '.';
+}
+
+// 按偏移递增地换算行列号，整个文件只前进一遍
+class LineCounter
+{
+public:
+    explicit LineCounter(StringRef aContent) : content(aContent) {}
+    void locate(size_t offset, unsigned &line, unsigned &column)
+    {
+        for (; position < offset; position++)
+        {
+            if (content[position] == '\n')
+            {
+                currentLine++;
+                lineStart = position + 1;
+            }
+        }
+        line = currentLine;
+        column = offset - lineStart + 1;
+    }
+
+private:
+    StringRef content;
+    size_t position = 0;
+    size_t lineStart = 0;
+    unsigned currentLine = 1;
+};
+
+} // namespace
+
+bool getResourceKind(StringRef path, ResourceKind &kind)
+{
+    StringRef extension = sys::path::extension(path);
+    if (extension == ".storyboard" || extension == ".xib")
+        kind = ResourceKind::InterfaceBuilder;
+    else if (extension == ".plist")
+        kind = ResourceKind::PropertyList;
+    else
+        return false;
+    return true;
+}
+
+void findClassReferences(StringRef content, ResourceKind kind, function_ref<void(const ResourceReference &)> found)
+{
+    LineCounter lines(content);
+    auto report = [&](size_t offset, size_t length) {
+        ResourceReference reference{offset, length, 0, 0};
+        lines.locate(offset, reference.line, reference.column);
+        found(reference);
+    };
+    //plist 中刚读到的 <key> 是类名键，等待紧随其后的 <string>
+    bool pendingClassKey = false;
+    size_t i = 0;
+    while (true)
+    {
+        size_t open = content.find('<', i);
+        if (open == StringRef::npos)
+            return;
+        StringRef rest = content.drop_front(open);
+        //注释、CDATA、处理指令、DOCTYPE 中的内容不是标签
+        StringRef skipTo = rest.startswith("<!--") ? "-->" : rest.startswith("<![CDATA[") ? "]]>"
+                         : rest.startswith("<?") ? "?>" : rest.startswith("<!") ? ">" : "";
+        if (!skipTo.empty())
+        {
+            size_t end = content.find(skipTo, open + 2);
+            if (end == StringRef::npos)
+                return;
+            i = end + skipTo.size();
+            continue;
+        }
+
+        size_t j = open + 1;
+        bool closing = j < content.size() && content[j] == '/';
+        if (closing)
+            j++;
+        size_t nameStart = j;
+        while (j < content.size() && isNameChar(content[j]))
+            j++;
+        StringRef tagName = content.slice(nameStart, j);
+        //属性：名字 = "值" 或 '值'，值中可以出现 >
+        while (j < content.size() && content[j] != '>')
+        {
+            if (isSpace(content[j]) || content[j] == '/')
+            {
+                j++;
+                continue;
+            }
+            size_t attributeStart = j;
+            while (j < content.size() && isNameChar(content[j]))
+                j++;
+            StringRef attributeName = content.slice(attributeStart, j);
+            if (attributeName.empty())
+            {
+                j++;
+                continue;
+            }
+            while (j < content.size() && isSpace(content[j]))
+                j++;
+            if (j >= content.size() || content[j] != '=')
+                continue;
+            j++;
+            while (j < content.size() && isSpace(content[j]))
+                j++;
+            if (j >= content.size() || (content[j] != '"' && content[j] != '\''))
+                continue;
+            size_t valueEnd = content.find(content[j], j + 1);
+            if (valueEnd == StringRef::npos)
+                return;
+            if (kind == ResourceKind::InterfaceBuilder && attributeName == "customClass" && valueEnd > j + 1)
+                report(j + 1, valueEnd - j - 1);
+            j = valueEnd + 1;
+        }
+        if (j >= content.size())
+            return;
+        i = j + 1;
+        bool selfClosing = content[j - 1] == '/';
+        if (kind != ResourceKind::PropertyList || closing)
+            continue;
+
+        //元素的文本内容到下一个 < 为止，首尾空白不算
+        size_t textEnd = content.find('<', i);
+        if (textEnd == StringRef::npos)
+            textEnd = content.size();
+        StringRef text = selfClosing ? StringRef() : content.slice(i, textEnd);
+        size_t leading = text.size() - text.ltrim().size();
+        text = text.trim();
+        if (tagName == "key")
+        {
+            pendingClassKey = isClassNameKey(text);
+            continue;
+        }
+        if (tagName == "string" && pendingClassKey && !text.empty())
+            report(i + leading, text.size());
+        pendingClassKey = false;
+    }
+}
+
+ResourceRewriter::ResourceRewriter(const RenameMap &aRenameMap, unsigned aJobs)
+: renameMap(aRenameMap)
+, jobs(aJobs)
+{
+}
+
+bool ResourceRewriter::collect(ArrayRef<std::string> paths, std::vector<std::string> &files, raw_ostream &errs) const
+{
+    ResourceKind kind;
+    for (const std::string &path : paths)
+    {
+        if (!sys::fs::is_directory(path))
+        {
+            if (!sys::fs::exists(path))
+            {
+                errs << "resource not found: " << path << "\n";
+                return false;
+            }
+            files.push_back(getNormalizedAbsolutePath(path));
+            continue;
+        }
+        std::error_code ec;
+        for (sys::fs::recursive_directory_iterator it(path, ec), end; it != end && !ec; it.increment(ec))
+        {
+            if (getResourceKind(it->path(), kind) && sys::fs::is_regular_file(it->path()))
+                files.push_back(getNormalizedAbsolutePath(it->path()));
+        }
+        if (ec)
+        {
+            errs << "cannot list " << path << ": " << ec.message() << "\n";
+            return false;
+        }
+    }
+    llvm::sort(files);
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return true;
+}
+
+unsigned ResourceRewriter::run(ArrayRef<std::string> files, std::vector<TUResult> &results, size_t &renamed,
+                               raw_ostream &errs) const
+{
+    results.clear();
+    results.resize(files.size());
+    std::atomic<size_t> renamedCount(0);
+    std::vector<std::string> errors(files.size());
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            pool.async([&, i]() {
+                const std::string &file = files[i];
+                TUResult &result = results[i];
+                result.mainFile = file;
+                ResourceKind kind;
+                if (!getResourceKind(file, kind))
+                {
+                    errors[i] = "not a .storyboard, .xib or .plist file: " + file;
+                    return;
+                }
+                //大文件由 MemoryBuffer 直接 mmap
+                ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(file, /*IsText=*/false,
+                                                                                      /*RequiresNullTerminator=*/false);
+                if (!buffer)
+                {
+                    errors[i] = "cannot read " + file + ": " + buffer.getError().message();
+                    return;
+                }
+                StringRef content = (*buffer)->getBuffer();
+                if (content.startswith("bplist"))
+                    return;
+                SmallString<64> scratch;
+                findClassReferences(content, kind, [&](const ResourceReference &reference) {
+                    StringRef oldName = content.substr(reference.offset, reference.length);
+                    StringRef newName = renameMap.lookup(oldName, scratch);
+                    if (newName.empty())
+                        return;
+                    result.edits[file].insert(tooling::Replacement(file, reference.offset, reference.length, newName));
+                    ManifestRecord record;
+                    record.kind = kind == ResourceKind::InterfaceBuilder ? rename_manifest::EK_CustomClass
+                                                                         : rename_manifest::EK_PlistClass;
+                    record.oldName = oldName.str();
+                    record.newName = newName.str();
+                    record.file = file;
+                    record.line = reference.line;
+                    record.column = reference.column;
+                    result.renames.push_back(std::move(record));
+                    renamedCount++;
+                });
+            });
+        }
+        pool.wait();
+    }
+    unsigned errorCount = 0;
+    for (const std::string &error : errors)
+    {
+        if (!error.empty())
+        {
+            errs << error << "\n";
+            errorCount++;
+        }
+    }
+    renamed = renamedCount;
+    return errorCount;
+}
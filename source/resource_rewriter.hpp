@@ -0,0 +1,72 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "objc_obfuscator.hpp"
+
+// Interface Builder 与 plist 资源中的类名(--resource)
+//
+// .storyboard/.xib 中元素的 customClass 属性；XML plist 中 NSPrincipalClass、NSExtensionPrincipalClass、
+// UISceneClassName、UISceneDelegateClassName 键对应的 <string> 值。文件映射到内存后单遍扫描，
+// 区分标签、属性值、文本、注释、CDATA 和处理指令，只看上述属性和键，不构建 DOM。
+// 二进制 plist 不处理。
+enum class ResourceKind
+{
+    InterfaceBuilder,
+    PropertyList,
+};
+
+//按扩展名判断，.storyboard/.xib/.plist 以外返回 false
+bool getResourceKind(StringRef path, ResourceKind &kind);
+
+struct ResourceReference
+{
+    size_t offset;
+    size_t length;
+    unsigned line;
+    unsigned column;
+};
+
+//content 中所有类名引用的位置，按出现顺序给出；是否改名由调用方决定
+void findClassReferences(StringRef content, ResourceKind kind, function_ref<void(const ResourceReference &)> found);
+
+// 用与源码相同的重命名表并行改写资源文件；每个文件的编辑和清单放在一个 TUResult 中，
+// 与各TU的结果一起合并、检查冲突、写出
+class ResourceRewriter
+{
+public:
+    ResourceRewriter(const RenameMap &aRenameMap, unsigned aJobs);
+
+    //paths 中的文件直接加入，目录递归查找 .storyboard/.xib/.plist；结果排序去重
+    bool collect(ArrayRef<std::string> paths, std::vector<std::string> &files, raw_ostream &errs) const;
+    //renamed 为改写的类名个数；返回无法处理的文件个数，不为 0 时改写不完整，调用方不应写出任何文件
+    unsigned run(ArrayRef<std::string> files, std::vector<TUResult> &results, size_t &renamed, raw_ostream &errs) const;
+
+private:
+    const RenameMap &renameMap;
+    unsigned jobs;
+};
@@ -0,0 +1,169 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "run_stats.hpp"
+#include "atomic_file.hpp"
+#include "objc_obfuscator.hpp"
+
+#include <atomic>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/TimeProfiler.h"
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+using namespace llvm;
+
+static std::atomic<bool> traceEnabled(false);
+static unsigned traceGranularity = 500;
+
+const char *getHandlerName(HandlerKind kind)
+{
+    static const char *const names[HK_Count] = {
+        "interface", "implementation", "category", "category-impl", "message", "cast",
+        "literal", "typedef", "var", "ivar", "property", "method",
+    };
+    return kind < HK_Count ? names[kind] : "";
+}
+
+RunPhases::Scope::Scope(RunPhases &aPhases, StringRef aName)
+: phases(aPhases)
+, name(aName.str())
+, start(std::chrono::steady_clock::now())
+{
+    timeTraceProfilerBegin(name, StringRef());
+}
+
+RunPhases::Scope::~Scope()
+{
+    timeTraceProfilerEnd();
+    phases.phases.emplace_back(name, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+uint64_t getCurrentRSS()
+{
+#if defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+        return info.resident_size;
+#elif defined(__linux__)
+    //statm 的第二项为常驻页数
+    ErrorOr<std::unique_ptr<MemoryBuffer>> statm = MemoryBuffer::getFileAsStream("/proc/self/statm");
+    uint64_t pages;
+    Expected<unsigned> pageSize = sys::Process::getPageSize();
+    if (statm && pageSize && !(*statm)->getBuffer().split(' ').second.split(' ').first.getAsInteger(10, pages))
+        return pages * *pageSize;
+    consumeError(pageSize.takeError());
+#endif
+    return sys::Process::GetMallocUsage();
+}
+
+void printRunStats(raw_ostream &os, ArrayRef<TUResult> results, const RunPhases &phases)
+{
+    os << format("%-40s %9s %9s %9s %9s %8s %8s\n", "TU", "total(ms)", "parse(ms)", "match(ms)", "rewrite", "rewrites", "rss(MB)");
+    TUStats total;
+    for (const TUResult &result : results)
+    {
+        double parse = std::max(0.0, result.totalSeconds - result.traversalSeconds);
+        double match = std::max(0.0, result.traversalSeconds - result.rewriteSeconds);
+        os << format("%-40s %9.2f %9.2f %9.2f %9.2f %8zu %8.1f%s\n", sys::path::filename(result.mainFile).str().c_str(),
+                     result.totalSeconds * 1e3, parse * 1e3, match * 1e3, result.rewriteSeconds * 1e3,
+                     result.renames.size(), result.stats.rssBytes / 1048576.0, result.fromCache ? " (cached)" : "");
+        for (unsigned kind = 0; kind < HK_Count; kind++)
+        {
+            total.matchHits[kind] += result.stats.matchHits[kind];
+            total.handlerHits[kind] += result.stats.handlerHits[kind];
+            total.handlerSeconds[kind] += result.stats.handlerSeconds[kind];
+        }
+        total.classifyCalls += result.stats.classifyCalls;
+        total.classifySeconds += result.stats.classifySeconds;
+        total.typeLocCalls += result.stats.typeLocCalls;
+        total.typeLocSeconds += result.stats.typeLocSeconds;
+        total.rssBytes = std::max(total.rssBytes, result.stats.rssBytes);
+    }
+
+    os << format("\n%-16s %10s %10s %10s\n", "handler", "matched", "handled", "time(ms)");
+    for (unsigned kind = 0; kind < HK_Count; kind++)
+    {
+        os << format("%-16s %10llu %10llu %10.2f\n", getHandlerName(HandlerKind(kind)),
+                     (unsigned long long)total.matchHits[kind], (unsigned long long)total.handlerHits[kind],
+                     total.handlerSeconds[kind] * 1e3);
+    }
+    os << format("%-16s %10llu %10s %10.2f\n", "isUserSourceDecl", (unsigned long long)total.classifyCalls, "",
+                 total.classifySeconds * 1e3);
+    os << format("%-16s %10llu %10s %10.2f\n", "handleTypeLoc", (unsigned long long)total.typeLocCalls, "",
+                 total.typeLocSeconds * 1e3);
+    os << format("peak rss at end of traversal: %.1f MB\n", total.rssBytes / 1048576.0);
+
+    os << "\nphases:\n";
+    for (const auto &phase : phases.get())
+        os << format("  %-16s %10.2f ms\n", phase.first.c_str(), phase.second * 1e3);
+}
+
+void enableTrace(unsigned granularityMicroseconds)
+{
+    traceGranularity = granularityMicroseconds;
+    traceEnabled = true;
+    timeTraceProfilerInitialize(traceGranularity, "MyClangTool");
+}
+
+bool isTraceEnabled()
+{
+    return traceEnabled;
+}
+
+bool writeTrace(StringRef path, raw_ostream &errs)
+{
+    bool written = writeFileAtomically(path, [](raw_ostream &os) { timeTraceProfilerWrite(os); }, errs);
+    timeTraceProfilerCleanup();
+    return written;
+}
+
+TraceTaskScope::TraceTaskScope(StringRef name, StringRef detail)
+{
+    if (!traceEnabled)
+        return;
+    if (!timeTraceProfilerEnabled())
+    {
+        timeTraceProfilerInitialize(traceGranularity, "MyClangTool");
+        ownsProfiler = true;
+    }
+    timeTraceProfilerBegin(name, detail);
+    active = true;
+}
+
+TraceTaskScope::~TraceTaskScope()
+{
+    if (!active)
+        return;
+    timeTraceProfilerEnd();
+    if (ownsProfiler)
+        timeTraceProfilerFinishThread();
+}
@@ -0,0 +1,154 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+struct TUResult;
+
+// 各 handle 函数，--stats 分别统计命中次数和耗时
+enum HandlerKind : unsigned
+{
+    HK_Interface,
+    HK_Implementation,
+    HK_Category,
+    HK_CategoryImpl,
+    HK_Message,
+    HK_Cast,
+    HK_Literal,
+    HK_Typedef,
+    HK_Var,
+    HK_Ivar,
+    HK_Property,
+    HK_Method,
+    HK_Count,
+};
+
+const char *getHandlerName(HandlerKind kind);
+
+// 单个TU的统计，只在 --stats 时填充
+struct TUStats
+{
+    //匹配器/visitor 到达的节点数
+    uint64_t matchHits[HK_Count] = {};
+    //通过用户源码过滤、进入 handle 函数的次数及耗时
+    uint64_t handlerHits[HK_Count] = {};
+    double handlerSeconds[HK_Count] = {};
+    //isUserSourceDecl
+    uint64_t classifyCalls = 0;
+    double classifySeconds = 0;
+    //handleTypeLoc(最外层调用)
+    uint64_t typeLocCalls = 0;
+    double typeLocSeconds = 0;
+    //遍历结束时(AST 仍在内存中)进程的常驻内存，多线程时为整个进程的值
+    uint64_t rssBytes = 0;
+};
+
+// 计数并累加耗时；count 和 seconds 为空时不读时钟，未开启统计时只有一次判断
+class StatsTimer
+{
+public:
+    StatsTimer(uint64_t *aCount, double *aSeconds)
+    : seconds(aSeconds)
+    {
+        if (aCount)
+            ++*aCount;
+        if (seconds)
+            start = std::chrono::steady_clock::now();
+    }
+    StatsTimer(TUStats *stats, HandlerKind kind)
+    : StatsTimer(stats ? &stats->handlerHits[kind] : nullptr, stats ? &stats->handlerSeconds[kind] : nullptr)
+    {
+    }
+    StatsTimer(const StatsTimer &) = delete;
+    StatsTimer &operator=(const StatsTimer &) = delete;
+    ~StatsTimer()
+    {
+        if (seconds)
+            *seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    double *seconds;
+    std::chrono::steady_clock::time_point start;
+};
+
+// 主流程各阶段(加载、解析、合并、写出...)的墙钟时间，同时作为 time-trace 中的区段
+class RunPhases
+{
+public:
+    class Scope
+    {
+    public:
+        Scope(RunPhases &aPhases, llvm::StringRef aName);
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+        ~Scope();
+
+    private:
+        RunPhases &phases;
+        std::string name;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    const std::vector<std::pair<std::string, double>> &get() const { return phases; }
+
+private:
+    std::vector<std::pair<std::string, double>> phases;
+};
+
+//当前进程的常驻内存(字节)，不支持的平台返回 malloc 的用量
+uint64_t getCurrentRSS();
+
+//--stats 的报告：每个TU的阶段耗时、改写数和内存，各 handle 函数的合计，以及主流程各阶段
+void printRunStats(llvm::raw_ostream &os, llvm::ArrayRef<TUResult> results, const RunPhases &phases);
+
+// Chrome trace(time-trace)输出
+//
+// 开启后主线程和每个任务各自持有一个 TimeTraceProfiler，clang 自身的 -ftime-trace 区段
+// (Frontend、ParseClass...)也会记录在所在任务下，结束时合并写成一个 JSON。
+// 未开启时 TimeTraceScope 只有一次判断。
+void enableTrace(unsigned granularityMicroseconds);
+bool isTraceEnabled();
+bool writeTrace(llvm::StringRef path, llvm::raw_ostream &errs);
+
+// 线程池中的任务：在工作线程上开启 profiler，任务结束后交给全局列表
+class TraceTaskScope
+{
+public:
+    TraceTaskScope(llvm::StringRef name, llvm::StringRef detail);
+    TraceTaskScope(const TraceTaskScope &) = delete;
+    TraceTaskScope &operator=(const TraceTaskScope &) = delete;
+    ~TraceTaskScope();
+
+private:
+    bool active = false;
+    bool ownsProfiler = false;
+};
@@ -0,0 +1,388 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "server.hpp"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+
+#ifdef LLVM_ON_UNIX
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+static const char RequestMagic[] = "OBF1";
+
+#ifdef LLVM_ON_UNIX
+
+//服务逐个处理连接：请求须在此时间内收完(客户端发完后关闭写端)、结果须在此时间内发完，否则放弃该连接
+static const int RequestTimeoutSeconds = 30;
+//请求只是文件列表，超过此大小的视为无效
+static const size_t MaxRequestBytes = 64 << 20;
+
+namespace {
+
+// 关闭时自动 close 的描述符
+class SocketHandle
+{
+public:
+    explicit SocketHandle(int aFd = -1) : fd(aFd) {}
+    SocketHandle(const SocketHandle &) = delete;
+    SocketHandle &operator=(const SocketHandle &) = delete;
+    ~SocketHandle()
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+    int get() const { return fd; }
+
+private:
+    int fd;
+};
+
+bool makeAddress(llvm::StringRef socketPath, sockaddr_un &address, llvm::raw_ostream &errs)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        errs << "socket path too long: " << socketPath << "\n";
+        return false;
+    }
+    memcpy(address.sun_path, socketPath.data(), socketPath.size());
+    return true;
+}
+
+int connectTo(llvm::StringRef socketPath, llvm::raw_ostream &errs)
+{
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address, errs))
+        return -1;
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool writeAll(int fd, llvm::StringRef data)
+{
+    while (!data.empty())
+    {
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        data = data.drop_front(written);
+    }
+    return true;
+}
+
+//读到对端关闭写端为止
+bool readAll(int fd, std::string &data)
+{
+    char buffer[16384];
+    while (true)
+    {
+        ssize_t count = ::read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            return false;
+        if (count == 0)
+            return true;
+        data.append(buffer, count);
+    }
+}
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+//等待 fd 就绪；到 deadline 仍未就绪时返回 false，errno 为 ETIMEDOUT
+bool waitReady(int fd, short events, Deadline deadline)
+{
+    while (true)
+    {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0)
+        {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        pollfd entry = {fd, events, 0};
+        int ready = ::poll(&entry, 1, static_cast<int>(remaining.count()));
+        if (ready < 0 && errno == EINTR)
+            continue;
+        if (ready < 0)
+            return false;
+        if (ready > 0)
+            return true;
+    }
+}
+
+//服务端读取请求：整个请求而不是每次 read 受 deadline 限制，大小不超过 MaxRequestBytes
+bool readRequest(int fd, std::string &data, Deadline deadline)
+{
+    char buffer[16384];
+    while (true)
+    {
+        if (!waitReady(fd, POLLIN, deadline))
+            return false;
+        ssize_t count = ::read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            return false;
+        if (count == 0)
+            return true;
+        if (data.size() + count > MaxRequestBytes)
+        {
+            errno = EMSGSIZE;
+            return false;
+        }
+        data.append(buffer, count);
+    }
+}
+
+//服务端回传结果，不读取结果的客户端同样不能阻塞服务
+bool writeResponse(int fd, llvm::StringRef data, Deadline deadline)
+{
+    while (!data.empty())
+    {
+        if (!waitReady(fd, POLLOUT, deadline))
+            return false;
+        ssize_t written = ::send(fd, data.data(), data.size(), MSG_DONTWAIT);
+        if (written < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+            continue;
+        if (written <= 0)
+            return false;
+        data = data.drop_front(written);
+    }
+    return true;
+}
+
+//只接受与服务进程同一用户的连接：服务可能带着 --in-place 运行，能连上的进程就能让它改写文件
+bool isSameUser(int fd)
+{
+    uid_t uid;
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    gid_t gid;
+    if (::getpeereid(fd, &uid, &gid) != 0)
+        return false;
+#elif defined(SO_PEERCRED)
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+        return false;
+    uid = credentials.uid;
+#else
+    return false;
+#endif
+    return uid == ::geteuid();
+}
+
+//socket 文件只允许本用户访问(0600)；umask 在 bind 创建文件时生效，此时还没有其它线程
+int bindPrivate(int fd, const sockaddr_un &address)
+{
+    mode_t previousMask = ::umask(0177);
+    int result = ::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    int bindError = errno;
+    ::umask(previousMask);
+    errno = bindError;
+    return result;
+}
+
+} // namespace
+
+bool runServer(llvm::StringRef socketPath, ServerRequestHandler handler, llvm::raw_ostream &errs)
+{
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address, errs))
+        return false;
+    //客户端中途断开时 write 返回错误而不是终止进程
+    ::signal(SIGPIPE, SIG_IGN);
+    SocketHandle listener(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (listener.get() < 0)
+    {
+        errs << "cannot create socket: " << strerror(errno) << "\n";
+        return false;
+    }
+    if (bindPrivate(listener.get(), address) != 0)
+    {
+        //上次的服务异常退出时留下的 socket 文件连不上，删除后重试；能连上说明服务仍在运行
+        int bindError = errno;
+        SocketHandle existing(bindError == EADDRINUSE ? connectTo(socketPath, errs) : -1);
+        if (bindError != EADDRINUSE || existing.get() >= 0)
+        {
+            errs << "cannot listen on " << socketPath << ": "
+                 << (existing.get() >= 0 ? "a server is already running" : strerror(bindError)) << "\n";
+            return false;
+        }
+        llvm::sys::fs::remove(socketPath);
+        if (bindPrivate(listener.get(), address) != 0)
+        {
+            errs << "cannot listen on " << socketPath << ": " << strerror(errno) << "\n";
+            return false;
+        }
+    }
+    if (::listen(listener.get(), 16) != 0)
+    {
+        errs << "cannot listen on " << socketPath << ": " << strerror(errno) << "\n";
+        llvm::sys::fs::remove(socketPath);
+        return false;
+    }
+    errs << "serving on " << socketPath << "\n";
+
+    bool running = true;
+    while (running)
+    {
+        SocketHandle connection(::accept(listener.get(), nullptr, nullptr));
+        if (connection.get() < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            errs << "accept failed: " << strerror(errno) << "\n";
+            break;
+        }
+        if (!isSameUser(connection.get()))
+        {
+            errs << "rejected a connection from another user\n";
+            continue;
+        }
+        std::string request;
+        if (!readRequest(connection.get(), request, std::chrono::steady_clock::now() + std::chrono::seconds(RequestTimeoutSeconds)))
+        {
+            errs << "dropped a connection: "
+                 << (errno == ETIMEDOUT ? "request not received within the timeout"
+                     : errno == EMSGSIZE ? "request too large" : strerror(errno)) << "\n";
+            continue;
+        }
+
+        llvm::SmallVector<llvm::StringRef, 64> lines;
+        llvm::StringRef(request).split(lines, '\n', -1, /*KeepEmpty=*/false);
+        std::string response;
+        llvm::raw_string_ostream out(response);
+        int code = 1;
+        if (lines.empty() || lines[0] != RequestMagic)
+        {
+            out << "malformed request\n";
+        }
+        else if (lines.size() == 2 && lines[1] == "shutdown")
+        {
+            out << "server on " << socketPath << " shutting down\n";
+            code = 0;
+            running = false;
+        }
+        else
+        {
+            std::vector<std::string> files;
+            bool valid = true;
+            for (llvm::StringRef line : llvm::makeArrayRef(lines).drop_front())
+            {
+                if (!line.consume_front("file "))
+                {
+                    out << "malformed request line: " << line << "\n";
+                    valid = false;
+                    break;
+                }
+                files.push_back(line.str());
+            }
+            if (valid)
+                code = handler(files, out);
+        }
+        out << "exit " << code << "\n";
+        if (!writeResponse(connection.get(), out.str(), std::chrono::steady_clock::now() + std::chrono::seconds(RequestTimeoutSeconds)))
+            errs << "could not send the result: " << (errno == ETIMEDOUT ? "client stopped reading" : strerror(errno)) << "\n";
+    }
+    llvm::sys::fs::remove(socketPath);
+    return true;
+}
+
+int runClient(llvm::StringRef socketPath, llvm::ArrayRef<std::string> files, bool shutdown, llvm::raw_ostream &out)
+{
+    SocketHandle connection(connectTo(socketPath, out));
+    if (connection.get() < 0)
+    {
+        out << "cannot connect to " << socketPath << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    std::string request = std::string(RequestMagic) + "\n";
+    if (shutdown)
+        request += "shutdown\n";
+    for (const std::string &file : files)
+    {
+        //服务的工作目录与客户端不同，统一发送绝对路径
+        llvm::SmallString<256> path(file);
+        llvm::sys::fs::make_absolute(path);
+        request += "file ";
+        request += path.str();
+        request += "\n";
+    }
+    std::string response;
+    if (!writeAll(connection.get(), request) || ::shutdown(connection.get(), SHUT_WR) != 0 ||
+        !readAll(connection.get(), response))
+    {
+        out << "lost connection to " << socketPath << "\n";
+        return 1;
+    }
+    llvm::StringRef text(response);
+    text.consume_back("\n");
+    size_t lastLine = text.rfind('\n');
+    llvm::StringRef status = lastLine == llvm::StringRef::npos ? text : text.substr(lastLine + 1);
+    int code;
+    if (!status.consume_front("exit ") || status.getAsInteger(10, code))
+    {
+        out << "malformed response from " << socketPath << "\n";
+        return 1;
+    }
+    out << text.take_front(lastLine == llvm::StringRef::npos ? 0 : lastLine + 1);
+    return code;
+}
+
+#else
+
+bool runServer(llvm::StringRef socketPath, ServerRequestHandler handler, llvm::raw_ostream &errs)
+{
+    errs << "--serve needs Unix domain sockets, which this platform does not provide\n";
+    return false;
+}
+
+int runClient(llvm::StringRef socketPath, llvm::ArrayRef<std::string> files, bool shutdown, llvm::raw_ostream &out)
+{
+    out << "--connect needs Unix domain sockets, which this platform does not provide\n";
+    return 1;
+}
+
+#endif
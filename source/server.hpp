@@ -0,0 +1,45 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+// 常驻服务(--serve)与客户端(--connect)之间的行协议，走本地 Unix socket
+//
+// 请求："OBF1\n"，随后每个源文件一行 "file <绝对路径>\n"；或 "OBF1\nshutdown\n" 让服务退出。
+// 客户端发送完请求即关闭写端。响应为处理过程的输出文本，最后一行为 "exit <退出码>\n"。
+// 服务按到达顺序逐个处理请求，同一时刻只有一个请求在运行。
+
+//处理一个请求：files 为客户端给出的源文件，输出写入 out，返回退出码
+typedef llvm::function_ref<int(llvm::ArrayRef<std::string> files, llvm::raw_ostream &out)> ServerRequestHandler;
+
+//监听 socketPath 直到收到 shutdown 请求；无法监听时返回 false
+bool runServer(llvm::StringRef socketPath, ServerRequestHandler handler, llvm::raw_ostream &errs);
+//发送请求并把响应中的输出写到 out，返回服务给出的退出码；无法连接时返回 1
+int runClient(llvm::StringRef socketPath, llvm::ArrayRef<std::string> files, bool shutdown, llvm::raw_ostream &out);
@@ -0,0 +1,97 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "shard.hpp"
+
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
+
+bool parseShardSpec(StringRef text, ShardSpec &spec)
+{
+    StringRef index, count;
+    std::tie(index, count) = text.split('/');
+    return !index.getAsInteger(10, spec.index) && !count.getAsInteger(10, spec.count) && spec.count > 0 &&
+           spec.index < spec.count;
+}
+
+std::vector<std::string> selectShard(ArrayRef<std::string> files, const ShardSpec &spec)
+{
+    std::vector<std::string> sorted;
+    sorted.reserve(files.size());
+    for (const std::string &file : files)
+    {
+        sorted.push_back(getNormalizedAbsolutePath(file));
+    }
+    llvm::sort(sorted);
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<std::string> selected;
+    for (size_t i = spec.index; i < sorted.size(); i += spec.count)
+    {
+        selected.push_back(std::move(sorted[i]));
+    }
+    return selected;
+}
+
+bool loadShardOutput(StringRef path, TUResult &result, raw_ostream &errs)
+{
+    result.mainFile = path.str();
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+    {
+        errs << "cannot read " << path << ": " << buffer.getError().message() << "\n";
+        return false;
+    }
+    if ((*buffer)->getBuffer().startswith(StringRef(rename_manifest::Magic, sizeof(rename_manifest::Magic))))
+    {
+        std::unique_ptr<RenameManifest> manifest = RenameManifest::load(path, errs);
+        if (!manifest)
+            return false;
+        for (const rename_manifest::Entry &entry : manifest->entries())
+        {
+            ManifestRecord record;
+            record.kind = static_cast<rename_manifest::EntryKind>(static_cast<uint32_t>(entry.kind));
+            record.oldName = manifest->getString(entry.oldName).str();
+            record.newName = manifest->getString(entry.newName).str();
+            record.file = manifest->getString(entry.file).str();
+            record.line = entry.line;
+            record.column = entry.column;
+            result.renames.push_back(std::move(record));
+        }
+        return true;
+    }
+
+    TranslationUnitReplacements replacements;
+    yaml::Input yaml((*buffer)->getBuffer());
+    yaml >> replacements;
+    if (yaml.error())
+    {
+        errs << path << " is neither a binary manifest nor a YAML replacement file: " << yaml.error().message() << "\n";
+        return false;
+    }
+    for (const tooling::Replacement &replacement : replacements.Replacements)
+    {
+        result.edits[replacement.getFilePath().str()].insert(replacement);
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "objc_obfuscator.hpp"
+
+// 多机分片运行(--shard=i/N)与合并(merge 子命令)
+//
+// 输入文件按规范化的绝对路径排序后轮流分给 N 个分片，只要输入相同，各机器得到的切分就相同且互不重叠。
+// 每个分片用 --export-fixes 和 --manifest-binary 输出结果，merge 读回所有分片的输出，
+// 同一头文件在多个分片中的相同编辑去重，不同编辑和新名撞名作为冲突报告。
+struct ShardSpec
+{
+    unsigned index = 0;
+    unsigned count = 1;
+};
+
+//"i/N"，0 <= i < N
+bool parseShardSpec(StringRef text, ShardSpec &spec);
+std::vector<std::string> selectShard(ArrayRef<std::string> files, const ShardSpec &spec);
+
+//读取一个分片的 --export-fixes(YAML)或 --manifest-binary 输出，按内容区分
+bool loadShardOutput(StringRef path, TUResult &result, raw_ostream &errs);
@@ -0,0 +1,203 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "shared_file_cache.hpp"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+namespace {
+
+// 引用缓存中的内容，不复制
+class SharedMemoryBuffer : public llvm::MemoryBuffer
+{
+public:
+    SharedMemoryBuffer(std::shared_ptr<const llvm::MemoryBuffer> aBuffer, llvm::StringRef aName)
+    : buffer(std::move(aBuffer))
+    , name(aName.str())
+    {
+        init(buffer->getBufferStart(), buffer->getBufferEnd(), /*RequiresNullTerminator=*/true);
+    }
+    llvm::StringRef getBufferIdentifier() const override { return name; }
+    BufferKind getBufferKind() const override { return MemoryBuffer_Malloc; }
+
+private:
+    std::shared_ptr<const llvm::MemoryBuffer> buffer;
+    std::string name;
+};
+
+// 打开时不读取，FileManager 真正需要内容时才从缓存取
+class CachedFile : public llvm::vfs::File
+{
+public:
+    CachedFile(llvm::vfs::FileSystem &aFileSystem, SharedFileCache &aCache, std::string aAbsolutePath, llvm::vfs::Status aStatus)
+    : fileSystem(aFileSystem)
+    , cache(aCache)
+    , absolutePath(std::move(aAbsolutePath))
+    , fileStatus(std::move(aStatus))
+    {
+    }
+    llvm::ErrorOr<llvm::vfs::Status> status() override { return fileStatus; }
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> getBuffer(const llvm::Twine &Name, int64_t FileSize,
+                                                                 bool RequiresNullTerminator, bool IsVolatile) override
+    {
+        auto buffer = cache.getBuffer(fileSystem, absolutePath, fileStatus);
+        if (!buffer)
+            return buffer.getError();
+        return std::unique_ptr<llvm::MemoryBuffer>(new SharedMemoryBuffer(std::move(*buffer), Name.str()));
+    }
+    std::error_code close() override { return std::error_code(); }
+
+private:
+    llvm::vfs::FileSystem &fileSystem;
+    SharedFileCache &cache;
+    std::string absolutePath;
+    llvm::vfs::Status fileStatus;
+};
+
+class CachingFileSystem : public llvm::vfs::ProxyFileSystem
+{
+public:
+    CachingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs, SharedFileCache &aCache)
+    : ProxyFileSystem(std::move(fs))
+    , cache(aCache)
+    {
+    }
+
+    llvm::ErrorOr<llvm::vfs::Status> status(const llvm::Twine &Path) override
+    {
+        llvm::SmallString<256> absolutePath;
+        Path.toVector(absolutePath);
+        if (std::error_code ec = makeAbsolute(absolutePath))
+            return ec;
+        auto result = cache.status(getUnderlyingFS(), absolutePath);
+        if (!result)
+            return result;
+        //按调用方给出的路径返回，与直接访问磁盘时一致
+        return llvm::vfs::Status::copyWithNewName(*result, Path.str());
+    }
+
+    llvm::ErrorOr<std::unique_ptr<llvm::vfs::File>> openFileForRead(const llvm::Twine &Path) override
+    {
+        llvm::SmallString<256> absolutePath;
+        Path.toVector(absolutePath);
+        if (std::error_code ec = makeAbsolute(absolutePath))
+            return ec;
+        auto result = cache.status(getUnderlyingFS(), absolutePath);
+        if (!result)
+            return result.getError();
+        if (!result->isRegularFile())
+            return getUnderlyingFS().openFileForRead(Path);
+        return std::unique_ptr<llvm::vfs::File>(new CachedFile(getUnderlyingFS(), cache, absolutePath.str().str(),
+                                                               llvm::vfs::Status::copyWithNewName(*result, Path.str())));
+    }
+
+private:
+    SharedFileCache &cache;
+};
+
+} // namespace
+
+void SharedFileCache::beginRequest()
+{
+    std::lock_guard<std::mutex> lock(statusesMutex);
+    statuses.clear();
+}
+
+llvm::ErrorOr<llvm::vfs::Status> SharedFileCache::status(llvm::vfs::FileSystem &fs, llvm::StringRef absolutePath)
+{
+    {
+        std::lock_guard<std::mutex> lock(statusesMutex);
+        auto found = statuses.find(absolutePath);
+        if (found != statuses.end())
+        {
+            statHits++;
+            return found->second;
+        }
+    }
+    //stat 在锁外进行，两个线程同时查询同一文件时结果相同，后写入的被忽略
+    llvm::ErrorOr<llvm::vfs::Status> result = fs.status(absolutePath);
+    std::lock_guard<std::mutex> lock(statusesMutex);
+    return statuses.try_emplace(absolutePath, result).first->second;
+}
+
+void SharedFileCache::eraseBuffer(llvm::StringMap<CachedBuffer>::iterator found)
+{
+    cachedBytes -= found->second.buffer->getBufferSize();
+    recentlyUsed.erase(found->second.useOrder);
+    buffers.erase(found);
+}
+
+llvm::ErrorOr<std::shared_ptr<const llvm::MemoryBuffer>> SharedFileCache::getBuffer(llvm::vfs::FileSystem &fs, llvm::StringRef absolutePath,
+                                                                                    const llvm::vfs::Status &status)
+{
+    {
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        auto found = buffers.find(absolutePath);
+        if (found != buffers.end())
+        {
+            if (found->second.modificationTime == status.getLastModificationTime() && found->second.size == status.getSize())
+            {
+                readHits++;
+                recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, found->second.useOrder);
+                return found->second.buffer;
+            }
+            //文件已变化，旧内容不再有用
+            eraseBuffer(found);
+        }
+    }
+    //用户源码可能在请求之间被改写，IsVolatile 使其读入堆内存；其余文件 mmap
+    llvm::SmallString<256> normalizedPath(absolutePath);
+    llvm::sys::path::remove_dots(normalizedPath, /*remove_dot_dot=*/true);
+    bool isVolatile = isUserPath(normalizedPath, roots);
+    auto buffer = fs.getBufferForFile(absolutePath, static_cast<int64_t>(status.getSize()),
+                                      /*RequiresNullTerminator=*/true, isVolatile);
+    if (!buffer)
+        return buffer.getError();
+    readCount++;
+    std::shared_ptr<const llvm::MemoryBuffer> shared = std::move(*buffer);
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    //两个线程同时读取同一文件时保留先写入的
+    auto inserted = buffers.try_emplace(absolutePath);
+    CachedBuffer &cached = inserted.first->second;
+    if (!inserted.second)
+        return cached.buffer;
+    cached.modificationTime = status.getLastModificationTime();
+    cached.size = status.getSize();
+    cached.buffer = shared;
+    cached.useOrder = recentlyUsed.insert(recentlyUsed.begin(), absolutePath.str());
+    cachedBytes += shared->getBufferSize();
+    //刚读入的文件不淘汰，即使它本身超过 capacity
+    while (cachedBytes > capacity && recentlyUsed.size() > 1)
+    {
+        eraseBuffer(buffers.find(recentlyUsed.back()));
+        evictions++;
+    }
+    return shared;
+}
+
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> createCachingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
+                                                                        SharedFileCache &cache)
+{
+    return llvm::makeIntrusiveRefCnt<CachingFileSystem>(std::move(fs), cache);
+}
@@ -0,0 +1,102 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include "source_classifier.hpp"
+
+// 跨请求共享的文件缓存(服务模式)
+//
+// stat 结果(含不存在的文件，头文件搜索会探测大量不存在的路径)在一次请求内由所有TU共享，
+// 每个请求开始时清空，因此磁盘上的变化在下一个请求中总能看到。文件内容跨请求保留，
+// 按本次请求 stat 得到的修改时间和大小校验，不一致时丢弃旧内容重新读取。用户源码读入堆内存，
+// 文件在请求之间被改写不会影响已缓存的内容；SDK 等非用户文件不会被改写，直接 mmap。
+// 内容总量超过 capacity 时按最近使用淘汰，正在使用的内容由持有者保留到用完。
+// 所有接口均可被多个线程同时调用。
+class SharedFileCache
+{
+public:
+    SharedFileCache(const SourceRoots &aRoots, uint64_t aCapacity)
+    : roots(aRoots)
+    , capacity(aCapacity)
+    {
+    }
+
+    //新请求开始，丢弃上次请求的 stat 结果
+    void beginRequest();
+
+    //absolutePath 的状态，本次请求中只向 fs 查询一次
+    llvm::ErrorOr<llvm::vfs::Status> status(llvm::vfs::FileSystem &fs, llvm::StringRef absolutePath);
+    //absolutePath 的内容(以 \0 结尾)，status 须为本次请求中该文件的状态
+    llvm::ErrorOr<std::shared_ptr<const llvm::MemoryBuffer>> getBuffer(llvm::vfs::FileSystem &fs, llvm::StringRef absolutePath,
+                                                                       const llvm::vfs::Status &status);
+
+    unsigned getStatHits() const { return statHits; }
+    unsigned getReadHits() const { return readHits; }
+    unsigned getReadCount() const { return readCount; }
+    unsigned getEvictions() const { return evictions; }
+
+private:
+    struct CachedBuffer
+    {
+        llvm::sys::TimePoint<> modificationTime;
+        uint64_t size = 0;
+        std::shared_ptr<const llvm::MemoryBuffer> buffer;
+        //在 recentlyUsed 中的位置
+        std::list<std::string>::iterator useOrder;
+    };
+
+    //调用方持有 buffersMutex
+    void eraseBuffer(llvm::StringMap<CachedBuffer>::iterator found);
+
+    const SourceRoots &roots;
+    const uint64_t capacity;
+    std::mutex statusesMutex;
+    llvm::StringMap<llvm::ErrorOr<llvm::vfs::Status>> statuses;
+    std::mutex buffersMutex;
+    llvm::StringMap<CachedBuffer> buffers;
+    //最近使用的在前
+    std::list<std::string> recentlyUsed;
+    uint64_t cachedBytes = 0;
+    std::atomic<unsigned> statHits{0};
+    std::atomic<unsigned> readHits{0};
+    std::atomic<unsigned> readCount{0};
+    std::atomic<unsigned> evictions{0};
+};
+
+//经 cache 访问 fs 的 VFS；工作目录等其余操作直接转给 fs，每个线程可以各自创建
+llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> createCachingFileSystem(llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> fs,
+                                                                        SharedFileCache &cache);
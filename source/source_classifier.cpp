@@ -0,0 +1,103 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "source_classifier.hpp"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Path.h"
+
+using namespace clang;
+
+SourceClassifier::SourceClassifier(const SourceManager &aSourceManager, const SourceRoots &aRoots)
+: sourceManager(aSourceManager)
+, roots(aRoots)
+{
+}
+
+bool SourceClassifier::isUserLoc(SourceLocation loc)
+{
+    if (loc.isInvalid())
+        return false;
+    return isUserFile(sourceManager.getFileID(sourceManager.getSpellingLoc(loc)));
+}
+
+bool SourceClassifier::isUserExpansionLoc(SourceLocation loc)
+{
+    if (loc.isInvalid())
+        return false;
+    return isUserFile(sourceManager.getFileID(sourceManager.getExpansionLoc(loc)));
+}
+
+bool SourceClassifier::isUserFile(FileID fileID)
+{
+    auto cached = cache.find(fileID);
+    if (cached != cache.end())
+        return cached->second;
+    bool isUser = classify(fileID);
+    cache[fileID] = isUser;
+    return isUser;
+}
+
+bool SourceClassifier::classify(FileID fileID) const
+{
+    //内建宏、命令行等没有对应文件
+    const FileEntry *entry = sourceManager.getFileEntryForID(fileID);
+    if (!entry)
+        return false;
+    //-isystem、--sysroot 引入的头文件
+    if (SrcMgr::isSystem(sourceManager.getFileCharacteristic(sourceManager.getLocForStartOfFile(fileID))))
+        return false;
+
+    llvm::SmallString<256> path(entry->getName());
+    sourceManager.getFileManager().makeAbsolutePath(path);
+    llvm::sys::path::remove_dots(path, true);
+    return isUserPath(path, roots);
+}
+
+//path 是 root 本身或位于 root 之下；/Applications/Xcode.app 不匹配 /Applications/Xcode.app.bak
+static bool isUnderRoot(llvm::StringRef path, llvm::StringRef root)
+{
+    if (!path.startswith(root))
+        return false;
+    if (path.size() == root.size() || root.empty())
+        return true;
+    return llvm::sys::path::is_separator(root.back()) || llvm::sys::path::is_separator(path[root.size()]);
+}
+
+bool isUserPath(llvm::StringRef absolutePath, const SourceRoots &roots)
+{
+    for (const std::string &root : roots.systemRoots)
+    {
+        if (isUnderRoot(absolutePath, root))
+            return false;
+    }
+    for (const std::string &dir : roots.vendorDirs)
+    {
+        for (auto it = llvm::sys::path::begin(absolutePath), end = llvm::sys::path::end(absolutePath); it != end; ++it)
+        {
+            if (*it == dir)
+                return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "clang/Basic/SourceLocation.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/DenseMap.h"
+
+// 系统/第三方源码的位置，可通过命令行配置
+struct SourceRoots
+{
+    //SDK 等系统源码所在的目录，须为去掉 . 和 .. 的绝对路径；按整级目录匹配
+    std::vector<std::string> systemRoots;
+    //第三方源码所在的目录名，路径中任意一级目录匹配即可，如 Pods
+    std::vector<std::string> vendorDirs;
+};
+
+//按路径判断：不在系统路径前缀下，也不在第三方目录中。absolutePath 须为去掉 . 和 .. 的绝对路径
+bool isUserPath(llvm::StringRef absolutePath, const SourceRoots &roots);
+
+// 判断源码是否为用户源码，结果按 FileID 缓存，每个文件每个TU只判断一次
+class SourceClassifier
+{
+public:
+    SourceClassifier(const clang::SourceManager &aSourceManager, const SourceRoots &aRoots);
+
+    //按 spelling 位置判断，宏展开时以宏所在的文件为准
+    bool isUserLoc(clang::SourceLocation loc);
+    bool isUserFile(clang::FileID fileID);
+    //按展开位置判断，用于决定是否遍历顶层声明的整个子树
+    bool isUserExpansionLoc(clang::SourceLocation loc);
+
+private:
+    bool classify(clang::FileID fileID) const;
+
+    const clang::SourceManager &sourceManager;
+    const SourceRoots &roots;
+    llvm::DenseMap<clang::FileID, bool> cache;
+};
@@ -0,0 +1,247 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "symbol_index.hpp"
+#include "atomic_file.hpp"
+#include "string_table.hpp"
+#include "name_generator.hpp"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+
+using namespace llvm;
+using namespace symbol_index;
+
+void SymbolIndexBuilder::add(const IndexCollectResult &aResult)
+{
+    for (const SymbolRecord &symbol : aResult.symbols)
+    {
+        symbolsByUSR.emplace(symbol.usr, symbol);
+    }
+    tus[aResult.mainFile].insert(aResult.referencedNames.begin(), aResult.referencedNames.end());
+    addIdentifiers(aResult.identifiers);
+}
+
+void SymbolIndexBuilder::addIdentifiers(const std::set<std::string> &someIdentifiers)
+{
+    identifiers.insert(someIdentifiers.begin(), someIdentifiers.end());
+}
+
+bool SymbolIndexBuilder::write(StringRef path, raw_ostream &errs) const
+{
+    size_t refCount = 0;
+    for (const auto &tu : tus)
+        refCount += tu.second.size();
+
+    StringTableBuilder strings;
+    std::string tables;
+    raw_string_ostream tableStream(tables);
+    support::endian::Writer writer(tableStream, support::little);
+    for (const auto &entry : symbolsByUSR)
+    {
+        const SymbolRecord &symbol = entry.second;
+        writer.write<uint32_t>(symbol.kind);
+        strings.writeRef(writer, symbol.name);
+        strings.writeRef(writer, symbol.owner);
+        strings.writeRef(writer, symbol.usr);
+        strings.writeRef(writer, symbol.file);
+    }
+    uint32_t firstRef = 0;
+    for (const auto &tu : tus)
+    {
+        strings.writeRef(writer, tu.first);
+        writer.write<uint32_t>(firstRef);
+        writer.write<uint32_t>(tu.second.size());
+        firstRef += tu.second.size();
+    }
+    for (const auto &tu : tus)
+        for (const std::string &name : tu.second)
+            strings.writeRef(writer, name);
+    for (const std::string &identifier : identifiers)
+        strings.writeRef(writer, identifier);
+    tableStream.flush();
+
+    return writeFileAtomically(path, [&](raw_ostream &os) {
+        os.write(Magic, sizeof(Magic));
+        support::endian::Writer headerWriter(os, support::little);
+        headerWriter.write<uint32_t>(Version);
+        headerWriter.write<uint32_t>(symbolsByUSR.size());
+        headerWriter.write<uint32_t>(tus.size());
+        headerWriter.write<uint32_t>(refCount);
+        headerWriter.write<uint32_t>(strings.data().size());
+        headerWriter.write<uint32_t>(identifiers.size());
+        os << tables << strings.data();
+    }, errs);
+}
+
+std::unique_ptr<SymbolIndex> SymbolIndex::load(StringRef path, raw_ostream &errs)
+{
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer =
+        MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!buffer)
+    {
+        errs << "cannot read symbol index " << path << ": " << buffer.getError().message() << "\n";
+        return nullptr;
+    }
+    StringRef data = (*buffer)->getBuffer();
+    const Header *header = reinterpret_cast<const Header *>(data.data());
+    if (data.size() < sizeof(Header) || memcmp(header->magic, Magic, sizeof(Magic)) != 0)
+    {
+        errs << path << ": not a symbol index\n";
+        return nullptr;
+    }
+    if (header->version != Version)
+    {
+        errs << path << ": unsupported symbol index version " << header->version << "\n";
+        return nullptr;
+    }
+    uint64_t symbolsSize = uint64_t(header->symbolCount) * sizeof(Symbol);
+    uint64_t tusSize = uint64_t(header->tuCount) * sizeof(TU);
+    uint64_t refsSize = uint64_t(header->refCount) * sizeof(Str);
+    uint64_t identifiersSize = uint64_t(header->identifierCount) * sizeof(Str);
+    if (sizeof(Header) + symbolsSize + tusSize + refsSize + identifiersSize + header->stringsSize != data.size())
+    {
+        errs << path << ": truncated symbol index\n";
+        return nullptr;
+    }
+
+    std::unique_ptr<SymbolIndex> index(new SymbolIndex());
+    const char *cursor = data.data() + sizeof(Header);
+    index->symbolTable = makeArrayRef(reinterpret_cast<const Symbol *>(cursor), header->symbolCount);
+    cursor += symbolsSize;
+    index->tuTable = makeArrayRef(reinterpret_cast<const TU *>(cursor), header->tuCount);
+    cursor += tusSize;
+    index->refTable = makeArrayRef(reinterpret_cast<const Str *>(cursor), header->refCount);
+    cursor += refsSize;
+    index->identifierTable = makeArrayRef(reinterpret_cast<const Str *>(cursor), header->identifierCount);
+    cursor += identifiersSize;
+    index->strings = StringRef(cursor, header->stringsSize);
+    index->buffer = std::move(*buffer);
+    return index;
+}
+
+StringRef SymbolIndex::getString(const Str &str) const
+{
+    //越界的引用按空串处理，避免损坏的索引导致越界读
+    if (uint64_t(str.offset) + str.length > strings.size())
+        return StringRef();
+    return strings.substr(str.offset, str.length);
+}
+
+bool SymbolIndex::getReferencedNames(StringRef mainFile, std::vector<StringRef> &names) const
+{
+    //TU 表按路径排序，二分查找
+    auto tu = std::lower_bound(tuTable.begin(), tuTable.end(), mainFile,
+        [this](const TU &entry, StringRef file) { return getString(entry.file) < file; });
+    if (tu == tuTable.end() || getString(tu->file) != mainFile)
+        return false;
+    if (uint64_t(tu->firstRef) + tu->refCount > refTable.size())
+        return false;
+    names.clear();
+    for (const Str &ref : refTable.slice(tu->firstRef, tu->refCount))
+        names.push_back(getString(ref));
+    return true;
+}
+
+void SymbolIndex::buildRenamePlan(const RenameMap &renameMap, RenameMap &plan) const
+{
+    //同名类只会有一个 USR；按名字排序处理，生成名的冲突处理与索引的存储顺序无关
+    std::vector<StringRef> names;
+    for (const Symbol &symbol : symbolTable)
+    {
+        if (symbol.kind == SK_Interface)
+            names.push_back(getString(symbol.name));
+    }
+    llvm::sort(names);
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    StringSet<> usedNames;
+    SmallString<64> scratch, retry;
+    std::string error;
+    for (StringRef name : names)
+    {
+        StringRef newName = renameMap.lookup(name, scratch);
+        //两个旧名生成了同一个新名：排在后面的旧名换下一个重试序号，结果确定
+        for (unsigned attempt = 1; !newName.empty() && usedNames.count(newName); attempt++)
+        {
+            StringRef next = renameMap.lookup(name, retry, attempt);
+            //显式规则给出的新名与重试序号无关，冲突留给合并阶段报告
+            if (next == newName)
+                break;
+            scratch = next;
+            newName = scratch;
+        }
+        if (newName.empty())
+            continue;
+        usedNames.insert(newName);
+        plan.addRule(name, newName, error);
+    }
+}
+
+void SymbolIndex::buildShortRenamePlan(const RenameMap &renameMap, const NameGenerator &generator, unsigned minLength,
+                                       RenameMap &plan, ShortNameStats &stats) const
+{
+    //引用计数：每个TU引用到的名字各记一次
+    StringMap<unsigned> usage;
+    for (const Str &ref : refTable)
+        usage[getString(ref)]++;
+
+    std::vector<std::pair<unsigned, StringRef>> classes;
+    SmallString<64> scratch;
+    for (const Symbol &symbol : symbolTable)
+    {
+        if (symbol.kind != SK_Interface)
+            continue;
+        StringRef name = getString(symbol.name);
+        if (!renameMap.lookup(name, scratch).empty())
+            classes.emplace_back(usage.lookup(name), name);
+    }
+    llvm::sort(classes, [](const std::pair<unsigned, StringRef> &a, const std::pair<unsigned, StringRef> &b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    classes.erase(std::unique(classes.begin(), classes.end()), classes.end());
+
+    ShortNameSequence sequence(generator, minLength);
+    std::string error;
+    for (const auto &entry : classes)
+    {
+        StringRef name = entry.second;
+        sequence.next(scratch);
+        plan.addRule(name, scratch, error);
+        stats.classCount++;
+        stats.oldBytes += name.size() + 1;
+        stats.newBytes += scratch.size() + 1;
+    }
+}
+
+bool SymbolIndex::mayReferenceAny(StringRef mainFile, const RenameMap &plan) const
+{
+    std::vector<StringRef> names;
+    if (!getReferencedNames(mainFile, names))
+        return true;
+    SmallString<64> scratch;
+    return llvm::any_of(names, [&](StringRef name) { return !plan.lookup(name, scratch).empty(); });
+}
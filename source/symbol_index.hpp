@@ -0,0 +1,175 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "rename_map.hpp"
+
+class NameGenerator;
+
+// 全局符号索引：第一阶段遍历所有TU收集，第二阶段据此生成统一的重命名计划
+//
+// 文件格式(小端)：
+//   Header
+//   Symbol[symbolCount]   按 USR 排序
+//   TU[tuCount]           按主文件路径排序
+//   Str[refCount]         每个TU引用到的名字，按TU依次存放
+//   Str[identifierCount]  所有TU中出现过、可能与短名相同的标识符，排序
+//   char[stringsSize]     字符串表，Str 为其中的 (offset, length)
+namespace symbol_index {
+
+enum SymbolKind : uint32_t
+{
+    SK_Interface = 0,
+    SK_Category = 1,
+    SK_Protocol = 2,
+};
+
+const char Magic[8] = {'O', 'B', 'F', 'S', 'Y', 'M', 'I', 'X'};
+const uint32_t Version = 2;
+
+struct Str
+{
+    llvm::support::ulittle32_t offset;
+    llvm::support::ulittle32_t length;
+};
+
+struct Header
+{
+    char magic[8];
+    llvm::support::ulittle32_t version;
+    llvm::support::ulittle32_t symbolCount;
+    llvm::support::ulittle32_t tuCount;
+    llvm::support::ulittle32_t refCount;
+    llvm::support::ulittle32_t stringsSize;
+    llvm::support::ulittle32_t identifierCount;
+};
+
+struct Symbol
+{
+    llvm::support::ulittle32_t kind;
+    Str name;
+    //分类所属的类名，其它为空
+    Str owner;
+    Str usr;
+    Str file;
+};
+
+struct TU
+{
+    Str file;
+    llvm::support::ulittle32_t firstRef;
+    llvm::support::ulittle32_t refCount;
+};
+
+} // namespace symbol_index
+
+// 收集阶段使用的符号记录
+struct SymbolRecord
+{
+    symbol_index::SymbolKind kind;
+    std::string name;
+    std::string owner;
+    std::string usr;
+    std::string file;
+};
+
+// 单个TU的收集结果
+struct IndexCollectResult
+{
+    std::string mainFile;
+    std::vector<SymbolRecord> symbols;
+    //TU 中可能被改写的名字：可见的用户类/协议名，以及用户代码中形如标识符的字符串
+    std::set<std::string> referencedNames;
+    //TU 中出现过的所有形如短名(大写字母开头、只含字母数字)的标识符，包括宏、typedef、函数、变量、
+    //枚举常量、泛型参数和 SDK 中的名字；类改成其中任何一个都可能与之冲突
+    std::set<std::string> identifiers;
+};
+
+// 汇总所有TU的收集结果并写出索引，符号按 USR 去重，输出与TU顺序无关
+class SymbolIndexBuilder
+{
+public:
+    void add(const IndexCollectResult &aResult);
+    //TU 结束时即可并入，不必保留每个TU的集合
+    void addIdentifiers(const std::set<std::string> &someIdentifiers);
+    bool write(llvm::StringRef path, llvm::raw_ostream &errs) const;
+
+private:
+    std::map<std::string, SymbolRecord> symbolsByUSR;
+    std::map<std::string, std::set<std::string>> tus;
+    std::set<std::string> identifiers;
+};
+
+// 短名计划的统计：__objc_classname 中类名字符串(含结尾的 \0)改名前后的总字节数
+struct ShortNameStats
+{
+    size_t classCount = 0;
+    uint64_t oldBytes = 0;
+    uint64_t newBytes = 0;
+};
+
+// 只读索引，文件通过 MemoryBuffer 映射到内存，不做反序列化
+class SymbolIndex
+{
+public:
+    static std::unique_ptr<SymbolIndex> load(llvm::StringRef path, llvm::raw_ostream &errs);
+
+    llvm::ArrayRef<symbol_index::Symbol> symbols() const { return symbolTable; }
+    llvm::StringRef getString(const symbol_index::Str &str) const;
+    //各TU中可能与生成的新名冲突的标识符，作为保留名
+    llvm::ArrayRef<symbol_index::Str> identifiers() const { return identifierTable; }
+
+    //返回 false 表示索引中没有这个TU
+    bool getReferencedNames(llvm::StringRef mainFile, std::vector<llvm::StringRef> &names) const;
+
+    //全局重命名计划：索引中每个用户类按 renameMap 解析一次，结果只含精确名
+    void buildRenamePlan(const RenameMap &renameMap, RenameMap &plan) const;
+    //体积优先的重命名计划：renameMap 只决定哪些类改名，新名取最短的合法标识符，
+    //被引用的TU越多的类名字越短；并列时按旧名排序，结果确定
+    void buildShortRenamePlan(const RenameMap &renameMap, const NameGenerator &generator, unsigned minLength,
+                              RenameMap &plan, ShortNameStats &stats) const;
+    //TU 是否可能引用到计划中的名字；索引里没有的TU按需要处理
+    bool mayReferenceAny(llvm::StringRef mainFile, const RenameMap &plan) const;
+
+private:
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    llvm::ArrayRef<symbol_index::Symbol> symbolTable;
+    llvm::ArrayRef<symbol_index::TU> tuTable;
+    llvm::ArrayRef<symbol_index::Str> refTable;
+    llvm::ArrayRef<symbol_index::Str> identifierTable;
+    llvm::StringRef strings;
+};
@@ -0,0 +1,348 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "tu_prefilter.hpp"
+
+#include <set>
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+using namespace clang;
+using namespace clang::tooling;
+using namespace llvm;
+
+static std::string makeAbsolute(StringRef path, StringRef directory)
+{
+    SmallString<256> absolutePath(path);
+    if (!sys::path::is_absolute(absolutePath))
+    {
+        absolutePath = directory;
+        sys::path::append(absolutePath, path);
+    }
+    sys::path::remove_dots(absolutePath, true);
+    return absolutePath.str().str();
+}
+
+static bool isHeaderMap(StringRef path)
+{
+    return path.endswith(".hmap");
+}
+
+TUPrefilter::TUPrefilter(const LiteralScanner &aScanner, const SourceRoots &aRoots)
+: scanner(aScanner)
+, roots(aRoots)
+{
+}
+
+std::vector<std::string> TUPrefilter::filter(const CompilationDatabase &compilations, ArrayRef<std::string> files, unsigned jobs)
+{
+    SmallString<256> currentDir;
+    sys::fs::current_path(currentDir);
+    std::vector<char> keep(files.size(), 1);
+    {
+        llvm::ThreadPool pool(llvm::hardware_concurrency(jobs));
+        for (size_t i = 0; i < files.size(); i++)
+        {
+            pool.async([&, i]() {
+                std::string mainFile = makeAbsolute(files[i], currentDir);
+                std::vector<CompileCommand> commands = compilations.getCompileCommands(mainFile);
+                //没有编译命令时交给 ClangTool 照常报错
+                if (commands.empty())
+                    return;
+                keep[i] = llvm::any_of(commands, [&](const CompileCommand &command) {
+                    return mayNeedRewrite(mainFile, command);
+                });
+            });
+        }
+        pool.wait();
+    }
+    std::vector<std::string> kept;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (keep[i])
+            kept.push_back(files[i]);
+    }
+    return kept;
+}
+
+bool TUPrefilter::mayNeedRewrite(StringRef file, const CompileCommand &command)
+{
+    SearchPaths paths;
+    parseSearchPaths(command, paths);
+    if (paths.unresolvable)
+        return true;
+    std::vector<std::string> worklist(paths.prefixHeaders.rbegin(), paths.prefixHeaders.rend());
+    worklist.push_back(file.str());
+    std::set<std::string> visited(worklist.begin(), worklist.end());
+    while (!worklist.empty())
+    {
+        std::string path = std::move(worklist.back());
+        worklist.pop_back();
+        std::shared_ptr<const FileScan> fileScan = scan(path);
+        if (!fileScan->exists || fileScan->hit || fileScan->unresolvable)
+            return true;
+        StringRef includerDir = sys::path::parent_path(path);
+        for (const Include &include : fileScan->includes)
+        {
+            std::string resolved;
+            Resolution resolution = resolve(include, includerDir, paths, resolved);
+            if (resolution == Resolution::Unknown)
+                return true;
+            if (resolution == Resolution::User && visited.insert(resolved).second)
+                worklist.push_back(std::move(resolved));
+        }
+    }
+    return false;
+}
+
+void TUPrefilter::parseSearchPaths(const CompileCommand &command, SearchPaths &paths)
+{
+    paths.directory = command.Directory;
+    std::string sysroot = "/";
+    std::string resourceDir;
+    ArrayRef<std::string> args = command.CommandLine;
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        StringRef arg = args[i];
+        //"-I dir" 与 "-Idir" 两种写法
+        auto value = [&](StringRef flag, std::string &out) {
+            if (!arg.startswith(flag))
+                return false;
+            StringRef rest = arg.drop_front(flag.size());
+            if (rest.empty())
+            {
+                if (i + 1 >= args.size())
+                    return false;
+                rest = args[++i];
+            }
+            out = makeAbsolute(rest, command.Directory);
+            return true;
+        };
+        std::string dir;
+        if (arg.startswith("-include-pch"))
+            continue;
+        //虚拟文件系统覆盖和只取宏的头文件，文本扫描看不到它们的效果
+        if (arg.startswith("-ivfsoverlay") || arg.startswith("-imacros"))
+        {
+            paths.unresolvable = true;
+            continue;
+        }
+        //先匹配较长的选项名
+        if (value("-isysroot", dir) || value("--sysroot=", dir) || value("--sysroot", dir))
+            sysroot = dir;
+        else if (value("-resource-dir=", dir) || value("-resource-dir", dir))
+            resourceDir = dir;
+        else if (value("-iquote", dir))
+            paths.quoteDirs.push_back(dir);
+        else if (value("-isystem", dir))
+            paths.systemDirs.emplace_back(dir, false);
+        else if (value("-iframework", dir))
+            paths.systemDirs.emplace_back(dir, true);
+        else if (value("-idirafter", dir))
+            paths.afterDirs.push_back(dir);
+        else if (value("-include", dir))
+            paths.prefixHeaders.push_back(dir);
+        else if (value("-I", dir))
+            paths.angledDirs.emplace_back(dir, false);
+        else if (value("-F", dir))
+            paths.angledDirs.emplace_back(dir, true);
+    }
+    for (StringRef dir : {"usr/include", "usr/local/include"})
+        paths.sdkDirs.emplace_back(makeAbsolute(dir, sysroot), false);
+    for (StringRef dir : {"System/Library/Frameworks", "Library/Frameworks"})
+        paths.sdkDirs.emplace_back(makeAbsolute(dir, sysroot), true);
+    if (!resourceDir.empty())
+        paths.sdkDirs.emplace_back(makeAbsolute("include", resourceDir), false);
+}
+
+TUPrefilter::Resolution TUPrefilter::resolve(const Include &include, StringRef includerDir, const SearchPaths &paths,
+                                             std::string &resolved)
+{
+    auto found = [&]() {
+        return isUserPath(resolved, roots) ? Resolution::User : Resolution::System;
+    };
+    if (!include.angled)
+    {
+        if (findIn(includerDir, false, include.name, paths.directory, resolved))
+            return found();
+        for (const std::string &dir : paths.quoteDirs)
+        {
+            if (findIn(dir, false, include.name, paths.directory, resolved))
+                return found();
+        }
+    }
+    for (const auto &dir : paths.angledDirs)
+    {
+        if (findIn(dir.first, dir.second, include.name, paths.directory, resolved))
+            return found();
+    }
+    for (const auto &dir : paths.systemDirs)
+    {
+        if (findIn(dir.first, dir.second, include.name, paths.directory, resolved))
+            return Resolution::System;
+    }
+    for (const std::string &dir : paths.afterDirs)
+    {
+        if (findIn(dir, false, include.name, paths.directory, resolved))
+            return found();
+    }
+    //<...> 到这里只可能是 sysroot 中的 SDK 头文件；在 SDK 目录中也找不到时(如经 -ivfsoverlay 映射的用户框架)无法判断
+    if (include.angled)
+    {
+        for (const auto &dir : paths.sdkDirs)
+        {
+            if (findIn(dir.first, dir.second, include.name, paths.directory, resolved))
+                return found();
+        }
+    }
+    return Resolution::Unknown;
+}
+
+bool TUPrefilter::findIn(StringRef dir, bool isFramework, StringRef name, StringRef commandDir, std::string &resolved)
+{
+    if (isHeaderMap(dir))
+    {
+        const HeaderMap *headerMap = getHeaderMap(dir);
+        SmallString<256> destination;
+        if (!headerMap)
+            return false;
+        StringRef mapped = headerMap->lookupFilename(name, destination);
+        if (mapped.empty())
+            return false;
+        resolved = makeAbsolute(mapped, commandDir);
+        return exists(resolved);
+    }
+    SmallString<256> path(dir);
+    if (isFramework)
+    {
+        StringRef framework, header;
+        std::tie(framework, header) = name.split('/');
+        if (header.empty())
+            return false;
+        sys::path::append(path, framework + ".framework");
+        for (StringRef headersDir : {"Headers", "PrivateHeaders"})
+        {
+            SmallString<256> candidate(path);
+            sys::path::append(candidate, headersDir, header);
+            resolved = makeAbsolute(candidate, commandDir);
+            if (exists(resolved))
+                return true;
+        }
+        return false;
+    }
+    sys::path::append(path, name);
+    resolved = makeAbsolute(path, commandDir);
+    return exists(resolved);
+}
+
+bool TUPrefilter::exists(StringRef absolutePath)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = existence.find(absolutePath);
+        if (found != existence.end())
+            return found->second;
+    }
+    bool isFile = sys::fs::is_regular_file(absolutePath);
+    std::lock_guard<std::mutex> lock(mutex);
+    existence[absolutePath] = isFile;
+    return isFile;
+}
+
+std::shared_ptr<const TUPrefilter::FileScan> TUPrefilter::scan(StringRef absolutePath)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = scans.find(absolutePath);
+        if (found != scans.end())
+            return found->second;
+    }
+    //两个线程同时扫描同一文件时结果相同，先写入的保留
+    auto fileScan = std::make_shared<FileScan>();
+    //大文件由 MemoryBuffer 直接 mmap，不复制
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(absolutePath, /*IsText=*/false,
+                                                                          /*RequiresNullTerminator=*/false);
+    if (buffer)
+    {
+        StringRef content = (*buffer)->getBuffer();
+        fileScan->exists = true;
+        fileScan->hit = scanner.containsAny(content);
+        //已经命中时这个文件的包含关系不再需要
+        if (!fileScan->hit)
+            parseIncludes(content, *fileScan);
+        scannedFiles++;
+        scannedBytes += content.size();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return scans.try_emplace(absolutePath, std::move(fileScan)).first->second;
+}
+
+void TUPrefilter::parseIncludes(StringRef content, FileScan &fileScan)
+{
+    while (!content.empty())
+    {
+        StringRef line;
+        std::tie(line, content) = content.split('\n');
+        line = line.ltrim();
+        //@import 的模块由模块映射决定，无法从文本得出包含的头文件
+        if (line.startswith("@import"))
+        {
+            fileScan.unresolvable = true;
+            continue;
+        }
+        if (!line.consume_front("#"))
+            continue;
+        line = line.ltrim();
+        //include_next 总是沿后面的搜索路径找，按 <...> 处理
+        bool next = line.consume_front("include_next");
+        if (!next && !line.consume_front("import") && !line.consume_front("include"))
+            continue;
+        line = line.ltrim();
+        char close = line.startswith("<") ? '>' : line.startswith("\"") ? '"' : 0;
+        size_t end = close ? line.find(close, 1) : StringRef::npos;
+        if (end == StringRef::npos)
+        {
+            //#include MACRO
+            fileScan.unresolvable = true;
+            continue;
+        }
+        fileScan.includes.push_back({line.substr(1, end - 1).str(), next || close == '>'});
+    }
+}
+
+const HeaderMap *TUPrefilter::getHeaderMap(StringRef path)
+{
+    //FileManager 不是线程安全的，加载全程持锁；每个 .hmap 只加载一次
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = headerMaps.find(path);
+    if (found != headerMaps.end())
+        return found->second.get();
+    std::unique_ptr<HeaderMap> headerMap;
+    if (auto entry = fileManager.getFile(path))
+        headerMap = HeaderMap::Create(*entry, fileManager);
+    return headerMaps.try_emplace(path, std::move(headerMap)).first->second.get();
+}
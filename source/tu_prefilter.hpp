@@ -0,0 +1,121 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Lex/HeaderMap.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+
+#include "literal_scanner.hpp"
+#include "source_classifier.hpp"
+
+// 解析前的字节级预筛选(--prefilter)
+//
+// 改写只发生在用户源码中类名出现的位置，所以一个TU的主文件、前缀头文件以及它能到达的所有用户头文件中
+// 都不含重命名表的任何字面键时，这个TU不会产生任何改写，可以不解析。头文件按编译参数中的搜索路径
+// (-iquote、-I(含 .hmap)、-F、-isystem、-idirafter)从 #import/#include 文本解析，不考虑条件编译，
+// 得到的是实际包含关系的超集。-isystem 下、系统路径前缀下、第三方目录中的头文件不会被改写，不再展开；
+// 在 sysroot(-isysroot，缺省为 /)的 usr/include、System/Library/Frameworks 等目录或 -resource-dir 中
+// 找到的 <...> 视为 SDK 头文件。找不到的 "..." 和 <...>、宏形式的 #include、@import，以及命令行中的
+// -ivfsoverlay(Xcode 的 all-product-headers.yaml 把框架头文件映射到用户源码)、-imacros 都无法判断，
+// 这个TU照常解析。
+// 每个文件在一次运行中只读取(mmap)并扫描一次，结果被所有TU共享。
+class TUPrefilter
+{
+public:
+    TUPrefilter(const LiteralScanner &aScanner, const SourceRoots &aRoots);
+
+    //返回可能产生改写的TU，保持原顺序
+    std::vector<std::string> filter(const clang::tooling::CompilationDatabase &compilations,
+                                    llvm::ArrayRef<std::string> files, unsigned jobs);
+
+    unsigned getScannedFileCount() const { return scannedFiles; }
+    uint64_t getScannedBytes() const { return scannedBytes; }
+
+private:
+    struct Include
+    {
+        std::string name;
+        bool angled;
+    };
+    // 一个用户文件的扫描结果
+    struct FileScan
+    {
+        bool exists = false;
+        //含有重命名表的字面键
+        bool hit = false;
+        //有宏形式等无法解析的 #include，或有 @import
+        bool unresolvable = false;
+        std::vector<Include> includes;
+    };
+    // 一条编译命令的头文件搜索路径，均为绝对路径
+    struct SearchPaths
+    {
+        std::string directory;
+        std::vector<std::string> quoteDirs;
+        //-I 与 -F 按命令行顺序
+        std::vector<std::pair<std::string, bool>> angledDirs;
+        std::vector<std::pair<std::string, bool>> systemDirs;
+        std::vector<std::string> afterDirs;
+        //找不到的 <...> 只有在这些 SDK 目录中找到时才视为系统头文件
+        std::vector<std::pair<std::string, bool>> sdkDirs;
+        std::vector<std::string> prefixHeaders;
+        //有 -ivfsoverlay、-imacros，包含关系无法从文件系统得出
+        bool unresolvable = false;
+    };
+    enum class Resolution
+    {
+        User,
+        System,
+        Unknown,
+    };
+
+    bool mayNeedRewrite(llvm::StringRef file, const clang::tooling::CompileCommand &command);
+    static void parseSearchPaths(const clang::tooling::CompileCommand &command, SearchPaths &paths);
+    Resolution resolve(const Include &include, llvm::StringRef includerDir, const SearchPaths &paths, std::string &resolved);
+    //dir 下的 name；dir 为 .hmap 时按头文件映射查找，isFramework 时按 A/B.h -> A.framework/Headers/B.h 查找
+    bool findIn(llvm::StringRef dir, bool isFramework, llvm::StringRef name, llvm::StringRef commandDir, std::string &resolved);
+    bool exists(llvm::StringRef absolutePath);
+    std::shared_ptr<const FileScan> scan(llvm::StringRef absolutePath);
+    static void parseIncludes(llvm::StringRef content, FileScan &fileScan);
+    const clang::HeaderMap *getHeaderMap(llvm::StringRef path);
+
+    const LiteralScanner &scanner;
+    const SourceRoots &roots;
+    std::mutex mutex;
+    llvm::StringMap<std::shared_ptr<const FileScan>> scans;
+    llvm::StringMap<bool> existence;
+    clang::FileManager fileManager{clang::FileSystemOptions()};
+    llvm::StringMap<std::unique_ptr<clang::HeaderMap>> headerMaps;
+    std::atomic<unsigned> scannedFiles{0};
+    std::atomic<uint64_t> scannedBytes{0};
+};
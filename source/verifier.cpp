@@ -0,0 +1,264 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#include "verifier.hpp"
+#include "parallel_driver.hpp"
+
+#include <set>
+#include <tuple>
+
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+namespace {
+
+struct VerifyDiagnostic
+{
+    std::string file;
+    unsigned line = 0;
+    unsigned column = 0;
+    unsigned id = 0;
+    std::string message;
+};
+
+// 只收集错误，不打印
+class ErrorCollector : public DiagnosticConsumer
+{
+public:
+    explicit ErrorCollector(std::vector<VerifyDiagnostic> &aErrors) : errors(aErrors) {}
+    void HandleDiagnostic(DiagnosticsEngine::Level level, const Diagnostic &info) override
+    {
+        DiagnosticConsumer::HandleDiagnostic(level, info);
+        if (level < DiagnosticsEngine::Error)
+            return;
+        VerifyDiagnostic diagnostic;
+        diagnostic.id = info.getID();
+        SmallString<256> message;
+        info.FormatDiagnostic(message);
+        diagnostic.message = message.str().str();
+        if (info.getLocation().isValid() && info.hasSourceManager())
+        {
+            const SourceManager &sm = info.getSourceManager();
+            PresumedLoc presumed = sm.getPresumedLoc(sm.getExpansionLoc(info.getLocation()));
+            if (presumed.isValid())
+            {
+                diagnostic.file = getNormalizedAbsolutePath(presumed.getFilename());
+                diagnostic.line = presumed.getLine();
+                diagnostic.column = presumed.getColumn();
+            }
+        }
+        errors.push_back(std::move(diagnostic));
+    }
+
+private:
+    std::vector<VerifyDiagnostic> &errors;
+};
+
+// 语法检查，诊断交给 ErrorCollector
+class VerifyActionFactory : public FrontendActionFactory
+{
+public:
+    explicit VerifyActionFactory(std::vector<VerifyDiagnostic> &aErrors) : collector(aErrors) {}
+    std::unique_ptr<FrontendAction> create() override { return std::make_unique<SyntaxOnlyAction>(); }
+    bool runInvocation(std::shared_ptr<CompilerInvocation> Invocation, FileManager *Files,
+                       std::shared_ptr<PCHContainerOperations> PCHContainerOps,
+                       DiagnosticConsumer *DiagConsumer) override
+    {
+        return FrontendActionFactory::runInvocation(Invocation, Files, PCHContainerOps, &collector);
+    }
+
+private:
+    ErrorCollector collector;
+};
+
+// 改写后的内容，引用 RewrittenFileSystem 共享的缓冲
+class RewrittenFile : public vfs::File
+{
+public:
+    RewrittenFile(StringRef aContent, vfs::Status aStatus) : content(aContent), fileStatus(std::move(aStatus)) {}
+    ErrorOr<vfs::Status> status() override { return fileStatus; }
+    ErrorOr<std::unique_ptr<MemoryBuffer>> getBuffer(const Twine &Name, int64_t FileSize,
+                                                     bool RequiresNullTerminator, bool IsVolatile) override
+    {
+        //std::string 的内容以 \0 结尾
+        return MemoryBuffer::getMemBuffer(content, Name.str(), RequiresNullTerminator);
+    }
+    std::error_code close() override { return std::error_code(); }
+
+private:
+    StringRef content;
+    vfs::Status fileStatus;
+};
+
+// 被改写的文件从内存中读取，其余访问直接转给 fs；改写表只读，所有线程共享，工作目录由每个线程的 fs 各自维护
+class RewrittenFileSystem : public vfs::ProxyFileSystem
+{
+public:
+    RewrittenFileSystem(IntrusiveRefCntPtr<vfs::FileSystem> fs, const StringMap<std::string> &aRewritten)
+    : ProxyFileSystem(std::move(fs))
+    , rewritten(aRewritten)
+    {
+    }
+
+    ErrorOr<vfs::Status> status(const Twine &Path) override
+    {
+        ErrorOr<vfs::Status> result = getUnderlyingFS().status(Path);
+        const std::string *content = find(Path);
+        if (!result || !content)
+            return result;
+        return withSize(*result, content->size());
+    }
+
+    ErrorOr<std::unique_ptr<vfs::File>> openFileForRead(const Twine &Path) override
+    {
+        const std::string *content = find(Path);
+        if (!content)
+            return getUnderlyingFS().openFileForRead(Path);
+        ErrorOr<vfs::Status> result = getUnderlyingFS().status(Path);
+        if (!result)
+            return result.getError();
+        return std::unique_ptr<vfs::File>(new RewrittenFile(*content, withSize(*result, content->size())));
+    }
+
+private:
+    const std::string *find(const Twine &Path)
+    {
+        SmallString<256> absolutePath;
+        Path.toVector(absolutePath);
+        if (makeAbsolute(absolutePath))
+            return nullptr;
+        sys::path::remove_dots(absolutePath, /*remove_dot_dot=*/true);
+        auto found = rewritten.find(absolutePath);
+        return found == rewritten.end() ? nullptr : &found->second;
+    }
+    static vfs::Status withSize(const vfs::Status &status, uint64_t size)
+    {
+        return vfs::Status(status.getName(), status.getUniqueID(), status.getLastModificationTime(), status.getUser(),
+                           status.getGroup(), size, status.getType(), status.getPermissions());
+    }
+
+    const StringMap<std::string> &rewritten;
+};
+
+} // namespace
+
+RewriteVerifier::RewriteVerifier(const CompilationDatabase &aCompilations, unsigned aJobs)
+: compilations(aCompilations)
+, jobs(aJobs)
+{
+}
+
+unsigned RewriteVerifier::verify(const std::map<std::string, tooling::Replacements> &replacements,
+                                 ArrayRef<std::string> files, ArrayRef<TUResult> results, raw_ostream &log)
+{
+    //与 OutputWriter 写出的内容相同
+    StringMap<std::string> rewritten;
+    unsigned problems = 0;
+    for (const auto &fileReplacements : replacements)
+    {
+        if (fileReplacements.second.empty())
+            continue;
+        ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(fileReplacements.first);
+        if (!buffer)
+        {
+            log << "verify: cannot read " << fileReplacements.first << ": " << buffer.getError().message() << "\n";
+            problems++;
+            continue;
+        }
+        Expected<std::string> code = tooling::applyAllReplacements((*buffer)->getBuffer(), fileReplacements.second);
+        if (!code)
+        {
+            log << "verify: cannot apply the edits to " << fileReplacements.first << ": "
+                << toString(code.takeError()) << "\n";
+            problems++;
+            continue;
+        }
+        rewritten[fileReplacements.first] = std::move(*code);
+    }
+
+    //包含关系未知(内存受限模式已释放)的TU同样验证
+    std::vector<std::string> affected;
+    std::vector<std::string> hadErrors;
+    for (size_t i = 0; i < files.size() && i < results.size(); i++)
+    {
+        const TUResult &result = results[i];
+        std::string mainFile = getNormalizedAbsolutePath(files[i]);
+        bool touched = rewritten.count(mainFile) || result.includedFiles.empty() ||
+                       llvm::any_of(result.includedFiles, [&](const std::string &file) { return rewritten.count(file); });
+        if (!touched)
+            continue;
+        affected.push_back(files[i]);
+        if (result.hasErrors)
+            hadErrors.push_back(files[i]);
+    }
+    parsedCount = affected.size();
+
+    auto mount = [&](IntrusiveRefCntPtr<vfs::FileSystem> fs) -> IntrusiveRefCntPtr<vfs::FileSystem> {
+        return new RewrittenFileSystem(std::move(fs), rewritten);
+    };
+    std::vector<std::vector<VerifyDiagnostic>> errors(affected.size());
+    runActionsInParallel(compilations, affected, jobs, [&](size_t i) -> std::unique_ptr<FrontendActionFactory> {
+        return std::make_unique<VerifyActionFactory>(errors[i]);
+    }, nullptr, nullptr, mount);
+    std::vector<std::vector<VerifyDiagnostic>> baselineErrors(hadErrors.size());
+    runActionsInParallel(compilations, hadErrors, jobs, [&](size_t i) -> std::unique_ptr<FrontendActionFactory> {
+        return std::make_unique<VerifyActionFactory>(baselineErrors[i]);
+    });
+    std::map<std::string, std::multiset<std::tuple<std::string, unsigned, unsigned>>> baseline;
+    for (size_t i = 0; i < hadErrors.size(); i++)
+    {
+        for (const VerifyDiagnostic &diagnostic : baselineErrors[i])
+            baseline[hadErrors[i]].insert(std::make_tuple(diagnostic.file, diagnostic.line, diagnostic.id));
+    }
+
+    //头文件中的同一个错误在每个包含它的TU中都会出现，只报告一次
+    std::set<std::tuple<std::string, unsigned, unsigned, std::string>> reported;
+    for (size_t i = 0; i < affected.size(); i++)
+    {
+        auto known = baseline.find(affected[i]);
+        for (const VerifyDiagnostic &diagnostic : errors[i])
+        {
+            if (known != baseline.end())
+            {
+                auto same = known->second.find(std::make_tuple(diagnostic.file, diagnostic.line, diagnostic.id));
+                if (same != known->second.end())
+                {
+                    known->second.erase(same);
+                    continue;
+                }
+            }
+            if (!reported.insert(std::make_tuple(diagnostic.file, diagnostic.line, diagnostic.column,
+                                                 diagnostic.message)).second)
+                continue;
+            log << "verify: " << (diagnostic.file.empty() ? affected[i] : diagnostic.file);
+            if (diagnostic.line)
+                log << ":" << diagnostic.line << ":" << diagnostic.column;
+            log << ": error: " << diagnostic.message << " (in " << affected[i] << ")\n";
+            problems++;
+        }
+    }
+    return problems;
+}
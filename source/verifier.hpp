@@ -0,0 +1,53 @@
+//===----------------------------------------------------------------------===//
+//                           The MIT License (MIT)
+//             Copyright (c) 2020 Douglas Chen <dougpuob@gmail.com>
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "objc_obfuscator.hpp"
+
+#include "clang/Tooling/CompilationDatabase.h"
+
+// 改写后的验证(--verify)
+//
+// 把合并后的编辑应用到原文件内容上，得到的缓冲经覆盖在每个线程文件系统之上的一层提供给 clang，不写磁盘；
+// 引用了被改写文件的TU并行地只做语法检查重新解析，报告改写后新出现的错误。
+// 第一遍已有错误的TU同时解析原文件，按 (文件, 行, 诊断ID) 去掉原本就有的错误；改名不跨行，行号不受影响。
+class RewriteVerifier
+{
+public:
+    RewriteVerifier(const CompilationDatabase &aCompilations, unsigned aJobs);
+
+    //files 与 results 按下标对应；返回新出现的错误个数
+    unsigned verify(const std::map<std::string, tooling::Replacements> &replacements, ArrayRef<std::string> files,
+                    ArrayRef<TUResult> results, raw_ostream &log);
+    size_t getParsedCount() const { return parsedCount; }
+
+private:
+    const CompilationDatabase &compilations;
+    unsigned jobs;
+    size_t parsedCount = 0;
+};